@@ -1,5 +1,6 @@
 #include "Marlin.h"
 #include "planner.h"
+#include "stepper.h"
 #include "temperature.h"
 #include "ConfigurationStore.h"
 
@@ -133,39 +134,25 @@ uint32_t EEPROM_Read_PLR_0()
     return lFPos;
 }
 
-String EEPROM_Read_PLR()
+void EEPROM_Read_PLR(PowerLossState &s)
 {
-    String strRet = "";
-    uint32_t lFPos;
-    int iTPos;
-    int iTPos1;
-    int iFanPos = 200;
-    int iT01;
-    int iBPos;
-    float fZPos;
-    float fEPos;
-    float fXPos = 0.0;
-    float fYPos = 0.0;
-    int i_dual_x_carriage_mode;
-    float f_duplicate_extruder_x_offset;
-    float f_feedrate;
-
     int i = 300;
-    EEPROM_READ_VAR(i, lFPos);
-    EEPROM_READ_VAR(i, iTPos);
-    EEPROM_READ_VAR(i, iTPos1);
-    EEPROM_READ_VAR(i, iT01);
-    EEPROM_READ_VAR(i, fZPos);
-    EEPROM_READ_VAR(i, fEPos);
+    EEPROM_READ_VAR(i, s.file_pos);
+    EEPROM_READ_VAR(i, s.temp0);
+    EEPROM_READ_VAR(i, s.temp1);
+    EEPROM_READ_VAR(i, s.active_extruder);
+    EEPROM_READ_VAR(i, s.z);
+    EEPROM_READ_VAR(i, s.e);
 
     i = 350;
-    EEPROM_READ_VAR(i, iBPos);
-    EEPROM_READ_VAR(i, i_dual_x_carriage_mode);
-    EEPROM_READ_VAR(i, f_duplicate_extruder_x_offset);
-    EEPROM_READ_VAR(i, f_feedrate);
-    //               1FPos                2TPos                3TPos1				4T01                   5ZPos                 6EPos                  7FanPos                   8XPos                 9YPos                 10BPos                     11DXCM                                     12DEXO                                      13Feedrate
-    strRet = String(lFPos) + "|" + String(iTPos) + "|" + String(iTPos1) + "|" + String(iT01) + "|" + String(fZPos) + "|" + String(fEPos) + "|" + String(iFanPos) + "|" + String(fXPos) + "|" + String(fYPos) + "|" + String(iBPos) + "|" + String(i_dual_x_carriage_mode) + "|" + String(f_duplicate_extruder_x_offset) + "|" + String(f_feedrate);
-    return strRet;
+    EEPROM_READ_VAR(i, s.bed);
+    EEPROM_READ_VAR(i, s.dual_x_mode);
+    EEPROM_READ_VAR(i, s.dup_x_offset);
+    EEPROM_READ_VAR(i, s.feedrate);
+
+    s.fan = 200;
+    s.x = 0.0;
+    s.y = 0.0;
 }
 
 #endif //POWER_LOSS_SAVE_TO_EEPROM
@@ -261,6 +248,15 @@ void Config_StoreSettings()
 #endif
     EEPROM_WRITE_VAR(i, lcd_contrast);
 
+#ifdef LIN_ADVANCE
+    EEPROM_WRITE_VAR(i, extruder_advance_k);
+#endif
+
+#ifdef INPUT_SHAPING
+    EEPROM_WRITE_VAR(i, shaping_frequency);
+    EEPROM_WRITE_VAR(i, shaping_zeta);
+#endif
+
     char ver2[4] = EEPROM_VERSION;
     i = EEPROM_OFFSET;
     EEPROM_WRITE_VAR(i, ver2); // validate data
@@ -327,6 +323,29 @@ void Config_PrintSettings()
     SERIAL_ECHOPAIR(" Y", add_homeing[1]);
     SERIAL_ECHOPAIR(" Z", add_homeing[2]);
     SERIAL_ECHOLN("");
+#ifdef LIN_ADVANCE
+    SERIAL_ECHO_START;
+    SERIAL_ECHOPGM("Linear advance K (mm per mm/s):");
+    for (short e = 0; e < EXTRUDERS; e++)
+    {
+        SERIAL_ECHO_START;
+        SERIAL_ECHOPAIR("  M900 T", (unsigned long)e);
+        SERIAL_ECHOPAIR(" K", extruder_advance_k[e]);
+        SERIAL_ECHOLN("");
+    }
+#endif
+#ifdef INPUT_SHAPING
+    SERIAL_ECHO_START;
+    SERIAL_ECHOPGM("Input shaping: F=frequency (Hz), D=damping ratio");
+    SERIAL_ECHO_START;
+    SERIAL_ECHOPAIR("  M593 X F", shaping_frequency[X_AXIS]);
+    SERIAL_ECHOPAIR(" D", shaping_zeta[X_AXIS]);
+    SERIAL_ECHOLN("");
+    SERIAL_ECHO_START;
+    SERIAL_ECHOPAIR("  M593 Y F", shaping_frequency[Y_AXIS]);
+    SERIAL_ECHOPAIR(" D", shaping_zeta[Y_AXIS]);
+    SERIAL_ECHOLN("");
+#endif
 #ifdef PIDTEMP
     SERIAL_ECHO_START;
     SERIAL_ECHOPGM("PID settings:");
@@ -462,6 +481,32 @@ void Config_RetrieveSettings()
 #endif
         EEPROM_READ_VAR(i, lcd_contrast);
 
+#ifdef LIN_ADVANCE
+        // stored by older firmware without linear advance: the bytes are not a valid K
+        EEPROM_READ_VAR(i, extruder_advance_k);
+        for (short e = 0; e < EXTRUDERS; e++)
+        {
+            if (!(extruder_advance_k[e] >= 0 && extruder_advance_k[e] <= 10))
+                extruder_advance_k[e] = LIN_ADVANCE_K;
+        }
+#endif
+
+#ifdef INPUT_SHAPING
+        EEPROM_READ_VAR(i, shaping_frequency);
+        EEPROM_READ_VAR(i, shaping_zeta);
+        if (!(shaping_frequency[X_AXIS] >= 0 && shaping_frequency[X_AXIS] <= 500 && shaping_zeta[X_AXIS] >= 0 && shaping_zeta[X_AXIS] < 1))
+        {
+            shaping_frequency[X_AXIS] = SHAPING_FREQ_X;
+            shaping_zeta[X_AXIS] = SHAPING_ZETA_X;
+        }
+        if (!(shaping_frequency[Y_AXIS] >= 0 && shaping_frequency[Y_AXIS] <= 500 && shaping_zeta[Y_AXIS] >= 0 && shaping_zeta[Y_AXIS] < 1))
+        {
+            shaping_frequency[Y_AXIS] = SHAPING_FREQ_Y;
+            shaping_zeta[Y_AXIS] = SHAPING_ZETA_Y;
+        }
+        st_set_shaping();
+#endif
+
         // Call updatePID (similar to when we have processed M301)
         updatePID();
 
@@ -500,6 +545,17 @@ void Config_ResetDefault()
     max_z_jerk = DEFAULT_ZJERK;
     max_e_jerk = DEFAULT_EJERK;
     add_homeing[0] = add_homeing[1] = add_homeing[2] = 0;
+#ifdef LIN_ADVANCE
+    for (short e = 0; e < EXTRUDERS; e++)
+        extruder_advance_k[e] = LIN_ADVANCE_K;
+#endif
+#ifdef INPUT_SHAPING
+    shaping_frequency[X_AXIS] = SHAPING_FREQ_X;
+    shaping_frequency[Y_AXIS] = SHAPING_FREQ_Y;
+    shaping_zeta[X_AXIS] = SHAPING_ZETA_X;
+    shaping_zeta[Y_AXIS] = SHAPING_ZETA_Y;
+    st_set_shaping();
+#endif
 
     plaPreheatHotendTemp = PLA_PREHEAT_HOTEND_TEMP;
     plaPreheatHPBTemp = PLA_PREHEAT_HPB_TEMP;
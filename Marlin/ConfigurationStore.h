@@ -20,7 +20,7 @@ FORCE_INLINE void Config_PrintSettings()
         void EEPROM_Write_PLR(uint32_t lFPos = 0, int iTPos = 0, int iTPos1 = 0, int iT01 = 0, float fZPos = 0.0, float fEPos = 0.0);
         void EEPROM_PRE_Write_PLR(uint32_t lFPos = 0, int iBPos = 0, int i_dual_x_carriage_mode = 0, float f_duplicate_extruder_x_offset = 0.0, float f_feedrate = 0.0);
         uint32_t EEPROM_Read_PLR_0();
-        String EEPROM_Read_PLR();
+        void EEPROM_Read_PLR(PowerLossState &s);
     #endif //POWER_LOSS_SAVE_TO_EEPROM
 #else
     FORCE_INLINE void Config_StoreSettings()
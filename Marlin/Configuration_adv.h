@@ -10,6 +10,17 @@
 #endif
 #define BED_CHECK_INTERVAL 5000 //ms between checks in bang-bang control
 
+// Drive the heaters from the AVR hardware PWM channels instead of the soft PWM in Temp_Controll(),
+// so the temperature ISR only samples the ADC for those outputs.
+// Only heaters on a free timer output are moved (Mega2560: D2,D3,D5,D9,D10,D44,D45 and D6-D8 for the bed);
+// D11/D12 (Timer1 = stepper) and D4/D13 (Timer0 = millis/temperature ISR) keep the soft PWM.
+// Each heater moved off the soft PWM saves ~10-14 cycles (~0.8us) per temperature ISR tick (976Hz).
+//#define HEATER_HW_PWM
+#ifdef HEATER_HW_PWM
+// The bed SSR (D6/D7/D8) is switched by Timer4 at this low frequency. Other Timer4 pins follow it.
+#define BED_HW_PWM_FREQUENCY 4 //Hz
+#endif
+
 //// Heating sanity check:
 // This waits for the watchperiod in milliseconds whenever an M104 or M109 increases the target temperature
 // If the temperature has not increased at the end of that period, the target temperature is set to zero.
@@ -188,6 +199,22 @@
 #define TOOLCHANGE_PARK_ZLIFT 0   // the distance to raise Z axis when parking an extruder		//By Zyf 0.2
 #define TOOLCHANGE_UNPARK_ZLIFT 0 // the distance to raise Z axis when unparking an extruder	//By zyf
 
+// Tool changes go through the planner: the park moves, the new extruder offsets and the unpark moves
+// follow each other in the block buffer instead of waiting for the machine to stop twice. X is only
+// re-homed on a tool change when nothing is queued (not while streaming a print) or after the X2 offset
+// was changed.
+//#define TOOLCHANGE_PIPELINED
+
+// G28 homes both X carriages and Y in the same moves: X1 runs to X min, X2 mirrored to X max and Y to its
+// endstop, each stopping on its own endstop. Speeds are homing_feedrate / divisor, the defaults are the
+// ones used when the axes are homed one by one.
+//#define HOMING_XY_TOGETHER
+#ifdef HOMING_XY_TOGETHER
+#define HOMING_FAST_DIVISOR 30    // first approach
+#define HOMING_RETRACT_DIVISOR 120 // back off by X/Y_HOME_RETRACT_MM
+#define HOMING_BUMP_DIVISOR 360   // slow second approach
+#endif
+
 // Default x offset in duplication mode (typically set to half print bed width)
 
 #endif
@@ -204,6 +231,20 @@
     }
 
 #define MAX_STEP_FREQUENCY 40000 // Max step frequency for Ultimaker (5000 pps / half step)
+// Above this step rate the stepper interrupt makes 2 steps per interrupt, above twice it 4 steps. Each burst
+// puts the steps back to back, so high rates get uneven. A higher value keeps single steps longer but the
+// stepper interrupt then has to finish within 1/DOUBLE_STEP_FREQUENCY s (S-curve, input shaping and linear
+// advance all add to it). Keep MAX_STEP_FREQUENCY <= 4 * DOUBLE_STEP_FREQUENCY.
+#define DOUBLE_STEP_FREQUENCY 10000 // steps/s
+// Step rates from 2048 steps/s up are interpolated between table rows 2^SPEED_TABLE_SHIFT steps/s apart
+// (8 = 256 steps/s, down to 5 = 32 steps/s). A lower shift takes the interpolation error from a few ticks
+// near 2048 steps/s to below one tick, at 4 bytes of flash per row up to DOUBLE_STEP_FREQUENCY.
+#define SPEED_TABLE_SHIFT 8
+// Step timer periods in 1/2^STEP_TIMER_FRACTION_BITS ticks (0.5us) above 2048 steps/s. The stepper interrupt
+// adds the dropped fractions up and makes a period one tick longer whenever they reach a tick, so the speed of
+// a move no longer snaps to whole-tick periods (0.5% steps at 10kHz). With it DOUBLE_STEP_FREQUENCY can be
+// raised to keep single, evenly spaced steps at higher rates instead of bursts.
+//#define STEP_TIMER_FRACTION_BITS 4
 
 //By default pololu step drivers require an active high signal. However, some high power drivers require an active low signal as step.
 #define INVERT_X_STEP_PIN false
@@ -223,6 +264,17 @@
 // If defined the movements slow down when the look ahead buffer is only half full
 #define SLOWDOWN
 
+// Counts how many blocks are left queued each time the stepper finishes one, how often SLOWDOWN stretches a
+// move, and how often and how long the stepper runs out of blocks during an SD print. M1045 prints the
+// counts, M1045 R clears them. 76 bytes of RAM.
+//#define PLANNER_STATS
+
+// Remaining time of SD prints from the duration of the planned trapezoids. A host pre-pass over the file with
+// the same planner settings puts M1047 S<seconds of moves> at its top; without it the remaining time is
+// extrapolated from the move time spent on the part of the file read so far. M1047 reports it, the TJC status
+// line gets it as field 22 and the DWIN screen at VP 0x7550.
+//#define PRINT_TIME_ESTIMATE
+
 // Frequency limit
 // See nophead's blog for more info
 // Not working O
@@ -233,6 +285,51 @@
 // if unwanted behavior is observed on a user's machine when running at very slow speeds.
 #define MINIMUM_PLANNER_SPEED 0.05 // (mm/sec)
 
+// Linear advance (pressure advance). The stepper interrupt pushes the filament ahead of the nozzle
+// by K * extrusion speed, so the pressure in the melt zone follows the acceleration of the move.
+// K is in mm of filament per mm/s of extrusion speed, set for each extruder with M900 T<extruder> K<k>
+// and saved with M500. K=0 turns it off for that extruder.
+//#define LIN_ADVANCE
+#ifdef LIN_ADVANCE
+#define LIN_ADVANCE_K 0.0        // default K for all extruders
+#define LIN_ADVANCE_MAX_STEPS 4  // max extra E steps per stepper interrupt
+#endif
+
+// S-curve acceleration. The step rate follows a 5th order Bezier (10t^3-15t^4+6t^5) from the entry to
+// the cruise rate and from the cruise to the exit rate instead of a straight ramp, so the acceleration
+// starts and ends at zero. Each ramp takes as long as the trapezoid ramp it replaces, the peak
+// acceleration is 1.875x the set acceleration. Costs ~300 cycles per stepper interrupt while ramping.
+//#define S_CURVE_ACCELERATION
+
+// Input shaping for X and Y. The X/Y drivers follow a mix of the planned position and the planned position
+// half a ringing period ago (ZV), which cancels the ringing of the frame at that frequency.
+// Set with M593 X|Y F<frequency Hz> D<damping ratio>, F0 turns it off for that axis. Saved with M500.
+// The X/Y position lags the plan by up to half a period (a full period for ZVD) and it costs ~250 cycles
+// per stepper interrupt. Endstop moves (homing) are never shaped.
+//#define INPUT_SHAPING
+#ifdef INPUT_SHAPING
+#define SHAPING_FREQ_X 40.0 // Hz, 0 = off
+#define SHAPING_FREQ_Y 40.0 // Hz, 0 = off
+#define SHAPING_ZETA_X 0.1  // damping ratio
+#define SHAPING_ZETA_Y 0.1
+// ZVD adds a third impulse: more tolerant of a wrong frequency, but twice the lag and a minimum of ~16Hz
+// instead of ~8Hz (64 x 1ms position history).
+//#define SHAPING_ZVD
+#define SHAPING_MAX_STEPS 8 // max X/Y steps per stepper interrupt from the shaper
+#endif
+
+// Segment coalescing. A short G0/G1 is merged with the queued G0/G1 lines that continue it in the same
+// direction (within SEGMENT_COALESCING_ANGLE of the merged chord) at the same feedrate and extrusion per mm
+// (within SEGMENT_COALESCING_E_RATIO), so finely tessellated curves take fewer planner blocks.
+// Set with M594 A<angle> E<ratio %> S<short segment mm> L<max merged mm>, L0 turns it off.
+//#define SEGMENT_COALESCING
+#ifdef SEGMENT_COALESCING
+#define SEGMENT_COALESCING_ANGLE 1.0    // degrees
+#define SEGMENT_COALESCING_E_RATIO 5.0  // percent
+#define SEGMENT_COALESCING_SHORT_MM 1.0 // mm, only segments shorter than this are merged
+#define SEGMENT_COALESCING_MAX_MM 5.0   // mm, max length of a merged move
+#endif
+
 // MS1 MS2 Stepper Driver Microstepping mode table
 #define MICROSTEP1 LOW, LOW
 #define MICROSTEP2 HIGH, LOW
@@ -258,6 +355,49 @@
 
 #define SD_FINISHED_RELEASECOMMAND "M84 X Y Z E" // You might want to keep the z enabled so your bed stays in place.
 
+// getnrfilenames() notes where each file of the directory starts, so getfilename() reads that entry
+// instead of walking the directory from the start. Directories with more files fall back to the walk
+// for the rest. Costs 2 bytes of RAM per file.
+#define SD_DIR_INDEX_SIZE 128
+
+// M1043 <bytes> <filename> uploads a file much faster than M28: the host sends raw 512 byte chunks (the last
+// one only as long as the rest of the file), each followed by its CRC-16/XMODEM (2 bytes, little endian), and
+// waits for "ok <chunk>" before the next. A chunk answered with "rs <chunk>" is sent again. The chunks go
+// straight into a contiguous file with one multi block write. SD_UPLOAD_TIMEOUT ms without data cancel it.
+//#define SD_FAST_UPLOAD
+#define SD_UPLOAD_TIMEOUT 5000
+
+// SD files that start with "TLB1" hold binary G-code, so moves need no number parsing and take about half
+// the bytes of the text. After the 4 byte header every record starts with a type byte (little endian):
+//   0x00-0x1F  move, the byte is a mask of X=1 Y=2 Z=4 E=8 F=16, followed by one int32 per set bit in that
+//              order in 1/1000 mm (F in 1/1000 mm/min). Does what the G1 line with these words does.
+//   0x80       any other command, a length byte n (1-95) and n ASCII characters without comment or newline.
+// Print from Z height reads such a file up to the height instead of bisecting it.
+//#define BINARY_GCODE
+
+// With BINARY_GCODE the host can also stream these records in frames between text lines:
+//   0xB5, sequence byte, length byte n, n bytes of one record, CRC-16/XMODEM of sequence, length and record
+//   (2 bytes, little endian).
+// Each frame is answered with "ok B<sequence>" once its command ran, so the host may keep as many frames in
+// flight as there are command buffer slots (BUFSIZE). A bad or out of order frame is answered once with
+// "rs B<expected sequence>"; everything up to a good frame with that sequence is dropped. A frame whose sync
+// byte was damaged is read as a text line, so the host sends a newline before it sends frames again
+// (tools/frame_sender does, and tests all this in a loopback).
+//#define BINARY_SERIAL
+
+// Times the sections of loop() and the waits for a free planner block with micros(); M1044 prints count,
+// min, avg and max per section and M1044 R clears them. Costs 180 bytes of RAM and a few us per loop.
+//#define LOOP_PROFILER
+
+// Paints the free RAM at boot so M1046 can tell how low the stack ever got, next to the static data, heap and
+// largest free heap block sizes.
+//#define SRAM_REPORT
+
+// Appends a line to JOBLOG.CSV on the card when an SD print finishes: file name, total seconds, seconds spent
+// waiting for heaters (M109/M190) and with an empty planner, tool changes, pauses, filament runouts, the
+// highest stepper interrupt load in % of the step interval and serial resend requests.
+//#define JOB_LOG
+
 // The hardware watchdog should reset the Microcontroller disabling all outputs, in case the firmware gets stuck and doesn't do temperature regulation.
 //#define USE_WATCHDOG
 
@@ -267,6 +407,16 @@
 // Arc interpretation settings:
 #define MM_PER_ARC_SEGMENT 1
 #define N_ARC_CORRECTION 25
+// Adaptive arc segments: the chords are as long as ARC_MAX_DEVIATION from the arc allows, so large radii
+// become a few long blocks and small radii stay accurate. Chords are not made shorter than the feedrate
+// covers in ARC_MIN_SEGMENT_TIME, so small fast arcs don't drain the planner (the deviation grows there).
+// Off by default (fixed MM_PER_ARC_SEGMENT chords); tools/arc_compare shows the effect on a G-code file.
+//#define ARC_MAX_DEVIATION 0.01  // mm
+#ifdef ARC_MAX_DEVIATION
+#define ARC_MIN_SEGMENT_MM 0.1  // mm
+#define ARC_MAX_SEGMENT_MM 10.0 // mm
+#define ARC_MIN_SEGMENT_TIME 10 // ms
+#endif
 
 const unsigned int dropsegments = 5; //everything with less than this number of steps will be ignored as move and joined with the next movement
 
@@ -312,6 +462,17 @@ const unsigned int dropsegments = 5; //everything with less than this number of
 #define MAX_CMD_SIZE 96
 #define BUFSIZE 4
 
+// Receive ring of the host serial port in bytes, a power of 2. M1042 shows how full it got and the bytes lost.
+#define RX_BUFFER_SIZE 128
+
+// Every plain "ok" also tells the host the free planner blocks and command buffer slots ("ok P15 B3"), so
+// it can keep both buffers full instead of sending one line per ok.
+//#define ADVANCED_OK
+
+// M155 S<seconds> prints the temperatures and M154 S<seconds> the position every so many seconds from the
+// idle loop, without polling commands taking buffer slots. S0 stops the report.
+//#define AUTO_REPORT
+
 // Firmware based and LCD controled retract
 // M207 and M208 can be used to define parameters for the retraction.
 // The retraction can be called by the slicer using G10 and G11
@@ -120,6 +120,11 @@ EOF UPDATE LOG
 #define POWER_LOSS_RECOVERY
 #define PRINT_FROM_Z_HEIGHT
 
+// Keep NAME.ZIX beside each printed G-code file with the file position of every layer, written on the first
+// full print or by M1041. Print from Z height then seeks straight to the layer instead of searching the file.
+//#define Z_LAYER_INDEX
+#define Z_LAYER_INDEX_MIN_STEP 0.05 // smaller Z steps (vase mode) do not start a new layer entry
+
 //#define DRIVER_2225
 #define DRIVER_2208 //Same as 2209
 //#define DRIVER_4988
@@ -322,6 +327,14 @@ const bool Y_ENDSTOPS_INVERTING = true; //Y Optical switch
 #define POWER_LOSS_SAVE_TO_EEPROM
 #define POWER_LOSS_TRIGGER_BY_PIN
 
+// Catch the detect pin with a pin change / external interrupt instead of polling it at the top of the
+// stepper and temperature ISRs. The stock detect pin D32 (PC5) has no interrupt, so the signal must be wired
+// to an INTx (D2,D3,D18-D21) or PCINT (D10-D15,D50-D53,D62-D69) pin given by POWER_LOSS_DETECT_INT_PIN.
+//#define POWER_LOSS_DETECT_BY_INTERRUPT
+#ifdef POWER_LOSS_DETECT_BY_INTERRUPT
+#define POWER_LOSS_DETECT_INT_PIN 63 //A9
+#endif
+
 #if !defined(POWER_LOSS_TRIGGER_BY_PIN)
 #define POWER_LOSS_TRIGGER_BY_Z_LEVEL
 #if !defined(POWER_LOSS_TRIGGER_BY_Z_LEVEL)
@@ -229,6 +229,7 @@ bool IsStopped();
 
 void enquecommand(const char *cmd);   //put an ascii command at the end of the current buffer.
 void enquecommand_P(const char *cmd); //put an ascii command at the end of the current buffer, read from flash
+void discard_queued_commands();       //drop the commands queued behind the one being processed
 void prepare_arc_move(char isclockwise);
 void clamp_to_software_endstops(float target[3]);
 
@@ -242,14 +243,64 @@ void command_M81(bool Loop = true, bool ShowPage = true);
 #ifdef POWER_LOSS_TRIGGER_BY_PIN
 bool Check_Power_Loss();
 #endif
+#ifdef POWER_LOSS_DETECT_BY_INTERRUPT
+extern volatile bool bPowerLossActive;
+void Power_Loss_Init();
+void Power_Loss_Manage();
+#endif
 void Power_Off_Handler(bool MoveX = true, bool M81 = true);
 void Save_Power_Loss_Status();
+
+// State saved for resuming an interrupted SD print, filled by card.get_PLR() / isPowerLoss().
+struct PowerLossState
+{
+    char long_name[32];
+    char name[13];
+    uint32_t file_pos;
+    int temp0;
+    int temp1;
+    int active_extruder;
+    float z;
+    float e;
+    int fan;
+    float x;
+    float y;
+    int bed;
+    int dual_x_mode;
+    float dup_x_offset;
+    float feedrate;
+};
 #endif
 
 #ifdef FAST_PWM_FAN
 void setPwmFrequency(uint8_t pin, int val);
 #endif
 
+#ifdef LOOP_PROFILER
+// Sections timed by the loop profiler, reported by M1044. They nest: process_commands includes the planner
+// waits and the heater and screen updates done while waiting.
+enum ProfileSection
+{
+  PROFILE_SCREEN_INPUT,   // get_command_tjc / get_command_dwn + process_command_dwn
+  PROFILE_GET_COMMAND,    // get_command, host serial and SD
+  PROFILE_PROCESS_COMMAND,
+  PROFILE_MANAGE_HEATER,
+  PROFILE_MANAGE_INACTIVITY,
+  PROFILE_STATUS_SCREEN,
+  PROFILE_TEMP_ERROR,     // CheckTempError_tjc / CheckTempError_dwn
+  PROFILE_PLANNER_FULL,   // plan_buffer_line() waiting for a free block
+  PROFILE_LOOP,           // a whole loop()
+  PROFILE_SECTIONS
+};
+unsigned long profile_add(uint8_t section, unsigned long start); // returns micros() at the end of the section
+void profile_report(bool reset);
+#define PROFILE_BEGIN(t) unsigned long t = micros()
+#define PROFILE_END(section, t) t = profile_add(section, t)
+#else
+#define PROFILE_BEGIN(t)
+#define PROFILE_END(section, t)
+#endif
+
 #ifndef CRITICAL_SECTION_START
 #define CRITICAL_SECTION_START \
   unsigned char _sreg = SREG;  \
@@ -305,7 +356,7 @@ extern int absPreheatFanSpeed;
 void preheat_abs();
 void preheat_pla();
 void cooldown();
-bool strISAscii(String str);
+bool strISAscii(const char *str);
 void sd_init();
 
 void sdcard_pause(int OValue = 0);
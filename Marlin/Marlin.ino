@@ -42,12 +42,12 @@
 
 
 char chrEnd = 0xFF;
-void TLSTJC_printconstln(const String s)
+void TLSTJC_printconstln(const __FlashStringHelper *s)
 {
     TLSERIAL.print(s);
     TLSTJC_printend();
 }
-void TLSTJC_printconst(const String s)
+void TLSTJC_printconst(const __FlashStringHelper *s)
 {
     TLSERIAL.print(s);
 }
@@ -125,7 +125,8 @@ void DWN_Page(int ID)
     iDWNPageID = ID;
 }
 
-void DWN_Text(long ID, int Len, String s, bool Center = false)
+// s is cut or padded with spaces to Len - 2 characters, centered if Center
+void DWN_Text(long ID, int Len, const char *s, bool Center)
 {
     TLSERIAL.write(DWN_HEAD0);
     TLSERIAL.write(DWN_HEAD1);
@@ -137,47 +138,29 @@ void DWN_Text(long ID, int Len, String s, bool Center = false)
     TLSERIAL.write(ID0);
     TLSERIAL.write(ID1);
 
-    if (s.length() > Len - 2)
-    {
-        s = s.substring(0, Len - 2);
-        TLSERIAL.print(s);
-        TLSERIAL.write(0xFF);
-        TLSERIAL.write(0xFF);
-    }
+    int iLen = strlen(s);
+    int iPad = 0;
+    if (iLen > Len - 2)
+        iLen = Len - 2;
     else
-    {
-        if (!Center)
-        {
-            TLSERIAL.print(s);
-            for (int i = 0; i < Len - s.length() - 2; i++)
-            {
-                TLSERIAL.print(" ");
-            }
-            TLSERIAL.write(0xFF);
-            TLSERIAL.write(0xFF);
-        }
-        else
-        {
-            String s1 = "";
-            int Count = 0;
-            for (int i = 0; i < (Len - s.length() - 2) / 2; i++)
-            {
-                s1 += " ";
-                Count++;
-            }
-            TLSERIAL.print(s1);
-            TLSERIAL.print(s);
-            Count += s.length();
-            s1 = "";
-            for (int i = 0; i < Len - Count - 2; i++)
-            {
-                s1 += " ";
-            }
-            TLSERIAL.print(s1);
-            TLSERIAL.write(0xFF);
-            TLSERIAL.write(0xFF);
-        }
-    }
+        iPad = Len - 2 - iLen;
+    int iLeft = Center ? iPad / 2 : 0;
+
+    for (int i = 0; i < iLeft; i++)
+        TLSERIAL.write(' ');
+    TLSERIAL.write((const uint8_t *)s, iLen);
+    for (int i = iLeft; i < iPad; i++)
+        TLSERIAL.write(' ');
+    TLSERIAL.write(0xFF);
+    TLSERIAL.write(0xFF);
+}
+
+void DWN_Text(long ID, int Len, const __FlashStringHelper *s, bool Center)
+{
+    char cText[33];
+    strncpy_P(cText, (const char *)s, sizeof(cText) - 1);
+    cText[sizeof(cText) - 1] = '\0';
+    DWN_Text(ID, Len, cText, Center);
 }
 
 void DWN_Language(int ID)
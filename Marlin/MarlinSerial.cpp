@@ -30,31 +30,18 @@
 
 #if UART_PRESENT(SERIAL_PORT)
 ring_buffer rx_buffer = {{0}, 0, 0};
+rx_statistics rx_stats = {0, 0, 0, 0, 0};
 #endif
 
-FORCE_INLINE void store_char(unsigned char c)
-{
-  int i = (unsigned int)(rx_buffer.head + 1) % RX_BUFFER_SIZE;
-
-  // if we should be storing the received character into the location
-  // just before the tail (meaning that the head would advance to the
-  // current location of the tail), we're about to overflow the buffer
-  // and so we don't write the character or advance the head.
-  if (i != rx_buffer.tail)
-  {
-    rx_buffer.buffer[rx_buffer.head] = c;
-    rx_buffer.head = i;
-  }
-}
-
 //#elif defined(SIG_USART_RECV)
 #if defined(M_USARTx_RX_vect)
 // fixed by Mark Sproul this is on the 644/644p
 //SIGNAL(SIG_USART_RECV)
 SIGNAL(M_USARTx_RX_vect)
 {
+  uint8_t status = M_UCSRxA;
   unsigned char c = M_UDRx;
-  store_char(c);
+  store_char(c, status);
 }
 #endif
 
@@ -130,7 +117,7 @@ int MarlinSerial::read(void)
   else
   {
     unsigned char c = rx_buffer.buffer[rx_buffer.tail];
-    rx_buffer.tail = (unsigned int)(rx_buffer.tail + 1) % RX_BUFFER_SIZE;
+    rx_buffer.tail = (rx_buffer.tail + 1) & RX_BUFFER_MASK;
     return c;
   }
 }
@@ -55,6 +55,9 @@
 #define M_RXCx SERIAL_REGNAME(RXC, SERIAL_PORT, )
 #define M_USARTx_RX_vect SERIAL_REGNAME(USART, SERIAL_PORT, _RX_vect)
 #define M_U2Xx SERIAL_REGNAME(U2X, SERIAL_PORT, )
+#define M_FEx SERIAL_REGNAME(FE, SERIAL_PORT, )
+#define M_DORx SERIAL_REGNAME(DOR, SERIAL_PORT, )
+#define M_UPEx SERIAL_REGNAME(UPE, SERIAL_PORT, )
 
 #define DEC 10
 #define HEX 16
@@ -66,18 +69,72 @@
 // Define constants and variables for buffering incoming serial data.  We're
 // using a ring buffer (I think), in which rx_buffer_head is the index of the
 // location to which to write the next incoming character and rx_buffer_tail
-// is the index of the location from which to read.
+// is the index of the location from which to read. The size is a power of 2, so the indexes wrap with a mask.
+#ifndef RX_BUFFER_SIZE
 #define RX_BUFFER_SIZE 128
+#endif
+#if RX_BUFFER_SIZE < 2 || (RX_BUFFER_SIZE & (RX_BUFFER_SIZE - 1))
+#error "RX_BUFFER_SIZE must be a power of 2"
+#endif
+#define RX_BUFFER_MASK (RX_BUFFER_SIZE - 1)
+
+#if RX_BUFFER_SIZE > 256
+typedef uint16_t rx_index_t;
+#else
+typedef uint8_t rx_index_t; // read in one instruction, no need to block the interrupt
+#endif
 
 struct ring_buffer
 {
   unsigned char buffer[RX_BUFFER_SIZE];
-  int head;
-  int tail;
+  volatile rx_index_t head;
+  volatile rx_index_t tail;
+};
+
+// What went wrong on the receiving side since the start, reported by M1042
+struct rx_statistics
+{
+  uint16_t overflow; // bytes dropped because the ring was full
+  uint16_t overrun;  // bytes the UART lost because the previous one was not read in time
+  uint16_t framing;
+  uint16_t parity;
+  rx_index_t peak;   // most bytes waiting in the ring at once
 };
 
 #if UART_PRESENT(SERIAL_PORT)
 extern ring_buffer rx_buffer;
+extern rx_statistics rx_stats;
+
+// Stores a received byte, status is UCSRnA as read before the data register
+FORCE_INLINE void store_char(unsigned char c, uint8_t status)
+{
+  if (status & ((1 << M_FEx) | (1 << M_DORx) | (1 << M_UPEx)))
+  {
+    if (status & (1 << M_FEx))
+      rx_stats.framing++;
+    if (status & (1 << M_DORx))
+      rx_stats.overrun++;
+    if (status & (1 << M_UPEx))
+      rx_stats.parity++;
+  }
+
+  rx_index_t i = (rx_buffer.head + 1) & RX_BUFFER_MASK;
+
+  // if we should be storing the received character into the location
+  // just before the tail (meaning that the head would advance to the
+  // current location of the tail), we're about to overflow the buffer
+  // and so we don't write the character or advance the head.
+  if (i != rx_buffer.tail)
+  {
+    rx_buffer.buffer[rx_buffer.head] = c;
+    rx_buffer.head = i;
+    rx_index_t used = (i - rx_buffer.tail) & RX_BUFFER_MASK;
+    if (used > rx_stats.peak)
+      rx_stats.peak = used;
+  }
+  else
+    rx_stats.overflow++;
+}
 #endif
 
 class MarlinSerial //: public Stream
@@ -93,7 +150,7 @@ public:
 
   FORCE_INLINE int available(void)
   {
-    return (unsigned int)(RX_BUFFER_SIZE + rx_buffer.head - rx_buffer.tail) % RX_BUFFER_SIZE;
+    return (rx_index_t)(rx_buffer.head - rx_buffer.tail) & RX_BUFFER_MASK;
   }
 
   FORCE_INLINE void write(uint8_t c)
@@ -106,21 +163,9 @@ public:
 
   FORCE_INLINE void checkRx(void)
   {
-    if ((M_UCSRxA & (1 << M_RXCx)) != 0)
-    {
-      unsigned char c = M_UDRx;
-      int i = (unsigned int)(rx_buffer.head + 1) % RX_BUFFER_SIZE;
-
-      // if we should be storing the received character into the location
-      // just before the tail (meaning that the head would advance to the
-      // current location of the tail), we're about to overflow the buffer
-      // and so we don't write the character or advance the head.
-      if (i != rx_buffer.tail)
-      {
-        rx_buffer.buffer[rx_buffer.head] = c;
-        rx_buffer.head = i;
-      }
-    }
+    uint8_t status = M_UCSRxA;
+    if ((status & (1 << M_RXCx)) != 0)
+      store_char(M_UDRx, status);
   }
 
 private:
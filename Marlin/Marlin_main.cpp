@@ -48,6 +48,9 @@
 #endif
 
 #include "avr/boot.h"
+#ifdef BINARY_SERIAL
+#include <util/crc16.h>
+#endif
 void (*resetFunc)(void) = 0; // Declare reset function as address 0
 
 // look here for descriptions of gcodes: http://linuxcnc.org/handbook/gcode/g-code.html
@@ -109,6 +112,8 @@ void (*resetFunc)(void) = 0; // Declare reset function as address 0
 // M128 - EtoP Open (BariCUDA EtoP = electricity to air pressure transducer by jmil)
 // M129 - EtoP Closed (BariCUDA EtoP = electricity to air pressure transducer by jmil)
 // M140 - Set bed target temp
+// M154 - S<seconds> Report the position every so many seconds, S0 = off (requires AUTO_REPORT)
+// M155 - S<seconds> Report the temperatures every so many seconds, S0 = off (requires AUTO_REPORT)
 // M190 - Sxxx Wait for bed current temp to reach target temp. Waits only when heating
 //        Rxxx Wait for bed current temp to reach target temp. Waits when heating and cooling
 // M200 - Set filament diameter
@@ -138,8 +143,11 @@ void (*resetFunc)(void) = 0; // Declare reset function as address 0
 // M502 - reverts to the default "factory settings".  You still need to store them in EEPROM afterwards if you want to.
 // M503 - print the current settings (from memory not from eeprom)
 // M540 - Use S[0|1] to enable or disable the stop SD card print on endstop hit (requires ABORT_ON_ENDSTOP_HIT_FEATURE_ENABLED)
+// M593 - Set input shaping: [X] [Y] F<frequency Hz> D<damping ratio>, F0 = off
+// M594 - Set segment coalescing: A<max angle deg> E<max extrusion ratio %> S<short segment mm> L<max merged mm>, L0 = off
 // M600 - Pause for filament change X[pos] Y[pos] Z[relative lift] E[initial retract] L[later retract distance for removal]
 // M605 - Set dual x-carriage movement mode: S<mode> [ X<duplication x-offset> R<duplication temp offset> ]
+// M900 - Set linear advance K factor: T<extruder> K<mm per mm/s>
 // M907 - Set digital trimpot motor current using axis codes.
 // M908 - Control digital trimpot directly.
 // M350 - Set microstepping mode.
@@ -147,6 +155,13 @@ void (*resetFunc)(void) = 0; // Declare reset function as address 0
 // M928 - Start SD logging (M928 filename.g) - ended by M29
 // M999 - Restart after being stopped by error
 // M1001 - Set & Get LanguageID
+// M1041 - Build the Z layer index of the selected SD file (requires Z_LAYER_INDEX)
+// M1042 - Host serial receive statistics: ring size, peak fill, bytes lost to overflow, overrun, framing and parity errors. R clears them
+// M1043 - Fast SD upload: M1043 <bytes> <filename>, see SD_FAST_UPLOAD
+// M1044 - Loop profiler report: count, min/avg/max time of each loop section, R clears them (requires LOOP_PROFILER)
+// M1045 - Planner statistics: blocks queued per finished block, slowdowns, starvation. R clears them (requires PLANNER_STATS)
+// M1046 - SRAM report: static data, heap, free heap, largest free heap block, free stack now and at its lowest (requires SRAM_REPORT)
+// M1047 - Print time: S<seconds> sets the move time of the whole file, without S reports elapsed, move and remaining seconds (requires PRINT_TIME_ESTIMATE)
 //
 
 //Stepper Movement Variables
@@ -225,6 +240,19 @@ static bool fromsd[BUFSIZE];
 static int bufindr = 0;
 static int bufindw = 0;
 static int buflen = 0;
+#ifdef BINARY_SERIAL
+#ifndef BINARY_GCODE
+#error "BINARY_SERIAL needs BINARY_GCODE"
+#endif
+#define BINARY_SERIAL_SYNC 0xB5
+static int16_t frame_seq[BUFSIZE]; // sequence of the frame the command came in, -1 for text lines
+static uint8_t frame_pos = 0;      // bytes of the current frame read so far, 0 = between frames
+static uint8_t frame_len;
+static uint8_t frame_seq_rx;
+static uint16_t frame_crc;
+static uint8_t frame_next_seq = 0; // sequence the next frame must have
+static bool frame_resend = false;  // "rs" sent, waiting for frame_next_seq
+#endif
 //static int i = 0;
 static char serial_char;
 static int serial_count = 0;
@@ -313,6 +341,67 @@ extern "C"
 
         return free_memory;
     }
+
+#ifdef SRAM_REPORT
+#define STACK_CANARY 0xC5
+    extern uint8_t __data_start;
+    extern uint8_t _end;
+    extern uint8_t __stack;
+
+    // avr-libc's malloc free list
+    struct __freelist
+    {
+        size_t sz;
+        struct __freelist *nx;
+    };
+    extern struct __freelist *__flp;
+
+    // Fills the RAM between the static data and the top of the stack with STACK_CANARY before anything
+    // runs. The stack pointer is not set up yet in .init1, so this is plain assembler.
+    void paint_stack(void) __attribute__((naked, used, section(".init1")));
+    void paint_stack(void)
+    {
+        __asm volatile("    ldi r30, lo8(_end)\n"
+                       "    ldi r31, hi8(_end)\n"
+                       "    ldi r24, %0\n"
+                       "    ldi r25, hi8(__stack)\n"
+                       "    rjmp 2f\n"
+                       "1:  st Z+, r24\n"
+                       "2:  cpi r30, lo8(__stack)\n"
+                       "    cpc r31, r25\n"
+                       "    brlo 1b\n"
+                       "    breq 1b\n"
+                       :
+                       : "i"(STACK_CANARY));
+    }
+
+    // M1046: static data, heap and stack use. The lowest free stack is how much of the painting above the
+    // heap is still there.
+    void sram_report()
+    {
+        uint8_t *heap_start = (uint8_t *)&__heap_start;
+        uint8_t *heap_end = __brkval ? (uint8_t *)__brkval : heap_start;
+        size_t free_list = 0, largest = 0;
+        for (struct __freelist *fp = __flp; fp; fp = fp->nx)
+        {
+            free_list += fp->sz;
+            if (fp->sz > largest)
+                largest = fp->sz;
+        }
+        uint8_t *p = heap_end;
+        while (p <= &__stack && *p == STACK_CANARY)
+            p++;
+
+        SERIAL_ECHO_START;
+        SERIAL_ECHOPAIR("SRAM data+bss:", (unsigned long)(&_end - &__data_start));
+        SERIAL_ECHOPAIR(" heap:", (unsigned long)(heap_end - heap_start));
+        SERIAL_ECHOPAIR(" heap free:", (unsigned long)free_list);
+        SERIAL_ECHOPAIR(" largest free block:", (unsigned long)largest);
+        SERIAL_ECHOPAIR(" stack free:", (unsigned long)freeMemory());
+        SERIAL_ECHOPAIR(" lowest stack free:", (unsigned long)(p - heap_end));
+        SERIAL_ECHOLN("");
+    }
+#endif //SRAM_REPORT
 }
 
 //adds an command to the main command buffer
@@ -324,6 +413,9 @@ void enquecommand(const char *cmd)
     {
         //this is dangerous if a mixing of serial and this happsens //Why?
         strcpy(&(cmdbuffer[bufindw][0]), cmd);
+#ifdef BINARY_SERIAL
+        frame_seq[bufindw] = -1;
+#endif
         SERIAL_ECHO_START;
         SERIAL_ECHOPGM("enqueing \"");
         SERIAL_ECHO(cmdbuffer[bufindw]);
@@ -339,6 +431,9 @@ void enquecommand_P(const char *cmd)
     {
         //this is dangerous if a mixing of serial and this happsens
         strcpy_P(&(cmdbuffer[bufindw][0]), cmd);
+#ifdef BINARY_SERIAL
+        frame_seq[bufindw] = -1;
+#endif
         SERIAL_ECHO_START;
         SERIAL_ECHOPGM("enqueing \"");
         SERIAL_ECHO(cmdbuffer[bufindw]);
@@ -348,6 +443,16 @@ void enquecommand_P(const char *cmd)
     }
 }
 
+//drops the commands queued behind the one being processed, e.g. after the SD file was repositioned
+void discard_queued_commands()
+{
+    if (buflen > 1)
+    {
+        buflen = 1;
+        bufindw = (bufindr + 1) % BUFSIZE;
+    }
+}
+
 void setup_killpin()
 {
 #if defined(POWER_LOSS_DETECT_PIN) && POWER_LOSS_DETECT_PIN > -1
@@ -496,34 +601,6 @@ void servo_init()
 #endif
 }
 
-///////////////////split by zyf
-String getSplitValue(String data, char separator, int index)
-{
-    int found = 0;
-    int strIndex[] = {
-        0, -1};
-    int maxIndex = data.length() - 1;
-
-    for (int i = 0; i <= maxIndex && found <= index; i++)
-    {
-        if (data.charAt(i) == separator || i == maxIndex)
-        {
-            found++;
-            strIndex[0] = strIndex[1] + 1;
-            strIndex[1] = (i == maxIndex) ? i + 1 : i;
-        }
-    }
-    return found > index ? data.substring(strIndex[0], strIndex[1]) : "";
-}
-
-float string2Float(String Value)
-{
-    char floatbuf[32]; // make this at least big enough for the whole string
-    Value.toCharArray(floatbuf, sizeof(floatbuf));
-    float fRet = atof(floatbuf);
-    return fRet;
-}
-
 long lVcc = 0;
 
 void get_command_dwn()
@@ -700,23 +777,19 @@ void DWN_Pause(bool filamentOut)
     }
     else if (card.sdprinting == 0)
     {
-        //String sM605 = "M605 S";
-        String strCommand = "M605 S" + String(pause_extruder_carriage_mode);
+        char _Command[32];
+        int n = snprintf_P(_Command, sizeof(_Command), PSTR("M605 S%d"), pause_extruder_carriage_mode);
         if (pause_extruder_carriage_mode == 2)
-            strCommand = strCommand + " X" + String(pause_duplicate_extruder_x_offset);
-
-        //char _Command[sizeof(strCommand)];
-        //strCommand.toCharArray(_Command, sizeof(_Command));
-        const char *_Command = strCommand.c_str();
-
+        {
+            strcpy_P(_Command + n, PSTR(" X"));
+            dtostrf(pause_duplicate_extruder_x_offset, 1, 2, _Command + n + 2); // as String(float) printed it
+        }
         enquecommand(_Command); //M605
         _delay_ms(20);
         enquecommand_P(PSTR("G28 X")); 
         _delay_ms(20);
 
-        strCommand = "M1032 T" + String(pause_T0T1) + " H" + String(pause_T0T) + " I" + String(pause_T1T);
-
-        _Command = strCommand.c_str();
+        snprintf_P(_Command, sizeof(_Command), PSTR("M1032 T%d H%d I%d"), pause_T0T1, pause_T0T, pause_T1T);
         enquecommand(_Command); //Resume
     }
 }
@@ -741,7 +814,7 @@ void CheckTempError_dwn()
             command_M81(false, false);
         }
         iTempErrID = 0;
-        sTempErrMsg = "";
+        sTempErrMsg[0] = 0;
         if (card.sdprinting == 1)
         {
             sdcard_stop();
@@ -849,16 +922,19 @@ float Check_Last_Z()
     return fLastZ;
 }
 
-//Get Data From Commport
-String getSerial2Data()
+//Get Data From Commport: what the screen sent, without line ends, cut to size - 1 characters
+uint8_t getSerial2Data(char *buf, uint8_t size)
 {
-    String strSerialdata = "";
+    uint8_t n = 0;
     while (MTLSERIAL_available() > 0)
     {
-        strSerialdata += char(MTLSERIAL_read());
+        char c = MTLSERIAL_read();
+        if (c != '\r' && c != '\n' && n < size - 1)
+            buf[n++] = c;
         delay(2);
     }
-    return strSerialdata;
+    buf[n] = 0;
+    return n;
 }
 
 /*
@@ -1097,6 +1173,9 @@ void check_filament_fail()
         if (card.sdprinting == 1)
         {
             iFilaFail = 0;
+#ifdef JOB_LOG
+            job_stats.runouts++;
+#endif
 
             if(tl_TouchScreenType == 1){
                 iBeepCount = 10;
@@ -1143,7 +1222,7 @@ void check_filament_fail()
 }
 #endif
 
-void loadingMessage(const String Message, const int ShowType = -1)
+void loadingMessage(const __FlashStringHelper *Message, const int ShowType = -1)
 {
 	
     if(tl_TouchScreenType == 1 && (ShowType == -1 || ShowType == 1))
@@ -1233,7 +1312,8 @@ void setup()
                 minutes = (lTime / 60) % 60;
                 hours = lTime / 60 / 60;
 
-                String strTime = " " + String(hours) + " h " + String(minutes) + " m";
+                char strTime[20];
+                sprintf_P(strTime, PSTR(" %i h %i m"), hours, minutes);
                 DWN_Message(MSG_PRINT_FINISHED, strTime, false);
             }
             EEPROM_Write_Last_Z(0.0, 0.0, 0, 0);
@@ -1278,6 +1358,9 @@ void setup()
     for (int8_t i = 0; i < BUFSIZE; i++)
     {
         fromsd[i] = false;
+#ifdef BINARY_SERIAL
+        frame_seq[i] = -1;
+#endif
     }
     // loads data from EEPROM if available else uses defaults (and resets step acceleration rate)
     Config_RetrieveSettings();
@@ -1311,6 +1394,9 @@ void setup()
     plan_init(); // Initialize planner;
     //watchdog_init();
     st_init(); // Initialize stepper, this enables interrupts!
+#ifdef POWER_LOSS_DETECT_BY_INTERRUPT
+    Power_Loss_Init();
+#endif
     setup_photpin();
 
     _delay_ms(500);
@@ -1343,26 +1429,19 @@ void setup()
         TLSTJC_printconstln(F("sleep=0"));
         TLSTJC_printconstln(F("page main"));
     #ifdef POWER_LOSS_RECOVERY
-        String sFileName = card.isPowerLoss();
-        sFileName = getSplitValue(sFileName, '|', 1);
-
-        if (sFileName != "")
+        PowerLossState plr;
+        if (card.isPowerLoss(plr))
         {        
             TLSTJC_printconstln(F("msgbox.vaFromPageID.val=1"));
             TLSTJC_printconstln(F("msgbox.vaToPageID.val=6"));
             TLSTJC_printconstln(F("msgbox.vtOKValue.txt=\"M1003\""));
             TLSTJC_printconstln(F("msgbox.vtCancelValue.txt=\"M1004\""));
-            String strMessage = "" + sFileName + "?";
-            strMessage = "" + strMessage + ""; 
-            const char *str0 = strMessage.c_str();
             TLSTJC_printconst(F("msgbox.tMessage.txt=\" Power loss detected, Resume print "));
-            TLSTJC_print(str0);
-            TLSTJC_printconstln(F("\""));
+            TLSTJC_print(plr.name);
+            TLSTJC_printconstln(F("?\""));
 
-            strMessage = "" + sFileName + "";
-            str0=strMessage.c_str();
             TLSTJC_printconst(F("msgbox.vtMS.txt=\""));
-            TLSTJC_print(str0);
+            TLSTJC_print(plr.name);
             TLSTJC_printconstln(F("\""));
             TLSTJC_printconstln(F("msgbox.vaMID.val=3"));
             TLSTJC_printconstln(F("page msgbox"));
@@ -1373,12 +1452,13 @@ void setup()
     {
         DWN_LED(DWN_LED_ON);
     #ifdef POWER_LOSS_RECOVERY
-        String sFileName = card.isPowerLoss();
-        String sLngFileName = getSplitValue(sFileName, '|', 0);
-        String sShtFileName = getSplitValue(sFileName, '|', 1);
-        if (sFileName != "")
+        PowerLossState plr;
+        if (card.isPowerLoss(plr))
         {
-            DWN_Message(MSG_POWER_LOSS_DETECTED, sLngFileName + "?", false);
+            char sMsg[sizeof(plr.long_name) + 1];
+            strcpy(sMsg, plr.long_name);
+            strcat_P(sMsg, PSTR("?"));
+            DWN_Message(MSG_POWER_LOSS_DETECTED, sMsg, false);
         }
         else if (!bPrintFinishedMSG)
         {
@@ -1410,6 +1490,8 @@ void setup()
 
 void loop()
 {
+    PROFILE_BEGIN(profile_loop);
+    PROFILE_BEGIN(profile_t);
 
     if(tl_TouchScreenType == 1)
     {
@@ -1421,6 +1503,7 @@ void loop()
         get_command_dwn();
         process_command_dwn();
     }
+    PROFILE_END(PROFILE_SCREEN_INPUT, profile_t);
 
     if (buflen < (BUFSIZE - 1))
         get_command();
@@ -1428,6 +1511,7 @@ void loop()
 #ifdef SDSUPPORT
     card.checkautostart(false);
 #endif
+    PROFILE_END(PROFILE_GET_COMMAND, profile_t);
     if (buflen)
     {
 #ifdef SDSUPPORT
@@ -1468,10 +1552,12 @@ void loop()
 #endif //SDSUPPORT
         buflen = (buflen - 1);
         bufindr = (bufindr + 1) % BUFSIZE;
+        PROFILE_END(PROFILE_PROCESS_COMMAND, profile_t);
     }
 
     //check heater every n milliseconds
     manage_heater();
+    PROFILE_END(PROFILE_MANAGE_HEATER, profile_t);
     if (tl_HEATER_FAIL)
     {
         card.closefile();
@@ -1480,16 +1566,76 @@ void loop()
 
     manage_inactivity();
     checkHitEndstops();
+    PROFILE_END(PROFILE_MANAGE_INACTIVITY, profile_t);
     if (bAtv && tl_TouchScreenType == 0 || tl_TouchScreenType == 1)
         tenlog_status_screen();
+    PROFILE_END(PROFILE_STATUS_SCREEN, profile_t);
 
     if(tl_TouchScreenType == 0)
         CheckTempError_dwn();
     else
         CheckTempError_tjc();
-    
+    PROFILE_END(PROFILE_TEMP_ERROR, profile_t);
+    PROFILE_END(PROFILE_LOOP, profile_loop);
 }
 
+#ifdef LOOP_PROFILER
+struct ProfileStat
+{
+    unsigned long count;
+    unsigned long min;
+    unsigned long max;
+    uint64_t total; // us
+};
+static ProfileStat profile_stats[PROFILE_SECTIONS];
+
+unsigned long profile_add(uint8_t section, unsigned long start)
+{
+    unsigned long now = micros();
+    unsigned long us = now - start;
+    ProfileStat &s = profile_stats[section];
+    if (s.count == 0 || us < s.min)
+        s.min = us;
+    if (us > s.max)
+        s.max = us;
+    s.total += us;
+    s.count++;
+    return now;
+}
+
+static const char profile_name_0[] PROGMEM = "screen input";
+static const char profile_name_1[] PROGMEM = "get_command";
+static const char profile_name_2[] PROGMEM = "process_commands";
+static const char profile_name_3[] PROGMEM = "manage_heater";
+static const char profile_name_4[] PROGMEM = "manage_inactivity";
+static const char profile_name_5[] PROGMEM = "status screen";
+static const char profile_name_6[] PROGMEM = "temp error check";
+static const char profile_name_7[] PROGMEM = "planner full";
+static const char profile_name_8[] PROGMEM = "loop";
+static const char *const profile_names[PROFILE_SECTIONS] PROGMEM = {
+    profile_name_0, profile_name_1, profile_name_2, profile_name_3, profile_name_4,
+    profile_name_5, profile_name_6, profile_name_7, profile_name_8};
+
+// M1044: one line per section, times in us except the total in ms
+void profile_report(bool reset)
+{
+    for (uint8_t i = 0; i < PROFILE_SECTIONS; i++)
+    {
+        ProfileStat &s = profile_stats[i];
+        SERIAL_ECHO_START;
+        serialprintPGM((const char *)pgm_read_word(&profile_names[i]));
+        SERIAL_ECHOPAIR(" n:", s.count);
+        SERIAL_ECHOPAIR(" min:", s.min);
+        SERIAL_ECHOPAIR(" avg:", s.count ? (unsigned long)(s.total / s.count) : 0UL);
+        SERIAL_ECHOPAIR(" max:", s.max);
+        SERIAL_ECHOPAIR(" total ms:", (unsigned long)(s.total / 1000));
+        SERIAL_ECHOLN("");
+    }
+    if (reset)
+        memset(profile_stats, 0, sizeof(profile_stats));
+}
+#endif //LOOP_PROFILER
+
 
 void get_command_tjc()
 {
@@ -1514,6 +1660,9 @@ void get_command_tjc()
             {
                 comment_mode = false; //for new command
                 fromsd[bufindw] = false;
+#ifdef BINARY_SERIAL
+                frame_seq[bufindw] = -1;
+#endif
                 if (strchr(cmdbuffer[bufindw], 'N') != NULL)
                 {
                     strchr_pointer = strchr(cmdbuffer[bufindw], 'N');
@@ -1694,11 +1843,174 @@ void command_G4(float dwell = 0)
     }
 }
 
+#ifdef SDSUPPORT
+//the whole SD file was read
+static void sd_file_printed()
+{
+    bool bAutoOff = false;
+#ifdef HAS_PLR_MODULE
+    if (b_PLR_MODULE_Detected)
+    {
+        if (tl_AUTO_OFF == 1)
+        {
+            bAutoOff = true;
+        }
+    }
+#endif //HAS_PLR_MODULE
+    SERIAL_PROTOCOLLNPGM(MSG_FILE_PRINTED);
+    stoptime = millis();
+    char time[48];
+    long t = (stoptime - starttime) / 1000;
+    int hours, minutes;
+    minutes = (t / 60) % 60;
+    hours = t / 60 / 60;
+    sprintf_P(time, PSTR("%i hours %i minutes"), hours, minutes);
+    SERIAL_ECHO_START;
+    SERIAL_ECHOLN(time);
+    //lcd_setstatus(time);
+    if(tl_TouchScreenType == 0)  
+    {  
+        sprintf_P(time, PSTR(" %i h %i m"), hours, minutes);
+        DWN_Message(MSG_PRINT_FINISHED, time, bAutoOff);
+    }
+    else
+    {
+        TLSTJC_printconstln(F("sleep=0"));
+        TLSTJC_printconstln(F("msgbox.vaFromPageID.val=1"));
+        TLSTJC_printconstln(F("msgbox.vaToPageID.val=1"));
+        TLSTJC_printconstln(F("msgbox.vtOKValue.txt=\"\""));
+        sprintf_P(time, PSTR("Print finished, %i house and %i minutes.\r\n"), hours, minutes);
+        TLSTJC_printconst(F("msgbox.tMessage.txt=\""));
+        TLSTJC_print(time);
+        if (bAutoOff)
+            TLSTJC_printconst(F("Power off in 5 seconds."));
+        TLSTJC_printconstln(F("\""));
+        TLSTJC_printconstln(F("msgbox.vaMID.val=1"));
+
+        sprintf_P(time, PSTR("%i:%i"), hours, minutes);
+        TLSTJC_printconst(F("msgbox.vtMS.txt=\""));
+        TLSTJC_print(time);
+        TLSTJC_printconstln(F("\""));
+
+        TLSTJC_printconstln(F("page msgbox"));
+    }    
+    iBeepCount = 10;
+#ifdef JOB_LOG
+    card.writeJobLog(stoptime - starttime); // before the auto power off cuts the card
+#endif
+    if (bAutoOff && b_PLR_MODULE_Detected)
+    {
+        card.sdprinting = 0;
+        command_G4(5.0);
+        command_M81();
+    }
+    card.printingHasFinished();
+    WriteLastZYM(t);
+    card.checkautostart(true);
+}
+#endif //SDSUPPORT
+
+#ifdef BINARY_SERIAL
+// Takes the next byte of a frame (see BINARY_SERIAL in Configuration_adv.h). The record is read straight
+// into the free command buffer row behind the 2 byte row marker, so a move needs no copy.
+static void get_frame_byte(uint8_t c)
+{
+    char *row = cmdbuffer[bufindw];
+    uint8_t pos = frame_pos++;
+    if (pos == 0)
+    {
+        if (c != BINARY_SERIAL_SYNC) // skipping to the next frame after a bad one
+            frame_pos = 0;
+        frame_crc = 0;
+        return;
+    }
+    if (pos < 3 + frame_len)
+        frame_crc = _crc_xmodem_update(frame_crc, c);
+    if (pos == 1)
+        frame_seq_rx = c;
+    else if (pos == 2)
+    {
+        frame_len = c;
+        if (c == 0 || c > MAX_CMD_SIZE - 3)
+            frame_pos = 0;
+    }
+    else if (pos < 3 + frame_len)
+        row[2 + pos - 3] = c;
+    else if (pos == 3 + frame_len)
+        frame_crc ^= c;
+    else
+    {
+        frame_pos = 0;
+        frame_crc ^= (uint16_t)c << 8;
+    }
+    if (frame_pos != 0)
+        return;
+
+    bool ok = frame_len != 0 && frame_len <= MAX_CMD_SIZE - 3 && frame_crc == 0;
+    if (ok && frame_seq_rx != frame_next_seq)
+    {
+        if ((uint8_t)(frame_next_seq - frame_seq_rx) <= BUFSIZE) // sent again, the "ok B" is on its way
+            return;
+        ok = false;
+    }
+    if (ok)
+    {
+        uint8_t type = row[2];
+        if (type < 0x20)
+        {
+            uint8_t fields = 0;
+            for (uint8_t m = type; m; m >>= 1)
+                fields += m & 1;
+            ok = frame_len == 1 + fields * sizeof(long);
+            row[0] = BINARY_GCODE_MOVE;
+            row[1] = 0;
+        }
+        else if (type == BINARY_GCODE_ASCII)
+        {
+            uint8_t n = row[3];
+            ok = n != 0 && frame_len == n + 2;
+            if (ok)
+            {
+                memmove(row, row + 4, n);
+                row[n] = 0;
+            }
+        }
+        else
+            ok = false;
+    }
+    if (!ok)
+    {
+        if (!frame_resend)
+        {
+            frame_resend = true;
+#ifdef JOB_LOG
+            job_stats.resends++;
+#endif
+            SERIAL_PROTOCOLPGM("rs B");
+            SERIAL_PROTOCOLLN((int)frame_next_seq);
+        }
+        return;
+    }
+    frame_resend = false;
+    fromsd[bufindw] = false;
+    frame_seq[bufindw] = frame_next_seq++;
+    bufindw = (bufindw + 1) % BUFSIZE;
+    buflen += 1;
+}
+#endif //BINARY_SERIAL
+
 void get_command()
 {
     while (MYSERIAL.available() > 0 && buflen < BUFSIZE)
     {
         serial_char = MYSERIAL.read();
+#ifdef BINARY_SERIAL
+        if (frame_pos != 0 || frame_resend || (serial_count == 0 && !comment_mode && (uint8_t)serial_char == BINARY_SERIAL_SYNC))
+        {
+            get_frame_byte(serial_char);
+            continue;
+        }
+#endif
         if (serial_char == '\n' ||
             serial_char == '\r' ||
             (serial_char == ':' && comment_mode == false) ||
@@ -1714,6 +2026,9 @@ void get_command()
             {
                 comment_mode = false; //for new command
                 fromsd[bufindw] = false;
+#ifdef BINARY_SERIAL
+                frame_seq[bufindw] = -1;
+#endif
                 if (strchr(cmdbuffer[bufindw], 'N') != NULL)
                 {
                     strchr_pointer = strchr(cmdbuffer[bufindw], 'N');
@@ -1817,6 +2132,41 @@ void get_command()
     {
         return;
     }
+#ifdef BINARY_SERIAL
+    if (frame_pos != 0) // the frame being read owns the free row
+        return;
+#endif
+#ifdef BINARY_GCODE
+    if (card.binary)
+    {
+        while (buflen < BUFSIZE)
+        {
+            if (card.eof())
+            {
+                sd_file_printed();
+                return;
+            }
+            if (!card.getBinaryCommand(cmdbuffer[bufindw]))
+            {
+                SERIAL_ERROR_START;
+                SERIAL_ERRORPGM(MSG_SD_BINARY_ERROR);
+                SERIAL_ERRORLN(card.sdpos);
+                card.pauseSDPrint();
+                return;
+            }
+            fromsd[bufindw] = true;
+#ifdef BINARY_SERIAL
+            frame_seq[bufindw] = -1;
+#endif
+            buflen += 1;
+            bufindw = (bufindw + 1) % BUFSIZE;
+        }
+        return;
+    }
+#endif //BINARY_GCODE
+#ifdef Z_LAYER_INDEX
+    static uint32_t sd_line_pos = 0; // file offset of the line being read
+#endif
     while (!card.eof() && buflen < BUFSIZE)
     {
         int16_t n = card.get();
@@ -1827,84 +2177,21 @@ void get_command()
             serial_count >= (MAX_CMD_SIZE - 1) || n == -1)
         {
             if (card.eof())
-            {
-
-                bool bAutoOff = false;
-                String strPLR = "";
-#ifdef HAS_PLR_MODULE
-                if (b_PLR_MODULE_Detected)
-                {
-                    if (tl_AUTO_OFF == 1)
-                    {
-                        strPLR = "Power off in 5 seconds.";
-                        bAutoOff = true;
-                    }
-                }
-#endif //HAS_PLR_MODULE
-                SERIAL_PROTOCOLLNPGM(MSG_FILE_PRINTED);
-                stoptime = millis();
-                char time[30];
-                long t = (stoptime - starttime) / 1000;
-                int hours, minutes;
-                minutes = (t / 60) % 60;
-                hours = t / 60 / 60;
-                sprintf_P(time, PSTR("%i hours %i minutes"), hours, minutes);
-                SERIAL_ECHO_START;
-                SERIAL_ECHOLN(time);
-                //lcd_setstatus(time);
-                if(tl_TouchScreenType == 0)  
-                {  
-                    String strTime = " " + String(hours) + " h " + String(minutes) + " m";
-                    DWN_Message(MSG_PRINT_FINISHED, strTime, bAutoOff);
-                }
-                else
-                {
-                    TLSTJC_printconstln(F("sleep=0"));
-                    TLSTJC_printconstln(F("msgbox.vaFromPageID.val=1"));
-                    TLSTJC_printconstln(F("msgbox.vaToPageID.val=1"));
-                    TLSTJC_printconstln(F("msgbox.vtOKValue.txt=\"\""));
-                    TLSTJC_printconst(F("msgbox.tMessage.txt=\"Print finished, "));
-                    const char *str0 = String(hours).c_str();
-                    TLSTJC_print(str0);
-                    TLSTJC_printconst(F(" house and "));
-                    str0 = String(minutes).c_str();
-                    TLSTJC_print(str0);
-                    TLSTJC_printconst(F(" minutes.\r\n"));
-                    if(strPLR != "")
-                    {
-                        str0 = strPLR.c_str();
-                        TLSTJC_print(str0);
-                    }
-                    TLSTJC_printconstln(F("\""));
-                    TLSTJC_printconstln(F("msgbox.vaMID.val=1"));
-                                    
-                    String strMessage = "" + String(hours) + ":" + String(minutes) + "";                
-                    str0 = strMessage.c_str();
-                    TLSTJC_printconst(F("msgbox.vtMS.txt=\""));
-                    TLSTJC_print(str0);
-                    TLSTJC_printconstln(F("\""));
-
-                    TLSTJC_printconstln(F("page msgbox"));
-                }    
-                iBeepCount = 10;
-                if (bAutoOff && b_PLR_MODULE_Detected)
-                {
-                    card.sdprinting = 0;
-                    command_G4(5.0);
-                    command_M81();
-                }
-                card.printingHasFinished();
-                WriteLastZYM(t);
-                card.checkautostart(true);
-            }
+                sd_file_printed();
             if (!serial_count)
             {
                 comment_mode = false; //for new command
                 return;               //if empty line
             }
             cmdbuffer[bufindw][serial_count] = 0; //terminate string
+#ifdef Z_LAYER_INDEX
+            card.zindexLine(cmdbuffer[bufindw], sd_line_pos);
+#endif
             // if(!comment_mode){
             fromsd[bufindw] = true;
+#ifdef BINARY_SERIAL
+            frame_seq[bufindw] = -1;
+#endif
             buflen += 1;
             bufindw = (bufindw + 1) % BUFSIZE;
             //      }
@@ -1915,6 +2202,10 @@ void get_command()
         {
             if (serial_char == ';')
                 comment_mode = true;
+#ifdef Z_LAYER_INDEX
+            if (serial_count == 0)
+                sd_line_pos = card.sdpos;
+#endif
             if (!comment_mode)
                 cmdbuffer[bufindw][serial_count++] = serial_char;
         }
@@ -2094,6 +2385,50 @@ static void homeaxis(int axis)
     }
 }
 
+#ifdef HOMING_XY_TOGETHER
+// One move of X1, X2 (mirrored) and Y by x/y mm with no axis faster than its homing feedrate / divisor
+static void home_xy_move(float x, float y, int divisor, bool to_endstops)
+{
+    current_position[X_AXIS] = 0;
+    current_position[Y_AXIS] = 0;
+    plan_set_position(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS]);
+    float length = sqrt(square(x) + square(y));
+    feedrate = min(homing_feedrate[X_AXIS] * length / fabs(x), homing_feedrate[Y_AXIS] * length / fabs(y));
+    st_home_together(to_endstops);
+    plan_buffer_line(x, y, current_position[Z_AXIS], current_position[E_AXIS], feedrate / divisor, 0);
+    st_synchronize();
+    st_home_together(false);
+}
+
+// Homes both X carriages and Y in three moves instead of nine. Leaves the same positions as homeaxis()
+// on X of the inactive and then the active extruder, and on Y.
+static void home_xy_together()
+{
+    int tmp_extruder = active_extruder;
+    active_extruder = 0; // the moves are planned for X1, X2 runs mirrored towards X max
+    extruder_carriage_mode = 3;
+    enable_x();
+
+    float x_retract = home_retract_mm(X_AXIS) * X_HOME_DIR;
+    float y_retract = home_retract_mm(Y_AXIS) * home_dir(Y_AXIS);
+    home_xy_move(1.5 * max_length(X_AXIS) * X_HOME_DIR, 1.5 * max_length(Y_AXIS) * home_dir(Y_AXIS), HOMING_FAST_DIVISOR, true);
+    home_xy_move(-x_retract, -y_retract, HOMING_RETRACT_DIVISOR, false);
+    home_xy_move(2 * x_retract, 2 * y_retract, HOMING_BUMP_DIVISOR, true);
+    extruder_carriage_mode = 1;
+
+    active_extruder = !tmp_extruder;
+    axis_is_at_home(X_AXIS);
+    inactive_extruder_x_pos = current_position[X_AXIS];
+    active_extruder = tmp_extruder;
+    axis_is_at_home(X_AXIS);
+    axis_is_at_home(Y_AXIS);
+    destination[X_AXIS] = current_position[X_AXIS];
+    destination[Y_AXIS] = current_position[Y_AXIS];
+    feedrate = 0.0;
+    endstops_hit_on_purpose();
+}
+#endif
+
 void command_G92(float XValue = -99999.0, float YValue = -99999.0, float ZValue = -99999.0, float EValue = -99999.0) //By Zyf
 {
     if (!code_seen(axis_codes[E_AXIS]) || EValue > -99999.0)
@@ -2204,17 +2539,28 @@ void command_G28(int XHome = 0, int YHome = 0, int ZHome = 0)
     PrintFromZHeightFound = true;
 #endif
 
+#ifdef HOMING_XY_TOGETHER
+    bool bHomedXY = false;
+#endif
     if ((home_all_axis) || XHome == 1 || (code_seen(axis_codes[X_AXIS])))
     {
 #ifdef DUAL_X_CARRIAGE
         int tmp_extruder = active_extruder;
         //int tmp_extruder_carriage_mode = extruder_carriage_mode;
         extruder_carriage_mode = 1;
-        active_extruder = !active_extruder;
-        HOMEAXIS(X);
-        inactive_extruder_x_pos = current_position[X_AXIS];
-        active_extruder = tmp_extruder;
-        HOMEAXIS(X);
+#ifdef HOMING_XY_TOGETHER
+        bHomedXY = (home_all_axis) || YHome == 1 || (code_seen(axis_codes[Y_AXIS]));
+        if (bHomedXY)
+            home_xy_together();
+        else
+#endif
+        {
+            active_extruder = !active_extruder;
+            HOMEAXIS(X);
+            inactive_extruder_x_pos = current_position[X_AXIS];
+            active_extruder = tmp_extruder;
+            HOMEAXIS(X);
+        }
         // reset state used by the different modes
         //memcpy(raised_parked_position, current_position, sizeof(raised_parked_position));   //By Zyf
         raised_parked_position[X_AXIS] = current_position[X_AXIS]; //By zyf
@@ -2241,6 +2587,9 @@ void command_G28(int XHome = 0, int YHome = 0, int ZHome = 0)
 #endif //PRINT_FROM_Z_HEIGHT
     }
 
+#ifdef HOMING_XY_TOGETHER
+    if (!bHomedXY) // Y went home with X
+#endif
     if ((home_all_axis) || YHome == 1 || (code_seen(axis_codes[Y_AXIS])))
     {
         HOMEAXIS(Y);
@@ -2394,6 +2743,9 @@ void command_T(int T01 = -1)
 #if EXTRUDERS > 1
         if (tmp_extruder != active_extruder)
         {
+#ifdef JOB_LOG
+            job_stats.toolchanges++;
+#endif
             // Save current position to return to after applying extruder offset
             //memcpy(destination, current_position, sizeof(destination));
             destination[X_AXIS] = current_position[X_AXIS]; //By zyf
@@ -2402,9 +2754,17 @@ void command_T(int T01 = -1)
             destination[E_AXIS] = current_position[E_AXIS]; //By zyf
 #ifdef DUAL_X_CARRIAGE
 
+#ifdef TOOLCHANGE_PIPELINED
+            bool bHomeX = card.sdprinting != 1 && !blocks_queued(); // not while a print streams in
+#else
+            bool bHomeX = card.sdprinting != 1;
+#endif
             //By zyf go home befor switch            
-            if (card.sdprinting != 1)
+            if (bHomeX)
             {
+#ifdef TOOLCHANGE_PIPELINED
+                st_synchronize();
+#endif
                 enable_endstops(true, 0);
                 HOMEAXIS(X);
                 enable_endstops(false, 0);
@@ -2417,7 +2777,9 @@ void command_T(int T01 = -1)
                 plan_buffer_line(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS] + TOOLCHANGE_PARK_ZLIFT, current_position[E_AXIS], max_feedrate[Z_AXIS], active_extruder);
                 plan_buffer_line(x_home_pos(active_extruder), current_position[Y_AXIS], current_position[Z_AXIS] + TOOLCHANGE_PARK_ZLIFT, current_position[E_AXIS], homing_feedrate[Z_AXIS] / 10, active_extruder);
                 plan_buffer_line(x_home_pos(active_extruder), current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS], max_feedrate[Z_AXIS], active_extruder);
+#ifndef TOOLCHANGE_PIPELINED
                 st_synchronize();
+#endif
             }
 
            // apply Y & Z extruder offset (x offset is already used in determining home pos)
@@ -2477,9 +2839,12 @@ void command_T(int T01 = -1)
 
 
                 //By Zyf gohome after autopark;
-                if(card.sdprinting != 1 || offset_changed == 1)
+                if(bHomeX || offset_changed == 1)
                 {
                     if(active_extruder == 1) offset_changed = 0;                    
+#ifdef TOOLCHANGE_PIPELINED
+                    st_synchronize(); // homing sets the position right away
+#endif
                     enable_endstops(true, 0);
                     HOMEAXIS(X);
                     enable_endstops(false, 0);
@@ -2498,7 +2863,11 @@ void command_T(int T01 = -1)
             // Set the new active extruder and position
             active_extruder = tmp_extruder;
 #endif // DUAL_X_CARRIAGE
+#ifdef TOOLCHANGE_PIPELINED
+            plan_set_position_queued(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS]);
+#else
             plan_set_position(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS]);
+#endif
             // Move to the old position if 'F' was in the parameters
             if (make_move && Stopped == false)
             {
@@ -2576,6 +2945,113 @@ void PrintStopOrFinished()
         command_T(0);
 }
 
+#ifdef SEGMENT_COALESCING
+float coalesce_angle = SEGMENT_COALESCING_ANGLE;
+float coalesce_e_ratio = SEGMENT_COALESCING_E_RATIO;
+float coalesce_short_mm = SEGMENT_COALESCING_SHORT_MM;
+float coalesce_max_mm = SEGMENT_COALESCING_MAX_MM;
+
+// Reads the G0/G1 at bufindr into target, continuing from current_position. Lines with anything
+// else than X Y Z E and an unchanged F are left for process_commands().
+static bool coalesce_read_move(float *target)
+{
+    if (!code_seen('G'))
+        return false;
+    int iG = (int)code_value();
+    if (iG != 0 && iG != 1)
+        return false;
+    if (code_seen('M') || code_seen('R') || code_seen('T') || code_seen('S'))
+        return false;
+    if (code_seen('F') && code_value() != feedrate)
+        return false;
+    for (int8_t i = 0; i < NUM_AXIS; i++)
+    {
+        if (code_seen(axis_codes[i]))
+            target[i] = (float)code_value() + (axis_relative_modes[i] || relative_mode) * current_position[i];
+        else
+            target[i] = current_position[i];
+    }
+    return true;
+}
+
+// Merges the queued G0/G1 lines that continue the short move in destination into it. Each merged line
+// is acknowledged here and bufindr moves on to it, so process_commands() and loop() finish the last one.
+static void coalesce_moves()
+{
+    if (coalesce_max_mm <= 0 || code_seen('R') || code_seen('M'))
+        return;
+#ifdef DUAL_X_CARRIAGE
+    if (active_extruder_parked)
+        return;
+#endif
+#ifdef SDSUPPORT
+    if (card.saving)
+        return;
+#endif
+    float start[NUM_AXIS];
+    memcpy(start, current_position, sizeof(start));
+    if (destination[Z_AXIS] != start[Z_AXIS] || destination[E_AXIS] < start[E_AXIS])
+        return;
+    float dx = destination[X_AXIS] - start[X_AXIS];
+    float dy = destination[Y_AXIS] - start[Y_AXIS];
+    float length = sqrt(dx * dx + dy * dy);
+    if (length == 0 || length >= coalesce_short_mm)
+        return;
+
+    float fXMin = X_MIN_POS;
+    float fXMax = tl_X2_MAX_POS;
+    if (dual_x_carriage_mode == DXC_AUTO_PARK_MODE)
+    {
+        if (active_extruder == 0)
+            fXMax = tl_X2_MAX_POS - X_NOZZLE_WIDTH;
+        if (active_extruder == 1)
+            fXMin = X_MIN_POS + X_NOZZLE_WIDTH;
+    }
+    float cos_limit = cos(radians(coalesce_angle));
+    float e_per_mm = (destination[E_AXIS] - start[E_AXIS]) / length;
+    float target[NUM_AXIS];
+
+    while (buflen > 1)
+    {
+        int iCurrent = bufindr;
+        bufindr = (bufindr + 1) % BUFSIZE;
+        memcpy(current_position, destination, sizeof(current_position));
+        bool bMove = coalesce_read_move(target);
+        memcpy(current_position, start, sizeof(current_position));
+        bufindr = iCurrent;
+        if (!bMove || target[Z_AXIS] != start[Z_AXIS] || target[X_AXIS] < fXMin || target[X_AXIS] > fXMax)
+            break;
+
+        float sx = target[X_AXIS] - destination[X_AXIS];
+        float sy = target[Y_AXIS] - destination[Y_AXIS];
+        float segment = sqrt(sx * sx + sy * sy);
+        float de = target[E_AXIS] - destination[E_AXIS];
+        if (segment == 0 || segment >= coalesce_short_mm || de < 0)
+            break;
+        if (dx * sx + dy * sy < cos_limit * length * segment) // bends away from the merged chord
+            break;
+        if (e_per_mm == 0 ? de != 0 : fabs(de / segment - e_per_mm) > e_per_mm * coalesce_e_ratio / 100.0)
+            break;
+        float nx = target[X_AXIS] - start[X_AXIS];
+        float ny = target[Y_AXIS] - start[Y_AXIS];
+        float merged = sqrt(nx * nx + ny * ny);
+        if (merged > coalesce_max_mm)
+            break;
+
+        ClearToSend();
+        buflen = (buflen - 1);
+        bufindr = (bufindr + 1) % BUFSIZE;
+        memcpy(destination, target, sizeof(destination));
+        dx = nx;
+        dy = ny;
+        length = merged;
+        e_per_mm = (destination[E_AXIS] - start[E_AXIS]) / length;
+        if (buflen < (BUFSIZE - 1))
+            get_command();
+    }
+}
+#endif //SEGMENT_COALESCING
+
 void command_G1(float XValue, float YValue, float ZValue, float EValue, int iMode)
 {
     if (Stopped == false)
@@ -2590,9 +3066,13 @@ void command_G1(float XValue, float YValue, float ZValue, float EValue, int iMod
             if (active_extruder == 1)
                 fXMin = X_MIN_POS + X_NOZZLE_WIDTH;
 
-            if (code_seen(axis_codes[X_AXIS]))
+            // moves given as values (binary records, screen and resume moves) have no text line to look at
+            bool bXSeen = (XValue != -99999.0);
+            float fXV = XValue;
+            if (!bXSeen && code_seen(axis_codes[X_AXIS]))
             {
-                float fXV = code_value();
+                bXSeen = true;
+                fXV = code_value();
                 float fRate = 1.0;
                 if (code_seen('R'))
                     fRate = code_value();
@@ -2601,16 +3081,17 @@ void command_G1(float XValue, float YValue, float ZValue, float EValue, int iMod
                 {
                     iMode = (int)code_value();
                 }
-
+            }
+            if (bXSeen)
+            {
                 if ((fXV > fXMax || fXV < fXMin) && iMode == 0)
                 {
                     if(tl_TouchScreenType == 1)
                     {
                         TLSTJC_printconst(F("main.sStatus.txt=\""));
                         long lN = current_position[X_AXIS] * 10.0; //1
-                        String sSend = String(lN);
-                        const char *str0 = sSend.c_str();
-                        TLSTJC_print(str0);
+                        char sSend[12];
+                        TLSTJC_print(ltoa(lN, sSend, 10));
                         TLSTJC_printconst(F("|"));
                         TLSTJC_printconst(F("\""));
                         TLSTJC_printend();
@@ -2630,6 +3111,10 @@ void command_G1(float XValue, float YValue, float ZValue, float EValue, int iMod
         }
 #endif
         get_coordinates(XValue, YValue, ZValue, EValue, iMode); // For X Y Z E F
+#ifdef SEGMENT_COALESCING
+        if (XValue == -99999.0 && YValue == -99999.0 && ZValue == -99999.0 && EValue == -99999.0 && iMode == 0)
+            coalesce_moves(); // only lines from the command queue
+#endif
         prepare_move();
         //ClearToSend();
 
@@ -2637,6 +3122,126 @@ void command_G1(float XValue, float YValue, float ZValue, float EValue, int iMod
     }
 }
 
+#ifdef BINARY_GCODE
+// A move record of a binary G-code file, see CardReader::getBinaryCommand(). Same as a G1 line with the
+// axes of the mask, without parsing text.
+static void command_G1_binary(const char *record)
+{
+    uint8_t mask = record[0];
+    const char *value = record + 1;
+    float values[NUM_AXIS + 1]; // X Y Z E F
+    for (int8_t i = 0; i < NUM_AXIS + 1; i++)
+    {
+        if (mask & (1 << i))
+        {
+            long l;
+            memcpy(&l, value, sizeof(l));
+            value += sizeof(l);
+            values[i] = l * 0.001;
+        }
+        else
+            values[i] = -99999.0;
+    }
+    if (values[NUM_AXIS] > 0.0)
+        feedrate = values[NUM_AXIS];
+    command_G1(values[X_AXIS], values[Y_AXIS], values[Z_AXIS], values[E_AXIS]);
+}
+#endif //BINARY_GCODE
+
+// The M105 answer after the "ok", e is the extruder the heater power is given for
+static void report_temperatures(int8_t e)
+{
+#if defined(TEMP_0_PIN) && TEMP_0_PIN > -1
+    SERIAL_PROTOCOLPGM(" T:");
+    SERIAL_PROTOCOL_F(degHotend(0), 1);
+    SERIAL_PROTOCOLPGM("/");
+    SERIAL_PROTOCOL_F(degTargetHotend(0), 1);
+#if defined(TEMP_1_PIN) && TEMP_1_PIN > -1
+    SERIAL_PROTOCOLPGM(" T1:");
+    SERIAL_PROTOCOL_F(degHotend(1), 1);
+    SERIAL_PROTOCOLPGM("/");
+    SERIAL_PROTOCOL_F(degTargetHotend(1), 1);
+#endif
+#if defined(TEMP_BED_PIN) && TEMP_BED_PIN > -1
+    SERIAL_PROTOCOLPGM(" B:");
+    SERIAL_PROTOCOL_F(degBed(), 1);
+    SERIAL_PROTOCOLPGM(" /");
+    SERIAL_PROTOCOL_F(degTargetBed(), 1);
+#endif //TEMP_BED_PIN
+#else
+    SERIAL_ERROR_START;
+    SERIAL_ERRORLNPGM(MSG_ERR_NO_THERMISTORS);
+#endif
+    SERIAL_PROTOCOLPGM(" @:");
+    SERIAL_PROTOCOL(getHeaterPower(e));
+
+    SERIAL_PROTOCOLPGM(" B@:");
+    SERIAL_PROTOCOL(getHeaterPower(-1));
+
+    SERIAL_PROTOCOLLN("");
+}
+
+// The M114 answer
+static void report_position()
+{
+    SERIAL_PROTOCOLPGM("X:");
+    SERIAL_PROTOCOL(current_position[X_AXIS]);
+    SERIAL_PROTOCOLPGM("Y:");
+    SERIAL_PROTOCOL(current_position[Y_AXIS]);
+    SERIAL_PROTOCOLPGM("Z:");
+    SERIAL_PROTOCOL(current_position[Z_AXIS]);
+    SERIAL_PROTOCOLPGM("E:");
+    SERIAL_PROTOCOL(current_position[E_AXIS]);
+
+    SERIAL_PROTOCOLPGM(MSG_COUNT_X);
+    SERIAL_PROTOCOL(float(st_get_position(X_AXIS)) / axis_steps_per_unit[X_AXIS]);
+    SERIAL_PROTOCOLPGM("Y:");
+    SERIAL_PROTOCOL(float(st_get_position(Y_AXIS)) / axis_steps_per_unit[Y_AXIS]);
+    SERIAL_PROTOCOLPGM("Z:");
+    SERIAL_PROTOCOL(float(st_get_position(Z_AXIS)) / axis_steps_per_unit[Z_AXIS]);
+
+    SERIAL_PROTOCOLLN("");
+}
+
+#ifdef AUTO_REPORT
+static uint8_t auto_report_temp_interval = 0; // seconds, 0 = off
+static uint8_t auto_report_pos_interval = 0;
+static unsigned long auto_report_temp_next;
+static unsigned long auto_report_pos_next;
+
+// M154/M155 S<seconds>
+static void command_auto_report(bool position)
+{
+    uint8_t s = code_seen('S') ? constrain(code_value(), 0, 60) : 0;
+    if (position)
+    {
+        auto_report_pos_interval = s;
+        auto_report_pos_next = millis() + s * 1000UL;
+    }
+    else
+    {
+        auto_report_temp_interval = s;
+        auto_report_temp_next = millis() + s * 1000UL;
+    }
+}
+
+// Called from manage_inactivity(), so the reports also come while a command waits for the planner
+static void auto_report()
+{
+    unsigned long ms = millis();
+    if (auto_report_temp_interval && (long)(ms - auto_report_temp_next) >= 0)
+    {
+        auto_report_temp_next = ms + auto_report_temp_interval * 1000UL;
+        report_temperatures(active_extruder);
+    }
+    if (auto_report_pos_interval && (long)(ms - auto_report_pos_next) >= 0)
+    {
+        auto_report_pos_next = ms + auto_report_pos_interval * 1000UL;
+        report_position();
+    }
+}
+#endif //AUTO_REPORT
+
 void command_M190(int SValue = -1)
 {
 #if defined(TEMP_BED_PIN) && TEMP_BED_PIN > -1
@@ -2659,6 +3264,9 @@ void command_M190(int SValue = -1)
         CooldownNoWait = true;
     }
     codenum = millis();
+#ifdef JOB_LOG
+    unsigned long heat_start = codenum;
+#endif
 
     target_direction = isHeatingBed(); // true if heating, false if cooling
     card.heating = true;
@@ -2682,32 +3290,27 @@ void command_M190(int SValue = -1)
 
             if(tl_TouchScreenType == 1)
             {
-                String strSerial2 = getSerial2Data();
-                if (strSerial2 != "")
+                char strSerial2[32];
+                if (getSerial2Data(strSerial2, sizeof(strSerial2)) > 0)
                 {
-                    strSerial2.replace("\r", "");
-                    strSerial2.replace("\n", "");
-                    String strM104 = getSplitValue(strSerial2, ' ', 0);
-                    if (strM104 == "M140")
+                    if (strncmp_P(strSerial2, PSTR("M140 "), 5) == 0)
                     {
-                        String strTemp = getSplitValue(strSerial2, ' ', 1);
-                        int iTempE;
-                        if (strTemp.substring(0, 1) == "S")
-                            iTempE = strTemp.substring(1, strTemp.length()).toInt();
-                        setTargetBed(iTempE);
+                        char *strTemp = strtok(strSerial2 + 5, " ");
+                        if (strTemp && strTemp[0] == 'S')
+                            setTargetBed(atoi(strTemp + 1));
                     }
-                    else if (strSerial2 == "M1033")
+                    else if (strcmp_P(strSerial2, PSTR("M1033")) == 0)
                     {
                         sdcard_stop();
                     }
-                    else if (strSerial2 == "M1031")
+                    else if (strcmp_P(strSerial2, PSTR("M1031")) == 0)
                     {
                         sdcard_pause();
                     }
-                    else if (strSerial2 == "M1031 O1")
+                    else if (strcmp_P(strSerial2, PSTR("M1031 O1")) == 0)
                     {
                     }
-                    else if (strSerial2.substring(0, 5) == "M1032")
+                    else if (strncmp_P(strSerial2, PSTR("M1032"), 5) == 0)
                     {
                         sdcard_resume();
                     }
@@ -2732,6 +3335,9 @@ void command_M190(int SValue = -1)
         tenlog_status_screen();
     }
     card.heating = false;
+#ifdef JOB_LOG
+    job_stats.heating_ms += millis() - heat_start;
+#endif
     //LCD_MESSAGEPGM(MSG_BED_DONE);
     previous_millis_cmd = millis();
 #endif
@@ -2852,6 +3458,9 @@ void command_M109(int SValue = -1)
 
     setWatch();
     codenum = millis();
+#ifdef JOB_LOG
+    unsigned long heat_start = codenum;
+#endif
 
     /* See if we are heating up or cooling down */
     target_direction = isHeatingHotend(tmp_extruder); // true if heating, false if cooling
@@ -2903,24 +3512,23 @@ void command_M109(int SValue = -1)
             codenum = millis();
             if(tl_TouchScreenType == 1)
             {
-                String strSerial2 = getSerial2Data();
-                if (strSerial2 != "")
+                char strSerial2[32];
+                if (getSerial2Data(strSerial2, sizeof(strSerial2)) > 0)
                 {
-                    strSerial2.replace("\r", "");
-                    strSerial2.replace("\n", "");
-                    String strM104 = getSplitValue(strSerial2, ' ', 0);
-                    if (strM104 == "M104")
+                    char *strT01 = NULL, *strTemp = NULL;
+                    if (strncmp_P(strSerial2, PSTR("M104 "), 5) == 0)
                     {
-                        String strT01 = getSplitValue(strSerial2, ' ', 1);
-                        String strTemp = getSplitValue(strSerial2, ' ', 2);
-                        int iTempE;
+                        strT01 = strtok(strSerial2 + 5, " ");
+                        strTemp = strtok(NULL, " ");
+                    }
+                    if (strT01 && strTemp && strTemp[0] == 'S')
+                    {
+                        int iTempE = atoi(strTemp + 1);
                         int iTemp = 0;
-                        if (strT01 == "T0")
+                        if (strcmp_P(strT01, PSTR("T0")) == 0)
                             iTemp = 0;
                         else
                             iTemp = 1;
-                        if (strTemp.substring(0, 1) == "S")
-                            iTempE = strTemp.substring(1, strTemp.length()).toInt();
                         setTargetHotend(iTempE, iTemp);
 
     #ifdef DUAL_X_CARRIAGE
@@ -2930,19 +3538,19 @@ void command_M109(int SValue = -1)
                             setTargetHotend(iTempE == 0.0 ? 0.0 : iTempE - duplicate_extruder_temp_offset, 0);
     #endif
                     }
-                    else if (strSerial2 == "M1033")
+                    else if (strcmp_P(strSerial2, PSTR("M1033")) == 0)
                     {
                         sdcard_stop();
                     }
-                    else if (strSerial2 == "M1031")
+                    else if (strcmp_P(strSerial2, PSTR("M1031")) == 0)
                     {
                         sdcard_pause();
                     }
-                    else if (strSerial2 == "M1031 O1")
+                    else if (strcmp_P(strSerial2, PSTR("M1031 O1")) == 0)
                     {
                         //sdcard_pause(1);
                     }
-                    else if (strSerial2.substring(0, 5) == "M1032")
+                    else if (strncmp_P(strSerial2, PSTR("M1032"), 5) == 0)
                     {
                         sdcard_resume();
                     }
@@ -2981,6 +3589,9 @@ void command_M109(int SValue = -1)
     }  //while
 
     card.heating = false;
+#ifdef JOB_LOG
+    job_stats.heating_ms += millis() - heat_start;
+#endif
     if (card.sdprinting != 1)
     {
         //LCD_MESSAGEPGM(MSG_HEATING_COMPLETE);
@@ -2993,47 +3604,8 @@ void command_M109(int SValue = -1)
 #ifdef POWER_LOSS_RECOVERY
 void command_M1003()
 {
-    bool bOK = false;
-    String sPLR = card.get_PLR();
-    String sLFileName = getSplitValue(sPLR, '|', 0);
-    String sFileName = getSplitValue(sPLR, '|', 1);
-
-    uint32_t lFPos = 0;
-    int iTemp0 = 0;
-    int iTemp1 = 0;
-    int iFan = 0;
-    int iT01 = 0;
-    int iTempBed = 0;
-    float fZ = 0.0;
-    float fE = 0.0;
-    float fX = 0.0;
-    float fY = 0.0;
-    int iMode = 0;
-    float fXOffSet = 0.0;
-
-    if (sPLR != "")
-    {
-        lFPos = atol(const_cast<char *>(getSplitValue(sPLR, '|', 2).c_str()));
-        iTemp0 = getSplitValue(sPLR, '|', 3).toInt();
-        iTemp1 = getSplitValue(sPLR, '|', 4).toInt();
-        iT01 = getSplitValue(sPLR, '|', 5).toInt();
-
-        fZ = string2Float(getSplitValue(sPLR, '|', 6));
-        fE = string2Float(getSplitValue(sPLR, '|', 7));
-        iFan = getSplitValue(sPLR, '|', 8).toInt();
-        fX = string2Float(getSplitValue(sPLR, '|', 9));
-        fY = string2Float(getSplitValue(sPLR, '|', 10));
-
-        iTempBed = getSplitValue(sPLR, '|', 11).toInt();
-        iMode = getSplitValue(sPLR, '|', 12).toInt();
-        fXOffSet = string2Float(getSplitValue(sPLR, '|', 13));
-
-        if (lFPos > 2048)
-        {
-            bOK = true;
-        }
-    }
-
+    PowerLossState plr;
+    bool bOK = card.get_PLR(plr) && plr.file_pos > 2048;
 
     if (!bOK)
     {
@@ -3042,22 +3614,18 @@ void command_M1003()
     }
     else
     {
-        char *fName = const_cast<char *>(sFileName.c_str());
-        card.openFile(fName, fName, true, lFPos);
+        card.openFile(plr.name, plr.name, true, plr.file_pos);
+        set_printing_message(plr.long_name);
 
         if(tl_TouchScreenType == 1)
         {
-            gsPrinting = "Printing " + sLFileName;
-            sFileName = "" + sLFileName + "";
             TLSTJC_printconst(F("printing.tFileName.txt=\""));
-            const char *str0 = sFileName.c_str();
-            TLSTJC_print(str0);
+            TLSTJC_print(plr.long_name);
             TLSTJC_printconstln(F("\""));
             TLSTJC_printconstln(F("page printing"));
         }
         else
         {
-            gsPrinting = "Printing " + sLFileName;
             DWN_Text(0x7500, 32, gsPrinting, true);
             DWN_Page(DWN_P_PRINTING);
         }
@@ -3065,46 +3633,46 @@ void command_M1003()
         feedrate = 4000;
         card.sdprinting = 2;
 
-        if (iTempBed > 0)
+        if (plr.bed > 0)
         {
-            command_M190(iTempBed);
+            command_M190(plr.bed);
         }
 
 #ifdef DUAL_X_CARRIAGE
 
-        dual_x_carriage_mode = iMode;
-        if (iTemp0 > 0)
+        dual_x_carriage_mode = plr.dual_x_mode;
+        if (plr.temp0 > 0)
         {
             if (dual_x_carriage_mode == DXC_DUPLICATION_MODE || dual_x_carriage_mode == DXC_MIRROR_MODE)
             {
                 tmp_extruder = 0;
-                command_M109(iTemp0);
+                command_M109(plr.temp0);
             }
             else if (dual_x_carriage_mode == DXC_AUTO_PARK_MODE)
             {
-                setTargetHotend(iTemp0, 0);
+                setTargetHotend(plr.temp0, 0);
             }
         }
 
-        if (iTemp1 > 0)
+        if (plr.temp1 > 0)
         {
             if (dual_x_carriage_mode == DXC_AUTO_PARK_MODE)
             {
-                setTargetHotend(iTemp0, 1);
+                setTargetHotend(plr.temp0, 1);
             }
         }
 
         if (dual_x_carriage_mode == DXC_AUTO_PARK_MODE)
         {
-            if (iTemp0 > 0 && iT01 == 0)
+            if (plr.temp0 > 0 && plr.active_extruder == 0)
             {
                 active_extruder = 0;
-                command_M109(iTemp0);
+                command_M109(plr.temp0);
             }
-            if (iTemp1 > 0 && iT01 == 1)
+            if (plr.temp1 > 0 && plr.active_extruder == 1)
             {
                 active_extruder = 1;
-                command_M109(iTemp1);
+                command_M109(plr.temp1);
             }
         }
 
@@ -3112,24 +3680,24 @@ void command_M1003()
 
         if (dual_x_carriage_mode == DXC_DUPLICATION_MODE)
         {
-            duplicate_extruder_x_offset = fXOffSet;
+            duplicate_extruder_x_offset = plr.dup_x_offset;
         }
 
-        if (iT01 == 1 && fX < 1)
-            fX = tl_X2_MAX_POS - 60;
+        if (plr.active_extruder == 1 && plr.x < 1)
+            plr.x = tl_X2_MAX_POS - 60;
 
 #else
 
-        if (iTemp0 > 0)
+        if (plr.temp0 > 0)
         {
-            command_M109(iTemp0);
+            command_M109(plr.temp0);
         }
 #endif //DUAL_X_CARRIAGE
 
         //fZ = fZ + 1.0;
-        fanSpeed = iFan;
-        command_G92(0.0, 0.0, fZ, fE);
-        command_G1(-99999.0, -99999.0, fZ + 15.0, fE);
+        fanSpeed = plr.fan;
+        command_G92(0.0, 0.0, plr.z, plr.e);
+        command_G1(-99999.0, -99999.0, plr.z + 15.0, plr.e);
         command_G28(1, 1, 0);
 
 #ifdef DUAL_X_CARRIAGE
@@ -3137,16 +3705,16 @@ void command_M1003()
         {
             //command_T(0);
             //command_T(iT01);
-            active_extruder = iT01;
+            active_extruder = plr.active_extruder;
 
             float fYOS = 0.0;
             float fXOS = -1 * X_NOZZLE_WIDTH;
-            if (iT01 == 1)
+            if (plr.active_extruder == 1)
             {
                 fYOS = 2 * (tl_Y2_OFFSET - 5.0);
                 fXOS = tl_X2_MAX_POS;
             }
-            command_G92(fXOS, fYOS, fZ + 15.0, fE);
+            command_G92(fXOS, fYOS, plr.z + 15.0, plr.e);
         }
 #endif
 
@@ -3158,9 +3726,9 @@ void command_M1003()
         card.PRE_Write_PLR();
 #endif
         //fZ = fZ - 1.0;
-        command_G1(fX, fY, fZ, fE);
+        command_G1(plr.x, plr.y, plr.z, plr.e);
 
-        feedrate = string2Float(getSplitValue(sPLR, '|', 13));
+        feedrate = plr.feedrate;
         if (feedrate < 2000)
             feedrate = 4000;
         card.sdprinting = 0;
@@ -3598,8 +4166,8 @@ void process_command_dwn()
 
                         if (pause_BedT > 0)
                         {
-                            String strCommand = "M140 S" + String(pause_BedT);
-                            char *_Command = strCommand.c_str();
+                            char _Command[12];
+                            snprintf_P(_Command, sizeof(_Command), PSTR("M140 S%d"), pause_BedT);
                             enquecommand(_Command);
                         }
                     }
@@ -3650,8 +4218,13 @@ void process_command_dwn()
                 case 0x55:
                 case 0x56:
                     iPrintID = lData - 0x51;
-                    if (file_name_long_list[iPrintID] != "")
-                        DWN_Message(MSG_START_PRINT, file_name_long_list[iPrintID] + "?", false);
+                    if (file_name_long_list[iPrintID][0])
+                    {
+                        char sMsg[LONG_FILENAME_LENGTH + 1];
+                        strcpy(sMsg, file_name_long_list[iPrintID]);
+                        strcat_P(sMsg, PSTR("?"));
+                        DWN_Message(MSG_START_PRINT, sMsg, false);
+                    }
                     break;
                 case 0xB1:
                     print_from_z_target = 0.0;
@@ -3744,6 +4317,15 @@ void process_commands()
     unsigned long codenum; //throw away variable
     char *starpos = NULL;
 
+#ifdef BINARY_GCODE
+    if (cmdbuffer[bufindr][0] == BINARY_GCODE_MOVE)
+    {
+        command_G1_binary(&cmdbuffer[bufindr][2]);
+        ClearToSend();
+        return;
+    }
+#endif
+
     if (code_seen('G'))
     {
         switch ((int)code_value())
@@ -3990,6 +4572,12 @@ void process_commands()
             command_M104();
         }
         break;
+#ifdef AUTO_REPORT
+        case 154: // M154 S<seconds> position auto-report
+        case 155: // M155 S<seconds> temperature auto-report
+            command_auto_report((int)code_value() == 154);
+            break;
+#endif
         case 140: // M140 set bed temp
             if (code_seen('S'))
                 setTargetBed(code_value());
@@ -3999,34 +4587,8 @@ void process_commands()
             {
                 break;
             }
-#if defined(TEMP_0_PIN) && TEMP_0_PIN > -1
-            SERIAL_PROTOCOLPGM("ok T:");
-            SERIAL_PROTOCOL_F(degHotend(0), 1);
-            SERIAL_PROTOCOLPGM("/");
-            SERIAL_PROTOCOL_F(degTargetHotend(0), 1);
-#if defined(TEMP_1_PIN) && TEMP_1_PIN > -1
-            SERIAL_PROTOCOLPGM(" T1:");
-            SERIAL_PROTOCOL_F(degHotend(1), 1);
-            SERIAL_PROTOCOLPGM("/");
-            SERIAL_PROTOCOL_F(degTargetHotend(1), 1);
-#endif
-#if defined(TEMP_BED_PIN) && TEMP_BED_PIN > -1
-            SERIAL_PROTOCOLPGM(" B:");
-            SERIAL_PROTOCOL_F(degBed(), 1);
-            SERIAL_PROTOCOLPGM(" /");
-            SERIAL_PROTOCOL_F(degTargetBed(), 1);
-#endif //TEMP_BED_PIN
-#else
-            SERIAL_ERROR_START;
-            SERIAL_ERRORLNPGM(MSG_ERR_NO_THERMISTORS);
-#endif
-            SERIAL_PROTOCOLPGM(" @:");
-            SERIAL_PROTOCOL(getHeaterPower(tmp_extruder));
-
-            SERIAL_PROTOCOLPGM(" B@:");
-            SERIAL_PROTOCOL(getHeaterPower(-1));
-
-            SERIAL_PROTOCOLLN("");
+            SERIAL_PROTOCOLPGM("ok");
+            report_temperatures(tmp_extruder);
             return;
             break;
         case 109:
@@ -4194,27 +4756,12 @@ void process_commands()
             starpos = (strchr(strchr_pointer + 5, '*'));
             if (starpos != NULL)
                 *(starpos - 1) = '\0';
-            gsM117 = strchr_pointer + 5;
+            strncpy(gsM117, strchr_pointer + 5, SCREEN_MESSAGE_LENGTH - 1);
+            gsM117[SCREEN_MESSAGE_LENGTH - 1] = '\0';
             //lcd_setstatus(strchr_pointer + 5);
             break;
         case 114: // M114
-            SERIAL_PROTOCOLPGM("X:");
-            SERIAL_PROTOCOL(current_position[X_AXIS]);
-            SERIAL_PROTOCOLPGM("Y:");
-            SERIAL_PROTOCOL(current_position[Y_AXIS]);
-            SERIAL_PROTOCOLPGM("Z:");
-            SERIAL_PROTOCOL(current_position[Z_AXIS]);
-            SERIAL_PROTOCOLPGM("E:");
-            SERIAL_PROTOCOL(current_position[E_AXIS]);
-
-            SERIAL_PROTOCOLPGM(MSG_COUNT_X);
-            SERIAL_PROTOCOL(float(st_get_position(X_AXIS)) / axis_steps_per_unit[X_AXIS]);
-            SERIAL_PROTOCOLPGM("Y:");
-            SERIAL_PROTOCOL(float(st_get_position(Y_AXIS)) / axis_steps_per_unit[Y_AXIS]);
-            SERIAL_PROTOCOLPGM("Z:");
-            SERIAL_PROTOCOL(float(st_get_position(Z_AXIS)) / axis_steps_per_unit[Z_AXIS]);
-
-            SERIAL_PROTOCOLLN("");
+            report_position();
             break;
         case 120: // M120
             enable_endstops(false, -1);
@@ -4600,6 +5147,54 @@ void process_commands()
         }
         break;
 #endif
+#ifdef INPUT_SHAPING
+        case 593: // M593 [X] [Y] F<frequency> D<damping> - set input shaping, both axes if no X/Y
+        {
+            bool axis_set[2];
+            axis_set[X_AXIS] = code_seen('X');
+            axis_set[Y_AXIS] = code_seen('Y');
+            if (!axis_set[X_AXIS] && !axis_set[Y_AXIS])
+                axis_set[X_AXIS] = axis_set[Y_AXIS] = true;
+            st_synchronize(); // the new delays must not see the history of a running move
+            for (int8_t axis = 0; axis < 2; axis++)
+            {
+                if (!axis_set[axis])
+                    continue;
+                if (code_seen('F') && code_value() >= 0 && code_value() <= 500)
+                    shaping_frequency[axis] = code_value();
+                if (code_seen('D') && code_value() >= 0 && code_value() < 1)
+                    shaping_zeta[axis] = code_value();
+            }
+            st_set_shaping();
+            SERIAL_ECHO_START;
+            SERIAL_ECHOPAIR("Input shaping X F", shaping_frequency[X_AXIS]);
+            SERIAL_ECHOPAIR(" D", shaping_zeta[X_AXIS]);
+            SERIAL_ECHOPAIR(" Y F", shaping_frequency[Y_AXIS]);
+            SERIAL_ECHOPAIR(" D", shaping_zeta[Y_AXIS]);
+            SERIAL_ECHOLN("");
+        }
+        break;
+#endif
+#ifdef SEGMENT_COALESCING
+        case 594: // M594 A<angle> E<ratio %> S<short segment mm> L<max merged mm> - set segment coalescing, L0 = off
+        {
+            if (code_seen('A') && code_value() >= 0 && code_value() < 90)
+                coalesce_angle = code_value();
+            if (code_seen('E') && code_value() >= 0)
+                coalesce_e_ratio = code_value();
+            if (code_seen('S') && code_value() >= 0)
+                coalesce_short_mm = code_value();
+            if (code_seen('L') && code_value() >= 0)
+                coalesce_max_mm = code_value();
+            SERIAL_ECHO_START;
+            SERIAL_ECHOPAIR("Segment coalescing A", coalesce_angle);
+            SERIAL_ECHOPAIR(" E", coalesce_e_ratio);
+            SERIAL_ECHOPAIR(" S", coalesce_short_mm);
+            SERIAL_ECHOPAIR(" L", coalesce_max_mm);
+            SERIAL_ECHOLN("");
+        }
+        break;
+#endif
 #ifdef FILAMENTCHANGEENABLE
         case 600: //Pause for filament change X[pos] Y[pos] Z[relative lift] E[initial retract] L[later retract distance for removal]
         {
@@ -4732,6 +5327,30 @@ void process_commands()
             command_M605(-1);
             break;
 #endif //DUAL_X_CARRIAGE
+#ifdef LIN_ADVANCE
+        case 900: // M900 T<extruder> K<k> - set linear advance K factor, K0 turns it off
+        {
+            if (setTargetedHotend(900))
+            {
+                break;
+            }
+            if (code_seen('K'))
+            {
+                float advance_k = code_value();
+                if (advance_k >= 0 && advance_k <= 10)
+                    extruder_advance_k[tmp_extruder] = advance_k;
+            }
+            SERIAL_ECHO_START;
+            SERIAL_ECHOPGM(MSG_ADVANCE_K);
+            for (tmp_extruder = 0; tmp_extruder < EXTRUDERS; tmp_extruder++)
+            {
+                SERIAL_ECHO(" ");
+                SERIAL_ECHO(extruder_advance_k[tmp_extruder]);
+            }
+            SERIAL_ECHOLN("");
+        }
+        break;
+#endif //LIN_ADVANCE
 
         case 907: // M907 Set digital trimpot motor current using axis codes.
         {
@@ -5054,6 +5673,86 @@ void process_commands()
         break;
 #endif //PRINT_FROM_Z_HEIGHT
 
+#ifdef Z_LAYER_INDEX
+        case 1041: //M1041 - Build the Z layer index of the selected file
+        {
+            card.zindexBuild();
+        }
+        break;
+#endif //Z_LAYER_INDEX
+
+#ifndef AT90USB
+        case 1042: //M1042 - Host serial receive statistics
+        {
+            rx_statistics s;
+            CRITICAL_SECTION_START;
+            s = rx_stats;
+            if (code_seen('R'))
+                memset(&rx_stats, 0, sizeof(rx_stats));
+            CRITICAL_SECTION_END;
+            SERIAL_ECHO_START;
+            SERIAL_ECHOPAIR("RX buffer:", (unsigned long)RX_BUFFER_SIZE);
+            SERIAL_ECHOPAIR(" peak:", (unsigned long)s.peak);
+            SERIAL_ECHOPAIR(" overflow:", (unsigned long)s.overflow);
+            SERIAL_ECHOPAIR(" overrun:", (unsigned long)s.overrun);
+            SERIAL_ECHOPAIR(" framing:", (unsigned long)s.framing);
+            SERIAL_ECHOPAIR(" parity:", (unsigned long)s.parity);
+            SERIAL_ECHOLN("");
+        }
+        break;
+#endif //AT90USB
+
+#ifdef SD_FAST_UPLOAD
+        case 1043: //M1043 <bytes> <filename> - Fast SD upload
+        {
+            starpos = (strchr(strchr_pointer + 6, '*'));
+            if (starpos != NULL)
+                *(starpos - 1) = '\0';
+            char *name;
+            uint32_t size = strtoul(strchr_pointer + 6, &name, 10);
+            while (*name == ' ')
+                name++;
+            card.uploadFile(name, size);
+        }
+        break;
+#endif //SD_FAST_UPLOAD
+
+#ifdef LOOP_PROFILER
+        case 1044: //M1044 - Loop profiler report
+            profile_report(code_seen('R'));
+            break;
+#endif //LOOP_PROFILER
+
+#ifdef PLANNER_STATS
+        case 1045: //M1045 - Planner statistics
+            plan_report_stats(code_seen('R'));
+            break;
+#endif //PLANNER_STATS
+
+#ifdef SRAM_REPORT
+        case 1046: //M1046 - SRAM report
+            sram_report();
+            break;
+#endif //SRAM_REPORT
+
+#ifdef PRINT_TIME_ESTIMATE
+        case 1047: //M1047 - Print time estimate
+            if (code_seen('S'))
+            {
+                card.timeEstimate = code_value_long();
+            }
+            else
+            {
+                SERIAL_ECHO_START;
+                SERIAL_ECHOPAIR("Print time elapsed:", card.isFileOpen() ? (millis() - starttime) / 1000 : 0UL);
+                SERIAL_ECHOPAIR(" moves:", plan_move_seconds());
+                SERIAL_ECHOPAIR(" estimate:", (unsigned long)card.timeEstimate);
+                SERIAL_ECHOPGM(" remaining:");
+                SERIAL_ECHOLN(card.remainingTime());
+            }
+            break;
+#endif //PRINT_TIME_ESTIMATE
+
         case 1050:
         {
             pinMode(16, OUTPUT);
@@ -5122,6 +5821,9 @@ void FlushSerialRequestResend()
 {
     //char cmdbuffer[bufindr][100]="Resend:";
     MYSERIAL.flush();
+#ifdef JOB_LOG
+    job_stats.resends++;
+#endif
     SERIAL_PROTOCOLPGM(MSG_RESEND);
     SERIAL_PROTOCOLLN(gcode_LastN + 1);
     ClearToSend();
@@ -5134,7 +5836,23 @@ void ClearToSend()
     if (fromsd[bufindr])
         return;
 #endif //SDSUPPORT
+#ifdef BINARY_SERIAL
+    if (frame_seq[bufindr] >= 0)
+    {
+        SERIAL_PROTOCOLPGM("ok B");
+        SERIAL_PROTOCOLLN(frame_seq[bufindr]);
+        return;
+    }
+#endif
+#ifdef ADVANCED_OK
+    SERIAL_PROTOCOLPGM(MSG_OK);
+    SERIAL_PROTOCOLPGM(" P");
+    SERIAL_PROTOCOL((int)(BLOCK_BUFFER_SIZE - 1 - movesplanned()));
+    SERIAL_PROTOCOLPGM(" B");
+    SERIAL_PROTOCOLLN(BUFSIZE - buflen);
+#else
     SERIAL_PROTOCOLLNPGM(MSG_OK);
+#endif
 }
 
 #ifdef POWER_LOSS_RECOVERY
@@ -5428,7 +6146,9 @@ void prepare_move()
             plan_buffer_line(raised_parked_position[X_AXIS], raised_parked_position[Y_AXIS], raised_parked_position[Z_AXIS], current_position[E_AXIS], max_feedrate[Z_AXIS], active_extruder);
             plan_buffer_line(current_position[X_AXIS], current_position[Y_AXIS], raised_parked_position[Z_AXIS], current_position[E_AXIS], min(max_feedrate[X_AXIS], max_feedrate[Y_AXIS]), active_extruder);
             plan_buffer_line(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS], max_feedrate[Z_AXIS], active_extruder);
+#ifndef TOOLCHANGE_PIPELINED
             st_synchronize();
+#endif
             extruder_carriage_mode = 1;
             active_extruder_parked = false;
         }
@@ -5610,11 +6330,95 @@ bool Check_Power_Loss()
 
     return bRet;
 }
+
+#ifdef POWER_LOSS_DETECT_BY_INTERRUPT
+volatile bool bPowerLossActive = false;      // the stepper and temperature ISRs stay idle while set
+static volatile bool bPowerLossEdge = false; // the detect pin changed, Power_Loss_Manage() has to look at it
+
+#if POWER_LOSS_DETECT_PIN == 2
+#define POWER_LOSS_INTX 0
+#elif POWER_LOSS_DETECT_PIN == 3
+#define POWER_LOSS_INTX 1
+#elif POWER_LOSS_DETECT_PIN == 21
+#define POWER_LOSS_INTX 2
+#elif POWER_LOSS_DETECT_PIN == 20
+#define POWER_LOSS_INTX 3
+#elif POWER_LOSS_DETECT_PIN == 19
+#define POWER_LOSS_INTX 4
+#elif POWER_LOSS_DETECT_PIN == 18
+#define POWER_LOSS_INTX 5
+#elif (POWER_LOSS_DETECT_PIN >= 10 && POWER_LOSS_DETECT_PIN <= 13) || (POWER_LOSS_DETECT_PIN >= 50 && POWER_LOSS_DETECT_PIN <= 53)
+#define POWER_LOSS_PCINT_vect PCINT0_vect
+#elif POWER_LOSS_DETECT_PIN == 14 || POWER_LOSS_DETECT_PIN == 15
+#define POWER_LOSS_PCINT_vect PCINT1_vect
+#elif POWER_LOSS_DETECT_PIN >= 62 && POWER_LOSS_DETECT_PIN <= 69
+#define POWER_LOSS_PCINT_vect PCINT2_vect
+#else
+#error "POWER_LOSS_DETECT_BY_INTERRUPT needs POWER_LOSS_DETECT_INT_PIN on an INTx or PCINT pin"
+#endif
+
+// Runs on every edge of the detect pin. Only stops the steppers and heaters when the level means a power loss
+// Check_Power_Loss() would act on (with its 10 re-read confirmation); saving the state and the screen are
+// left to Power_Loss_Manage().
+static void Power_Loss_Edge()
+{
+    bPowerLossEdge = true;
+    int iPLRead = digitalRead(POWER_LOSS_DETECT_PIN);
+    if (b_PLR_MODULE_Detected)
+    {
+        if (iPLRead == 1)
+            bPowerLossActive = true;
+        return;
+    }
+    if (iPLRead == 1 || millis() < DETECT_PLR_TIME || card.sdprinting != 1)
+        return;
+    for (int i = 0; i < 10; i++)
+    {
+        if (digitalRead(POWER_LOSS_DETECT_PIN) == 1)
+            return;
+    }
+    bPowerLossActive = true;
+}
+
+#ifdef POWER_LOSS_PCINT_vect
+ISR(POWER_LOSS_PCINT_vect)
+{
+    Power_Loss_Edge();
+}
+#endif
+
+void Power_Loss_Init()
+{
+#ifdef POWER_LOSS_INTX
+    attachInterrupt(POWER_LOSS_INTX, Power_Loss_Edge, CHANGE);
+#else
+    *digitalPinToPCMSK(POWER_LOSS_DETECT_PIN) |= (1 << digitalPinToPCMSKbit(POWER_LOSS_DETECT_PIN));
+    PCIFR |= (1 << digitalPinToPCICRbit(POWER_LOSS_DETECT_PIN));
+    *digitalPinToPCICR(POWER_LOSS_DETECT_PIN) |= (1 << digitalPinToPCICRbit(POWER_LOSS_DETECT_PIN));
+#endif
+    // a level present before the interrupt was armed produces no edge
+    bPowerLossActive = Check_Power_Loss();
+}
+
+// Called from manage_inactivity(). The first DETECT_PLR_TIME ms sample the level as the polled version
+// does, that is how a PLR module is told from the LM393 circuit; after that only edges are looked at.
+void Power_Loss_Manage()
+{
+    if (!bPowerLossEdge && millis() > DETECT_PLR_TIME)
+        return;
+    bPowerLossEdge = false;
+    bPowerLossActive = Check_Power_Loss();
+}
+#endif //POWER_LOSS_DETECT_BY_INTERRUPT
 #else
 
 #endif
+// Interrupts are off while the state is saved and X parked and come back as they were on entry: on from
+// Power_Loss_Manage(), still off inside an ISR until its return. A short dip of the LM393 circuit then
+// reaches the "power restored" branch of Check_Power_Loss() again.
 void Power_Off_Handler(bool MoveX, bool M81)
 {
+    uint8_t oldSREG = SREG;
 
     if (card.sdprinting == 1 && !gbPLRStatusSaved)
     {
@@ -5692,12 +6496,19 @@ void Power_Off_Handler(bool MoveX, bool M81)
         command_M81(false); //false to show shutdown screen;
         gbPowerLoss = true;
     }
+    SREG = oldSREG;
 }
 
 #endif //POWER_LOSS_TRIGGER_BY_PIN
 
 void manage_inactivity()
 {
+#ifdef POWER_LOSS_DETECT_BY_INTERRUPT
+    Power_Loss_Manage();
+#endif
+#ifdef AUTO_REPORT
+    auto_report();
+#endif
     if ((millis() - previous_millis_cmd) > max_inactive_time)
         if (max_inactive_time)
             kill();
@@ -5885,6 +6696,9 @@ bool setTargetedHotend(int code)
             case 218:
                 SERIAL_ECHO(MSG_M218_INVALID_EXTRUDER);
                 break;
+            case 900:
+                SERIAL_ECHO(MSG_M900_INVALID_EXTRUDER);
+                break;
             }
             SERIAL_ECHOLN(tmp_extruder);
             return true;
@@ -5928,48 +6742,40 @@ void sdcard_pause(int OValue)
         return;
 #endif
     card.pauseSDPrint();
+#ifdef JOB_LOG
+    job_stats.pauses++;
+#endif
 
     if(tl_TouchScreenType == 1)
     {
         TLSTJC_printconstln(F("reload.vaFromPageID.val=6"));
         
-        String strMessage = String(active_extruder + 1);    
-        const char *str0 = strMessage.c_str();
+        char sSend[16];
         TLSTJC_printconst(F("reload.sT1T2.txt=\""));
-        TLSTJC_print(str0);
+        TLSTJC_print(itoa(active_extruder + 1, sSend, 10));
         TLSTJC_printconstln(F("\""));
         _delay_ms(50);
 
-        strMessage = String(target_temperature[0]);
-        str0 = strMessage.c_str();
         TLSTJC_printconst(F("reload.vaTargetTemp0.val="));
-        TLSTJC_println(str0);
+        TLSTJC_println(itoa(target_temperature[0], sSend, 10));
         _delay_ms(50);
         
-        strMessage = String(target_temperature[1]);
-        str0 = strMessage.c_str();
         TLSTJC_printconst(F("reload.vaTargetTemp1.val="));
-        TLSTJC_println(str0);
+        TLSTJC_println(itoa(target_temperature[1], sSend, 10));
         _delay_ms(50);
 
-        strMessage = String(int(degTargetBed() + 0.5));
-        str0 = strMessage.c_str();
         TLSTJC_printconst(F("reload.vaTargetBed.val="));
-        TLSTJC_println(str0);
+        TLSTJC_println(itoa(int(degTargetBed() + 0.5), sSend, 10));
         _delay_ms(50);
         
-        strMessage = String(dual_x_carriage_mode);
-        str0 = strMessage.c_str();
         TLSTJC_printconst(F("reload.vaMode.val="));
-        TLSTJC_println(str0);
+        TLSTJC_println(itoa(dual_x_carriage_mode, sSend, 10));
         _delay_ms(50);
 
         if (duplicate_extruder_x_offset != DEFAULT_DUPLICATION_X_OFFSET)
         {
-            strMessage = "" + String(duplicate_extruder_x_offset) + "";
-            str0 = strMessage.c_str();
             TLSTJC_printconst(F("reload.vaMode2Offset.val="));
-            TLSTJC_println(str0);
+            TLSTJC_println(dtostrf(duplicate_extruder_x_offset, 1, 2, sSend)); // as String(float) printed it
         }
         else
             TLSTJC_printconstln(F("reload.vaMode2Offset.val=-1"));
@@ -6164,21 +6970,14 @@ void cooldown()
     //lcd_return_to_status();
 }
 
-bool strISAscii(String str)
+bool strISAscii(const char *str)
 {
-    bool bOK = true;
-    int iFNL = str.length();
-    char cFN[iFNL];
-    str.toCharArray(cFN, iFNL);
-    for (int i = 0; i < iFNL - 1; i++)
+    for (; *str; str++)
     {
-        if (!isAscii(cFN[i]))
-        {
-            bOK = false;
-            break;
-        }
+        if (!isAscii(*str))
+            return false;
     }
-    return bOK;
+    return true;
 }
 
 char conv[8];
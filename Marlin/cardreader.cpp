@@ -4,6 +4,9 @@
 #include "temperature.h"
 #include "language.h"
 #include "ConfigurationStore.h"
+#ifdef SD_FAST_UPLOAD
+#include <util/crc16.h>
+#endif
 
 #ifdef SDSUPPORT
 
@@ -18,6 +21,17 @@ CardReader::CardReader()
     autostart_atmillis = 0;
     workDirDepth = 0;
     memset(workDirParents, 0, sizeof(workDirParents));
+#ifdef SD_DIR_INDEX_SIZE
+    dirIndexCount = 0;
+#endif
+
+#ifdef Z_LAYER_INDEX
+    zindexRecording = false;
+    zindexCount = 0;
+#endif
+#ifdef BINARY_GCODE
+    binary = false;
+#endif
 
     autostart_stilltocheck = true; //the sd start is delayed, because otherwise the serial cannot answer fast enought to make contact with the hostsoftware.
     lastnr = 0;
@@ -52,8 +66,13 @@ void CardReader::lsDive(const char *prepend, SdFile parent)
     dir_t p;
     uint8_t cnt = 0;
 
-    while (parent.readDir(p, longFilename) > 0)
+    while (true)
     {
+#ifdef SD_DIR_INDEX_SIZE
+        uint16_t entry = parent.curPosition() >> 5; // the long name entries come before the 8.3 one
+#endif
+        if (parent.readDir(p, longFilename) <= 0)
+            break;
         if (DIR_IS_SUBDIR(&p) && lsAction != LS_Count && lsAction != LS_GetFilename) // hence LS_SerialPrint
         {
 
@@ -120,6 +139,10 @@ void CardReader::lsDive(const char *prepend, SdFile parent)
             }
             else if (lsAction == LS_Count)
             {
+#ifdef SD_DIR_INDEX_SIZE
+                if (nrFiles < SD_DIR_INDEX_SIZE)
+                    dirIndex[nrFiles] = entry;
+#endif
                 nrFiles++;
             }
             else if (lsAction == LS_GetFilename)
@@ -185,6 +208,9 @@ void CardReader::initsd()
     }
     workDir = root;
     curDir = &root;
+#ifdef SD_DIR_INDEX_SIZE
+    dirIndexCount = 0;
+#endif
 }
 
 void CardReader::setroot()
@@ -196,6 +222,9 @@ void CardReader::setroot()
     workDir = root;
 
     curDir = &workDir;
+#ifdef SD_DIR_INDEX_SIZE
+    dirIndexCount = 0;
+#endif
 }
 void CardReader::release()
 {
@@ -208,6 +237,9 @@ void CardReader::startFileprint()
     if (cardOK)
     {
         sdprinting = 1;
+#ifdef Z_LAYER_INDEX
+        zindexStart();
+#endif
     }
 }
 
@@ -215,6 +247,9 @@ void CardReader::pauseSDPrint()
 {
     if (sdprinting == 1)
         sdprinting = 0;
+#if defined(PLANNER_STATS) || defined(JOB_LOG)
+    st_reset_starved();
+#endif
 }
 
 void CardReader::openLogFile(char *name)
@@ -227,8 +262,14 @@ void CardReader::openFile(char *lngName, char *name, bool read, uint32_t startPo
 {
     if (!cardOK)
         return;
+#ifdef Z_LAYER_INDEX
+    zindexFinish(false);
+#endif
     file.close();
     sdprinting = 0;
+#ifdef BINARY_GCODE
+    binary = false;
+#endif
 
     SdFile myDir;
     curDir = &root;
@@ -291,6 +332,18 @@ void CardReader::openFile(char *lngName, char *name, bool read, uint32_t startPo
             SERIAL_PROTOCOLPGM(MSG_SD_SIZE);
             SERIAL_PROTOCOLLN(filesize);
 
+#ifdef Z_LAYER_INDEX
+            // NAME.ZIX in the same directory
+            zindexDir = *curDir;
+            uint8_t n = 0;
+            while (fname[n] && fname[n] != '.' && n < 8)
+            {
+                zindexName[n] = fname[n];
+                n++;
+            }
+            strcpy_P(zindexName + n, PSTR(".ZIX"));
+#endif
+
 //By Zyf
 #ifdef POWER_LOSS_RECOVERY
             if (startPos > 0)
@@ -308,13 +361,33 @@ void CardReader::openFile(char *lngName, char *name, bool read, uint32_t startPo
             sdpos = 0;
 #endif
 
+#ifdef BINARY_GCODE
+            char header[4];
+            file.seekSet(0);
+            binary = file.read(header, sizeof(header)) == sizeof(header) && memcmp_P(header, PSTR(BINARY_GCODE_MAGIC), sizeof(header)) == 0;
+            if (binary && sdpos < sizeof(header))
+                sdpos = sizeof(header);
+            setIndex(sdpos);
+#endif
+
             SERIAL_PROTOCOLLNPGM(MSG_SD_FILE_SELECTED);
+#ifdef PRINT_TIME_ESTIMATE
+            timeEstimate = 0;
+            timeStartPos = sdpos;
+            plan_reset_time();
+#endif
+#ifdef JOB_LOG
+            CRITICAL_SECTION_START;
+            memset(&job_stats, 0, sizeof(job_stats));
+            job_stats.isr_period = 1;
+            CRITICAL_SECTION_END;
+            st_reset_starved();
+            strlcpy(jobName, lngName[0] ? lngName : fname, sizeof(jobName));
+#endif
             //lcd_setstatus(fname);
 
 #ifdef POWER_LOSS_RECOVERY
-            String strFName = fname;
-            String strLFName = lngName;
-            writeLastFileName(strLFName, strFName);
+            writeLastFileName(lngName, fname);
 #if defined(POWER_LOSS_SAVE_TO_EEPROM)
             EEPROM_Write_PLR();
             EEPROM_PRE_Write_PLR();
@@ -334,6 +407,9 @@ void CardReader::openFile(char *lngName, char *name, bool read, uint32_t startPo
     }
     else
     { //write
+#ifdef SD_DIR_INDEX_SIZE
+        dirIndexCount = 0;
+#endif
         if (!file.open(curDir, fname, O_CREAT | O_APPEND | O_WRITE | O_TRUNC))
         {
             SERIAL_PROTOCOLPGM(MSG_SD_OPEN_FILE_FAIL);
@@ -354,6 +430,9 @@ void CardReader::removeFile(char *name)
 {
     if (!cardOK)
         return;
+#ifdef SD_DIR_INDEX_SIZE
+    dirIndexCount = 0;
+#endif
     file.close();
     sdprinting = 0;
 
@@ -432,6 +511,112 @@ void CardReader::getStatus()
         SERIAL_PROTOCOLLNPGM(MSG_SD_NOT_PRINTING);
     }
 }
+#ifdef SD_FAST_UPLOAD
+// next byte from the host, -1 after SD_UPLOAD_TIMEOUT ms without one
+static int16_t upload_byte()
+{
+    unsigned long timeout = millis() + SD_UPLOAD_TIMEOUT;
+    while (MYSERIAL.available() == 0)
+    {
+        manage_heater();
+        if ((long)(millis() - timeout) > 0)
+            return -1;
+    }
+    return MYSERIAL.read();
+}
+
+// M1043, see SD_FAST_UPLOAD. The file is allocated contiguous up front, so the chunks can go to the card
+// with one CMD25 multi block write through the volume cache buffer, with no FAT or directory updates on the way.
+void CardReader::uploadFile(char *name, uint32_t size)
+{
+    if (!cardOK || size == 0 || sdprinting)
+    {
+        SERIAL_PROTOCOLPGM(MSG_SD_OPEN_FILE_FAIL);
+        SERIAL_PROTOCOLLN(name);
+        return;
+    }
+#ifdef SD_DIR_INDEX_SIZE
+    dirIndexCount = 0;
+#endif
+    file.close();
+    SdBaseFile::remove(curDir, name);
+
+    uint32_t bgnBlock, endBlock;
+    cache_t *cache = 0;
+    if (!file.createContiguous(curDir, name, size) || !file.contiguousRange(&bgnBlock, &endBlock) ||
+        (cache = volume.cacheClear()) == 0 || !card.writeStart(bgnBlock, (size + 511) >> 9))
+    {
+        if (file.isOpen())
+            file.remove();
+        SERIAL_PROTOCOLPGM(MSG_SD_OPEN_FILE_FAIL);
+        SERIAL_PROTOCOLLN(name);
+        return;
+    }
+    SERIAL_PROTOCOLPGM(MSG_SD_WRITE_TO_FILE);
+    SERIAL_PROTOCOLLN(name);
+
+    uint8_t *buf = cache->data;
+    unsigned long start = millis();
+    uint32_t done = 0;
+    uint32_t chunk = 0;
+    while (done < size)
+    {
+        uint16_t n = size - done < 512 ? size - done : 512;
+        uint16_t crc = 0;
+        for (uint16_t i = 0; i < n + 2; i++)
+        {
+            int16_t c = upload_byte();
+            if (c < 0)
+                goto fail;
+            if (i < n)
+            {
+                buf[i] = c;
+                crc = _crc_xmodem_update(crc, c);
+            }
+            else
+                crc ^= i == n ? c : (uint16_t)c << 8;
+        }
+        if (crc != 0)
+        {
+            // let the rest of a garbled chunk pass before asking for it again
+            unsigned long quiet = millis();
+            while (millis() - quiet < 50)
+                if (MYSERIAL.read() >= 0)
+                    quiet = millis();
+            SERIAL_PROTOCOLPGM("rs ");
+            SERIAL_PROTOCOLLN(chunk);
+            continue;
+        }
+        memset(buf + n, 0, 512 - n);
+        if (!card.writeData(buf))
+            goto fail;
+        done += n;
+        SERIAL_PROTOCOLPGM(MSG_OK " ");
+        SERIAL_PROTOCOLLN(chunk++);
+    }
+    if (!card.writeStop())
+        goto fail;
+    file.close();
+    {
+        unsigned long ms = millis() - start;
+        SERIAL_PROTOCOLPGM(MSG_SD_UPLOAD_DONE);
+        SERIAL_PROTOCOL(size);
+        SERIAL_PROTOCOLPGM(" ms: ");
+        SERIAL_PROTOCOL(ms);
+        SERIAL_PROTOCOLPGM(" bytes/s: ");
+        SERIAL_PROTOCOLLN((unsigned long)(ms ? size * 1000.0 / ms : size));
+    }
+    return;
+
+fail:
+    card.writeStop();
+    file.remove();
+    SERIAL_ERROR_START;
+    SERIAL_ERRORPGM(MSG_SD_UPLOAD_FAIL);
+    SERIAL_ERRORLN(done);
+}
+#endif //SD_FAST_UPLOAD
+
 void CardReader::write_command(char *buf)
 {
     char *begin = buf;
@@ -505,6 +690,9 @@ void CardReader::checkautostart(bool force)
 
 void CardReader::closefile()
 {
+#ifdef Z_LAYER_INDEX
+    zindexFinish(false);
+#endif
     file.sync();
     file.close();
     saving = false;
@@ -514,6 +702,18 @@ void CardReader::closefile()
 void CardReader::getfilename(const uint8_t nr)
 {
     curDir = &workDir;
+#ifdef SD_DIR_INDEX_SIZE
+    if (nr < dirIndexCount)
+    {
+        dir_t p;
+        if (workDir.seekSet((uint32_t)dirIndex[nr] << 5) && workDir.readDir(p, longFilename) > 0)
+        {
+            filenameIsDir = DIR_IS_SUBDIR(&p);
+            createFilename(filename, p);
+            return;
+        }
+    }
+#endif
     lsAction = LS_GetFilename;
     nrFiles = nr;
     curDir->rewind();
@@ -527,6 +727,9 @@ uint16_t CardReader::getnrfilenames()
     nrFiles = 0;
     curDir->rewind();
     lsDive("", *curDir);
+#ifdef SD_DIR_INDEX_SIZE
+    dirIndexCount = min(nrFiles, SD_DIR_INDEX_SIZE);
+#endif
     //SERIAL_ECHOLN(nrFiles);
     return nrFiles;
 }
@@ -554,6 +757,9 @@ void CardReader::chdir(const char *relpath)
             workDirParents[0] = *parent;
         }
         workDir = newfile;
+#ifdef SD_DIR_INDEX_SIZE
+        dirIndexCount = 0;
+#endif
     }
     //SERIAL_ECHOLN(relpath);
 }
@@ -567,6 +773,9 @@ void CardReader::updir()
         int d;
         for (int d = 0; d < workDirDepth; d++)
             workDirParents[d] = workDirParents[d + 1];
+#ifdef SD_DIR_INDEX_SIZE
+        dirIndexCount = 0;
+#endif
     }
 }
 
@@ -574,171 +783,358 @@ void CardReader::printingHasFinished()
 {
     st_synchronize();
     quickStop();
+#ifdef Z_LAYER_INDEX
+    zindexFinish(true);
+#endif
     file.close();
     sdprinting = 0;
+#if defined(PLANNER_STATS) || defined(JOB_LOG)
+    st_reset_starved();
+#endif
     finishAndDisableSteppers(true); //By Zyf
     autotempShutdown();
 }
 
-#ifdef POWER_LOSS_RECOVERY
+#ifdef JOB_LOG
+job_stats_t job_stats;
 
-void CardReader::writeLastFileName(String LFName, String Value)
+void CardReader::writeJobLog(unsigned long ms)
 {
     if (!cardOK)
         return;
 
-    SdFile tf_file;
-    SdFile *parent = &root;
-    const char *tff = "PLN.TXT";
+    job_stats_t s;
+    CRITICAL_SECTION_START;
+    s = job_stats;
+    CRITICAL_SECTION_END;
 
-    bool bFileExists = false;
-    if (tf_file.open(*parent, tff, O_READ))
+    SdFile log;
+    if (!log.open(&root, "JOBLOG.CSV", O_CREAT | O_WRITE | O_APPEND))
+        return;
+    if (log.fileSize() == 0)
+        log.write_P(PSTR("file,seconds,heating s,empty planner s,toolchanges,pauses,runouts,max isr load %,resends\r\n"));
+    // quoted name, a quote in it doubled
+    log.write('"');
+    for (const char *c = jobName; *c; c++)
     {
-        bFileExists = true;
-        tf_file.close();
+        if (*c == '"')
+            log.write('"');
+        log.write((uint8_t)*c);
     }
+    log.write('"');
+    // 3 * ",4294967295" + 5 * ",65535" + "\r\n"
+    char line[66];
+    snprintf_P(line, sizeof(line), PSTR(",%lu,%lu,%lu,%u,%u,%u,%u,%u\r\n"), ms / 1000, s.heating_ms / 1000,
+               s.starved_ms / 1000, s.toolchanges, s.pauses, s.runouts, (unsigned int)((uint32_t)s.isr_ticks * 100 / s.isr_period), s.resends);
+    log.write(line);
+    log.close();
+}
+#endif
 
-    String sContent = "";
-    char cAll[150];
-    char cContent[50];
-
-    sContent = LFName + "|";
-    sContent += Value;
-    sContent.toCharArray(cContent, 50);
-    sprintf_P(cAll, PSTR("%s"), cContent);
+#ifdef PRINT_TIME_ESTIMATE
+long CardReader::remainingTime()
+{
+    if (!isFileOpen())
+        return -1;
 
-    const char *arrFileContentNew = cAll;
+    unsigned long done = plan_move_seconds();
+    if (timeEstimate > done)
+        return timeEstimate - done;
 
-    uint8_t O_TF = O_CREAT | O_EXCL | O_WRITE;
-    if (bFileExists)
-        O_TF = O_WRITE | O_TRUNC;
+    // No estimate or the job is running over it: scale the move time by the part of the file still to read
+    if (done == 0 || sdpos <= timeStartPos + filesize / 100 || sdpos > filesize)
+        return -1;
+    return (float)done * (filesize - sdpos) / (sdpos - timeStartPos);
+}
+#endif
 
-    if (tf_file.open(*parent, tff, O_TF))
+#ifdef BINARY_GCODE
+bool CardReader::getBinaryCommand(char *cmd)
+{
+    int16_t type = file.read();
+    if (type == BINARY_GCODE_ASCII)
     {
-        tf_file.write(arrFileContentNew);
-        tf_file.close();
+        int16_t n = file.read();
+        if (n <= 0 || n >= MAX_CMD_SIZE || file.read(cmd, n) != n)
+            return false;
+        cmd[n] = 0;
+    }
+    else if (type >= 0 && type < 0x20)
+    {
+        cmd[0] = BINARY_GCODE_MOVE;
+        cmd[1] = 0; // nothing for code_seen()
+        cmd[2] = type;
+        int16_t n = 0;
+        for (uint8_t mask = type; mask; mask >>= 1)
+            if (mask & 1)
+                n += 4;
+        if (file.read(cmd + 3, n) != n)
+            return false;
     }
     else
+        return false;
+    sdpos = file.curPosition();
+    return true;
+}
+#endif //BINARY_GCODE
+
+#ifdef Z_LAYER_INDEX
+// NAME.ZIX beside the G-code file holds the size of the G-code file, then one ZIndexEntry per layer in
+// rising Z. pos is the offset of the line that moved to the layer's Z. The size stays 0 until the whole
+// file went through zindexLine(), so the index of an interrupted print is never used.
+
+void CardReader::zindexStart(bool force)
+{
+    if (zindexRecording || !file.isOpen() || sdpos != 0)
+        return;
+#ifdef BINARY_GCODE
+    if (binary)
+        return;
+#endif
+#ifdef PRINT_FROM_Z_HEIGHT
+    if (!force && !PrintFromZHeightFound)
+        return; // the file is searched, not read in order
+#endif
+    uint32_t size = 0;
+    if (!force && zindexFile.open(&zindexDir, zindexName, O_READ))
     {
+        zindexFile.read(&size, sizeof(size));
+        zindexFile.close();
+        if (size == filesize)
+            return; // indexed already
     }
+    if (!zindexFile.open(&zindexDir, zindexName, O_CREAT | O_WRITE | O_TRUNC))
+        return;
+    size = 0;
+    zindexFile.write(&size, sizeof(size));
+    zindexRecording = true;
+    zindexZ = 0.0;
+    zindexZPos = 0;
+    zindexLayerZ = 0.0;
+    zindexLastPos = 0;
+    zindexCount = 0;
 }
 
-///////////////////split
-String CardReader::getSplitValue(String data, char separator, int index)
+void CardReader::zindexLine(const char *cmd, uint32_t pos)
 {
-    int found = 0;
-    int strIndex[] = {0, -1};
-    int maxIndex = data.length() - 1;
+    if (!zindexRecording)
+        return;
+    if (pos < zindexLastPos)
+    { // the file was repositioned
+        zindexFinish(false);
+        return;
+    }
+    zindexLastPos = pos;
 
-    for (int i = 0; i <= maxIndex && found <= index; i++)
+    // G0/G1 only, not G10/G11
+    if (cmd[0] != 'G' || (cmd[1] != '0' && cmd[1] != '1') || (cmd[2] >= '0' && cmd[2] <= '9'))
+        return;
+    const char *z = strchr(cmd, 'Z');
+    if (z != NULL)
     {
-        if (data.charAt(i) == separator || i == maxIndex)
-        {
-            found++;
-            strIndex[0] = strIndex[1] + 1;
-            strIndex[1] = (i == maxIndex) ? i + 1 : i;
-        }
+        zindexZ = strtod(z + 1, NULL);
+        zindexZPos = pos;
+    }
+    // a layer starts with the first extrusion at a new height, so Z hops do not count
+    if (zindexZ >= zindexLayerZ + Z_LAYER_INDEX_MIN_STEP && strchr(cmd, 'E') != NULL && (strchr(cmd, 'X') != NULL || strchr(cmd, 'Y') != NULL))
+    {
+        zindexLayerZ = zindexZ;
+        zindexBuf[zindexCount].z = zindexZ;
+        zindexBuf[zindexCount].pos = zindexZPos;
+        if (++zindexCount == sizeof(zindexBuf) / sizeof(zindexBuf[0]))
+            zindexFlush();
     }
-    return found > index ? data.substring(strIndex[0], strIndex[1]) : "";
 }
 
+void CardReader::zindexFlush()
+{
+    zindexFile.write(zindexBuf, zindexCount * sizeof(ZIndexEntry));
+    zindexCount = 0;
+}
 
-String CardReader::isPowerLoss()
+void CardReader::zindexFinish(bool complete)
 {
-    if (!cardOK)
-        return "";
+    if (!zindexRecording)
+        return;
+    zindexRecording = false;
+    zindexFlush();
+    if (complete)
+    {
+        zindexFile.seekSet(0);
+        zindexFile.write(&filesize, sizeof(filesize));
+    }
+    zindexFile.close();
+}
+
+bool CardReader::zindexSeek(float z)
+{
+    if (zindexRecording || !file.isOpen() || !zindexFile.open(&zindexDir, zindexName, O_READ))
+        return false;
 
-    String sRet = "";
+    bool found = false;
+    uint32_t size = 0;
+    ZIndexEntry entry;
+    zindexFile.read(&size, sizeof(size));
+    if (size == filesize)
+    { // binary search for the first layer at or above z
+        uint32_t count = (zindexFile.fileSize() - sizeof(size)) / sizeof(ZIndexEntry);
+        uint32_t lo = 0;
+        uint32_t hi = count;
+        while (lo < hi)
+        {
+            uint32_t mid = (lo + hi) / 2;
+            zindexFile.seekSet(sizeof(size) + mid * sizeof(ZIndexEntry));
+            zindexFile.read(&entry, sizeof(entry));
+            if (entry.z < z - 0.001)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo < count)
+        {
+            zindexFile.seekSet(sizeof(size) + lo * sizeof(ZIndexEntry));
+            found = zindexFile.read(&entry, sizeof(entry)) == sizeof(entry) && entry.pos > 0;
+        }
+    }
+    zindexFile.close();
 
-    SdFile tf_file;
-    SdFile *parent = &root;
-    const char *tff = "PLN.TXT";
+    if (found)
+        setIndex(entry.pos);
+    return found;
+}
 
-    //Read File
-    if (tf_file.open(*parent, tff, O_READ))
-    {
-        int16_t fS = tf_file.fileSize() + 1;
-        char buf[255];
-        char dim1[] = "\n";
-        char *dim = dim1;
-        int16_t n = tf_file.fgets(buf, fS, dim);
-        String strFileContent = "";
+void CardReader::zindexBuild()
+{
+    if (!file.isOpen() || sdprinting == 1)
+        return;
+
+    uint32_t savedpos = sdpos;
+    setIndex(0);
+    zindexStart(true);
 
-        for (int i = 0; i < fS; i++)
+    char line[MAX_CMD_SIZE];
+    uint8_t n = 0;
+    bool comment = false;
+    uint32_t linepos = 0;
+    while (zindexRecording && !eof())
+    {
+        int16_t c = get();
+        if (c == '\n' || c == '\r' || c < 0)
         {
-            if (buf[i] != '\0')
-                strFileContent += buf[i];
+            line[n] = 0;
+            if (n)
+                zindexLine(line, linepos);
+            n = 0;
+            comment = false;
+            linepos = sdpos + 1;
+            manage_heater();
         }
+        else if (c == ';')
+            comment = true;
+        else if (!comment && n < MAX_CMD_SIZE - 1)
+            line[n++] = c;
+    }
+    line[n] = 0;
+    if (n)
+        zindexLine(line, linepos);
+    zindexFinish(true);
+    setIndex(savedpos);
+
+    SERIAL_ECHO_START;
+    SERIAL_ECHOLNPGM("Z index written");
+}
+#endif //Z_LAYER_INDEX
+
+#ifdef POWER_LOSS_RECOVERY
 
-        if (strFileContent != "")
-            sRet = strFileContent;
+// First line of a small text file in dir, false if it is missing or empty.
+static bool read_text_file(SdFile &dir, const char *name, char *buf, int16_t size)
+{
+    SdFile tf_file;
+    buf[0] = '\0';
+    if (tf_file.open(&dir, name, O_READ))
+    {
+        if (tf_file.fgets(buf, size) < 0)
+            buf[0] = '\0';
+        tf_file.close();
     }
-    tf_file.close();
+    return buf[0] != '\0';
+}
 
-    if (sRet != "")
+static void write_text_file(SdFile &dir, const char *name, const char *content)
+{
+    SdFile tf_file;
+    if (tf_file.open(&dir, name, O_CREAT | O_WRITE | O_TRUNC))
     {
-        uint32_t lFPos = 0;
-#if defined(POWER_LOSS_SAVE_TO_EEPROM)
-        lFPos = EEPROM_Read_PLR_0();
-#elif defined(POWER_LOSS_SAVE_TO_SDCARD)
-        lFPos = Read_PLR_0();
-#endif
-        if (lFPos < 2048)
-            sRet = "";
+        tf_file.write(content);
+        tf_file.close();
     }
-    else
+}
+
+// Splits buf on '|' in place, returns the number of fields found.
+static uint8_t split_fields(char *buf, char *field[], uint8_t count)
+{
+    uint8_t n = 0;
+    while (n < count)
     {
-        //TL_DEBUG_PRINT_LN(F("PLR File open fail."));
+        field[n++] = buf;
+        buf = strchr(buf, '|');
+        if (!buf)
+            break;
+        *buf++ = '\0';
     }
+    return n;
+}
 
-    return sRet;
+// PLN.TXT holds "long name|short name" of the file being printed.
+static bool read_file_names(SdFile &dir, PowerLossState &s)
+{
+    char buf[50];
+    char *field[2];
+    if (!read_text_file(dir, "PLN.TXT", buf, sizeof(buf)) || split_fields(buf, field, 2) < 2 || !field[1][0])
+        return false;
+    strlcpy(s.long_name, field[0], sizeof(s.long_name));
+    strlcpy(s.name, field[1], sizeof(s.name));
+    return true;
 }
 
-String CardReader::get_PLR()
+void CardReader::writeLastFileName(const char *LFName, const char *Value)
 {
     if (!cardOK)
-        return "";
-
-    String sRet = "";
+        return;
 
-    SdFile tf_file;
-    SdFile *parent = &root;
-    const char *tff = "PLN.TXT";
+    char cAll[50];
+    snprintf_P(cAll, sizeof(cAll), PSTR("%s|%s"), LFName, Value);
+    write_text_file(root, "PLN.TXT", cAll);
+}
 
-    //Read File
-    if (tf_file.open(*parent, tff, O_READ))
-    {
-        int16_t fS = tf_file.fileSize() + 1;
-        char buf[255];
-        char dim1[] = "\n";
-        char *dim = dim1;
-        int16_t n = tf_file.fgets(buf, fS, dim);
-        String strFileContent = "";
+bool CardReader::isPowerLoss(PowerLossState &s)
+{
+    if (!cardOK || !read_file_names(root, s))
+        return false;
 
-        for (int i = 0; i < fS; i++)
-        {
-            if (buf[i] != '\0')
-                strFileContent += buf[i];
-        }
+    s.file_pos = 0;
+#if defined(POWER_LOSS_SAVE_TO_EEPROM)
+    s.file_pos = EEPROM_Read_PLR_0();
+#elif defined(POWER_LOSS_SAVE_TO_SDCARD)
+    s.file_pos = Read_PLR_0();
+#endif
+    return s.file_pos >= 2048;
+}
 
-        if (strFileContent != "")
-        {
-            sRet = strFileContent;
-        }
-    }
-    tf_file.close();
+bool CardReader::get_PLR(PowerLossState &s)
+{
+    if (!cardOK || !read_file_names(root, s))
+        return false;
 
-    if (sRet != "")
-    {
-        String strRet = "";
 #if defined(POWER_LOSS_SAVE_TO_EEPROM)
-        strRet = EEPROM_Read_PLR();
+    EEPROM_Read_PLR(s);
+    return true;
 #elif defined(POWER_LOSS_SAVE_TO_SDCARD)
-        strRet = Read_PLR();
+    return Read_PLR(s);
+#else
+    return false;
 #endif
-        sRet = sRet + "|" + strRet;
-    }
-    return sRet;
 }
 
 #ifdef POWER_LOSS_SAVE_TO_SDCARD
@@ -757,86 +1153,21 @@ void CardReader::Write_PLR(uint32_t lFPos, int iTPos, int iTPos1, int iT01, floa
     if (!cardOK)
         return;
 
-    SdFile tf_file;
-    SdFile *parent = &root;
-    const char *tff = "PLR.TXT";
-
-    bool bFileExists = false;
-    if (tf_file.open(*parent, tff, O_READ))
-    {
-        bFileExists = true;
-        tf_file.close();
-    }
-
-    String sContent = "";
-    char cAll[150];
-    char cContent[15] = "";
-    char cLine[15];
-    const char *arrFileContentNew;
-
-    uint32_t lFPos0 = sdpos;
+    char cAll[64];
+    const char *arrFileContentNew = "0";
 
     if (lFPos > 2048 && sdprinting == 1)
     {
-
-        sContent.toCharArray(cContent, 12);
-        float fValue = 0.0;
-
-        ///////////// 0 = file Pos
-        sContent = lFPos0;
-        sContent.toCharArray(cContent, 12);
-        sprintf_P(cLine, PSTR("%s|"), cContent);
-        strcat(cAll, cLine);
-
-        ///////////// 1 = Temp0 Pos
-        sContent = iTPos;
-        sContent.toCharArray(cContent, 10);
-        sprintf_P(cLine, PSTR("%s|"), cContent);
-        strcat(cAll, cLine);
-
-        ///////////// 2 = Temp1 Pos
-        sContent = iTPos1;
-        sContent.toCharArray(cContent, 10);
-        sprintf_P(cLine, PSTR("%s|"), cContent);
-        strcat(cAll, cLine);
-
-        ///////////// 3 = T0T1
-        sContent = iT01;
-        sContent.toCharArray(cContent, 10);
-        sprintf_P(cLine, PSTR("%s|"), cContent);
-        strcat(cAll, cLine);
-
-        ///////////// 4 = Z Pos
-        fValue = fZPos;
-        dtostrf(fValue, 1, 2, cContent);
-        sprintf_P(cLine, PSTR("%s|"), cContent);
-        strcat(cAll, cLine);
-
-        ///////////// 5 = E Pos
-        fValue = fEPos;
-        dtostrf(fValue, 1, 2, cContent);
-        sprintf_P(cLine, PSTR("%s|"), cContent);
-        strcat(cAll, cLine);
+        //  file pos | Temp0 | Temp1 | T0T1 | Z | E |
+        char cZ[16];
+        char cE[16];
+        dtostrf(fZPos, 1, 2, cZ);
+        dtostrf(fEPos, 1, 2, cE);
+        snprintf_P(cAll, sizeof(cAll), PSTR("%lu|%d|%d|%d|%s|%s|"), (unsigned long)sdpos, iTPos, iTPos1, iT01, cZ, cE);
         arrFileContentNew = cAll;
     }
-    else
-    {
-        arrFileContentNew = "0";
-    }
 
-    uint8_t O_TF = O_CREAT | O_EXCL | O_WRITE;
-    if (bFileExists)
-        O_TF = O_WRITE | O_TRUNC;
-
-    if (tf_file.open(*parent, tff, O_TF))
-    {
-        tf_file.write(arrFileContentNew);
-        tf_file.close();
-    }
-    else
-    {
-        //TL_DEBUG_PRINT_LN(F("Write Value Err "));
-    }
+    write_text_file(root, "PLR.TXT", arrFileContentNew);
 }
 
 bool b_PRE_Write_PLR_Done = false;
@@ -845,170 +1176,54 @@ void CardReader::PRE_Write_PLR(uint32_t lFPos, int iBPos, int i_dual_x_carriage_
     if (!cardOK)
         return;
 
-    SdFile tf_file;
-    SdFile *parent = &root;
-    const char *tff = "PPLR.TXT";
-
-    bool bFileExists = false;
-    if (tf_file.open(*parent, tff, O_READ))
-    {
-        bFileExists = true;
-        tf_file.close();
-    }
-
-    String sContent = "";
-    char cAll[150];
-    char cContent[15];
-    char cLine[15];
-    const char *arrFileContentNew;
-
     if (lFPos > 2048 && sdprinting == 1 && !b_PRE_Write_PLR_Done)
     {
-
-        float fValue = 0.0;
-
-        ///////////// 0 = Bed Temp
-        sContent = iBPos;
-        sContent.toCharArray(cContent, 10);
-        sprintf_P(cLine, PSTR("%s|"), cContent);
-        strcat(cAll, cLine);
-
-        ///////////// 1 = dual_x_carriage_mode
-        sContent = dual_x_carriage_mode;
-        sContent.toCharArray(cContent, 10);
-        sprintf_P(cLine, PSTR("%s|"), cContent);
-        strcat(cAll, cLine);
-
-        ///////////////  2 = duplicate_extruder_x_offset
-        fValue = f_duplicate_extruder_x_offset;
-        dtostrf(fValue, 1, 2, cContent);
-        sprintf_P(cLine, PSTR("%s|"), cContent);
-        strcat(cAll, cLine);
-
-        ///////////// 3 = feedrate
-        fValue = f_feedrate;
-        dtostrf(fValue, 1, 2, cContent);
-        sprintf_P(cLine, PSTR("%s|"), cContent);
-        strcat(cAll, cLine);
-
-        arrFileContentNew = cAll;
-
-        uint8_t O_TF = O_CREAT | O_EXCL | O_WRITE;
-        if (bFileExists)
-            O_TF = O_WRITE | O_TRUNC;
-
-        if (tf_file.open(*parent, tff, O_TF))
-        {
-            tf_file.write(arrFileContentNew);
-            tf_file.close();
-        }
-        else
-        {
-            //TL_DEBUG_PRINT_LN(F("New Value Err "));
-        }
+        //  Bed Temp | dual_x_carriage_mode | duplicate_extruder_x_offset | feedrate |
+        char cAll[48];
+        char cOffset[16];
+        char cFeedrate[16];
+        dtostrf(f_duplicate_extruder_x_offset, 1, 2, cOffset);
+        dtostrf(f_feedrate, 1, 2, cFeedrate);
+        snprintf_P(cAll, sizeof(cAll), PSTR("%d|%d|%s|%s|"), iBPos, dual_x_carriage_mode, cOffset, cFeedrate);
+        write_text_file(root, "PPLR.TXT", cAll);
         b_PRE_Write_PLR_Done = true;
     }
 }
 
 uint32_t CardReader::Read_PLR_0()
 {
-    uint32_t lRet = 0;
-    if (!cardOK)
+    char buf[64];
+    if (!cardOK || !read_text_file(root, "PLR.TXT", buf, sizeof(buf)))
         return 0;
-
-    SdFile tf_file;
-    SdFile *parent = &root;
-    const char *tff = "PLR.TXT";
-
-   //Read File
-    if (tf_file.open(*parent, tff, O_READ))
-    {
-        int16_t fS = tf_file.fileSize() + 1;
-        char buf[255];
-        char dim1[] = "\n";
-        char *dim = dim1;
-        int16_t n = tf_file.fgets(buf, fS, dim);
-        String strFileContent = "";
-
-        for (int i = 0; i < fS; i++)
-        {
-            if (buf[i] != '\0')
-                strFileContent += buf[i];
-        }
-
-        if (strFileContent != "")
-        {
-            lRet = atol(const_cast<char *>(getSplitValue(strFileContent, '|', 0).c_str()));
-        }
-    }
-    
-    tf_file.close();
-    return lRet;
+    return atol(buf);
 }
 
-String CardReader::Read_PLR()
+bool CardReader::Read_PLR(PowerLossState &s)
 {
-    String sRet = "";
-    uint32_t lFP = 0;
-    if (!cardOK)
-        return "";
-
-    SdFile tf_file;
-    SdFile *parent = &root;
-    const char *tff = "PLR.TXT";
-String strFileContent = "";
-
-    //Read File
-    if (tf_file.open(*parent, tff, O_READ))
-    {
-        int16_t fS = tf_file.fileSize() + 1;
-        char buf[255];
-        char dim1[] = "\n";
-        char *dim = dim1;
-        int16_t n = tf_file.fgets(buf, fS, dim);
-
-        for (int i = 0; i < fS; i++)
-        {
-            if (buf[i] != '\0')
-                strFileContent += buf[i];
-        }
-
-        if (strFileContent != "")
-        {
-            lFP = atol(const_cast<char *>(getSplitValue(strFileContent, '|', 0).c_str()));
-        }
-    }
-    
-    tf_file.close();
-    if (lFP > 2048)
-    {
-        const char *tff = "PPLR.TXT";
-        String strFileContent1 = "";
-
-        //Read File
-        if (tf_file.open(*parent, tff, O_READ))
-        {
-            int16_t fS = tf_file.fileSize() + 1;
-            char buf[255];
-            char dim1[] = "\n";
-            char *dim = dim1;
-            int16_t n = tf_file.fgets(buf, fS, dim);
-
-            for (int i = 0; i < fS; i++)
-            {
-                if (buf[i] != '\0')
-                    strFileContent1 += buf[i];
-            }
-
-            if (strFileContent1 != "")
-            {
-                String sFC = strFileContent;
-                sRet = sFC + "255|0|0|" + strFileContent1;
-            }
-        }
-        tf_file.close();
-    }
-    return sRet;
+    char buf[64];
+    char *field[6];
+
+    if (!cardOK || !read_text_file(root, "PLR.TXT", buf, sizeof(buf)) || split_fields(buf, field, 6) < 6)
+        return false;
+    s.file_pos = atol(field[0]);
+    if (s.file_pos <= 2048)
+        return false;
+    s.temp0 = atoi(field[1]);
+    s.temp1 = atoi(field[2]);
+    s.active_extruder = atoi(field[3]);
+    s.z = atof(field[4]);
+    s.e = atof(field[5]);
+    s.fan = 255;
+    s.x = 0.0;
+    s.y = 0.0;
+
+    if (!read_text_file(root, "PPLR.TXT", buf, sizeof(buf)) || split_fields(buf, field, 4) < 4)
+        return false;
+    s.bed = atoi(field[0]);
+    s.dual_x_mode = atoi(field[1]);
+    s.dup_x_offset = atof(field[2]);
+    s.feedrate = atof(field[3]);
+    return true;
 }
 
 #endif //#ifdef POWER_LOSS_SAVE_TO_SDCARD
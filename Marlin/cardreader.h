@@ -6,12 +6,34 @@
 #define MAX_DIR_DEPTH 10
 
 #include "SdFile.h"
+
+#ifdef BINARY_GCODE
+#define BINARY_GCODE_MAGIC "TLB1"
+#define BINARY_GCODE_MOVE 0x01  // first char of a command buffer row with a move record, the record follows at [2]
+#define BINARY_GCODE_ASCII 0x80 // record type of a text command
+#endif
+
 enum LsAction
 {
 	LS_SerialPrint,
 	LS_Count,
 	LS_GetFilename
 };
+#ifdef JOB_LOG
+struct job_stats_t
+{
+	unsigned long heating_ms; // waiting in M109/M190
+	unsigned long starved_ms; // stepper without a block during the print
+	uint16_t toolchanges;
+	uint16_t pauses;
+	uint16_t runouts;
+	uint16_t resends;
+	uint16_t isr_ticks;  // the stepper interrupt that used the largest share of its step interval:
+	uint16_t isr_period; // its run time and that interval in timer ticks
+};
+extern job_stats_t job_stats;
+#endif
+
 class CardReader
 {
 public:
@@ -26,6 +48,9 @@ public:
 	void openFile(char *lngName, char *name, bool read, uint32_t startPos = 0); //By zyf
 	void openLogFile(char *name);
 	void removeFile(char *name);
+#ifdef SD_FAST_UPLOAD
+	void uploadFile(char *name, uint32_t size);
+#endif
 	void closefile();
 	void release();
 	void startFileprint();
@@ -69,19 +94,29 @@ public:
 	};
 
 #ifdef POWER_LOSS_RECOVERY
-	void writeLastFileName(String LFName, String Value);
+	void writeLastFileName(const char *LFName, const char *Value);
 
 #ifdef POWER_LOSS_SAVE_TO_SDCARD
 	void Write_PLR(uint32_t lFPos = 0, int iTPos = 0, int iTPos1 = 0, int iT01 = 0, float fZPos = 0.0, float fEPos = 0.0);
 	void PRE_Write_PLR(uint32_t lFPos = 0, int iBPos = 0, int i_dual_x_carriage_mode = 0, float f_duplicate_extruder_x_offset = 0.0, float f_feedrate = 0.0);
 	uint32_t Read_PLR_0();
-	String Read_PLR();
+	bool Read_PLR(PowerLossState &s);
+#endif
+
+	bool isPowerLoss(PowerLossState &s); // file names of an interrupted print, false if there is nothing to resume
+	bool get_PLR(PowerLossState &s);
 #endif
 
-	String getSplitValue(String data, char separator, int index);
+#ifdef BINARY_GCODE
+	bool getBinaryCommand(char *cmd); // next record of a binary file into a command buffer row, false if it is bad
+#endif
 
-	String isPowerLoss();
-	String get_PLR();
+#ifdef Z_LAYER_INDEX
+	void zindexStart(bool force = false); // record the layers of the selected file while it is read from the start
+	void zindexLine(const char *cmd, uint32_t pos); // every G-code line read from the file, pos = offset of the line
+	void zindexFinish(bool complete);
+	bool zindexSeek(float z); // seek to the first layer at or above z, false if there is no index
+	void zindexBuild(); // scan the selected file and write its index
 #endif
 
 public:
@@ -96,6 +131,17 @@ public:
 	int lastnr; //last number of the autostart;
 	uint32_t sdpos;
 	uint32_t filesize;
+#ifdef BINARY_GCODE
+	bool binary; // the open file is binary G-code, sdpos is always at a record
+#endif
+#ifdef PRINT_TIME_ESTIMATE
+	uint32_t timeEstimate; // seconds of moves in the whole file, from M1047 S
+	uint32_t timeStartPos; // file position the job was started from
+	long remainingTime(); // seconds, -1 while it is not known
+#endif
+#ifdef JOB_LOG
+	void writeJobLog(unsigned long ms); // append the finished job to JOBLOG.CSV
+#endif
 
 private:
 	SdFile root, *curDir, workDir, workDirParents[MAX_DIR_DEPTH];
@@ -106,11 +152,36 @@ private:
 	unsigned long autostart_atmillis;
 
 	bool autostart_stilltocheck; //the sd start is delayed, because otherwise the serial cannot answer fast enought to make contact with the hostsoftware.
+#ifdef JOB_LOG
+	char jobName[LONG_FILENAME_LENGTH];
+#endif
 
+#ifdef SD_DIR_INDEX_SIZE
+	uint16_t dirIndex[SD_DIR_INDEX_SIZE]; // first directory entry (long name included) of every file getnrfilenames() counted
+	uint16_t dirIndexCount; // valid entries of dirIndex for workDir
+#endif
 	LsAction lsAction; //stored for recursion.
 	int16_t nrFiles;   //counter for the files in the current directory and recycled as position counter for getting the nrFiles'th name in the directory.
 	char *diveDirName;
 	void lsDive(const char *prepend, SdFile parent);
+
+#ifdef Z_LAYER_INDEX
+	struct ZIndexEntry
+	{
+		float z;
+		uint32_t pos;
+	};
+	SdFile zindexDir, zindexFile; // directory of the selected file, its NAME.ZIX
+	char zindexName[13];
+	bool zindexRecording;
+	float zindexZ; // Z of the last G0/G1 with Z
+	uint32_t zindexZPos; // offset of that line
+	float zindexLayerZ; // last layer written to the index
+	uint32_t zindexLastPos;
+	uint8_t zindexCount; // entries in zindexBuf
+	ZIndexEntry zindexBuf[4];
+	void zindexFlush();
+#endif
 };
 extern CardReader card;
 #define IS_SD_PRINTING (card.sdprinting == 1)
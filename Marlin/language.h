@@ -143,6 +143,7 @@
 #define MSG_M104_INVALID_EXTRUDER "M104 Invalid extruder "
 #define MSG_M105_INVALID_EXTRUDER "M105 Invalid extruder "
 #define MSG_M218_INVALID_EXTRUDER "M218 Invalid extruder "
+#define MSG_M900_INVALID_EXTRUDER "M900 Invalid extruder "
 #define MSG_ERR_NO_THERMISTORS "No thermistors - no temperature"
 #define MSG_M109_INVALID_EXTRUDER "M109 Invalid extruder "
 #define MSG_HEATING "Heating..."
@@ -167,6 +168,7 @@
 #define MSG_ENDSTOP_HIT "TRIGGERED"
 #define MSG_ENDSTOP_OPEN "open"
 #define MSG_HOTEND_OFFSET "Hotend offsets:"
+#define MSG_ADVANCE_K "Advance K:"
 
 #define MSG_SD_CANT_OPEN_SUBDIR "Cannot open subdir"
 #define MSG_SD_INIT_FAIL "SD init fail"
@@ -183,6 +185,9 @@
 #define MSG_SD_NOT_PRINTING "Not SD printing"
 #define MSG_SD_ERR_WRITE_TO_FILE "error writing to file"
 #define MSG_SD_CANT_ENTER_SUBDIR "Cannot enter subdir: "
+#define MSG_SD_BINARY_ERROR "Bad binary G-code record at byte "
+#define MSG_SD_UPLOAD_FAIL "Upload failed at byte "
+#define MSG_SD_UPLOAD_DONE "Upload done, bytes: "
 
 #define MSG_STEPPER_TOO_HIGH "Steprate too high: "
 #define MSG_ENDSTOPS_HIT "endstops hit: "
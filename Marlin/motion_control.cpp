@@ -24,7 +24,7 @@
 #include "planner.h"
 
 // The arc is approximated by generating a huge number of tiny, linear segments. The length of each
-// segment is configured in settings.mm_per_arc_segment.
+// segment is MM_PER_ARC_SEGMENT, or set by ARC_MAX_DEVIATION and ARC_MIN_SEGMENT_TIME.
 void mc_arc(float *position, float *target, float *offset, uint8_t axis_0, uint8_t axis_1,
             uint8_t axis_linear, float feed_rate, float radius, uint8_t isclockwise, uint8_t extruder)
 {
@@ -55,7 +55,15 @@ void mc_arc(float *position, float *target, float *offset, uint8_t axis_0, uint8
   {
     return;
   }
+#ifdef ARC_MAX_DEVIATION
+  // Longest chord within ARC_MAX_DEVIATION of the arc: c = 2*sqrt(e*(2r-e))
+  float mm_per_arc_segment = (radius > ARC_MAX_DEVIATION) ? 2 * sqrt(ARC_MAX_DEVIATION * (2 * radius - ARC_MAX_DEVIATION)) : ARC_MAX_SEGMENT_MM;
+  mm_per_arc_segment = max(mm_per_arc_segment, feed_rate * (ARC_MIN_SEGMENT_TIME / 1000.0));
+  mm_per_arc_segment = constrain(mm_per_arc_segment, ARC_MIN_SEGMENT_MM, ARC_MAX_SEGMENT_MM);
+  uint16_t segments = ceil(millimeters_of_travel / mm_per_arc_segment); // chords never longer than the limit
+#else
   uint16_t segments = floor(millimeters_of_travel / MM_PER_ARC_SEGMENT);
+#endif
   if (segments == 0)
     segments = 1;
 
@@ -97,6 +105,14 @@ void mc_arc(float *position, float *target, float *offset, uint8_t axis_0, uint8
   // Vector rotation matrix values
   float cos_T = 1 - 0.5 * theta_per_segment * theta_per_segment; // Small angle approximation
   float sin_T = theta_per_segment;
+#ifdef ARC_MAX_DEVIATION
+  // long chords on large arcs are past the small angle approximation
+  if (fabs(theta_per_segment) > 0.05)
+  {
+    cos_T = cos(theta_per_segment);
+    sin_T = sin(theta_per_segment);
+  }
+#endif
 
   float arc_target[4];
   float sin_Ti;
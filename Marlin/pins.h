@@ -84,7 +84,9 @@
 #define PS_ON_PIN 40 //zyf 40		//PF1
 
 #if defined(POWER_LOSS_RECOVERY)
-	#ifdef HAS_PLR_MODULE
+	#if defined(HAS_PLR_MODULE) && defined(POWER_LOSS_DETECT_BY_INTERRUPT)
+		#define POWER_LOSS_DETECT_PIN POWER_LOSS_DETECT_INT_PIN
+	#elif defined(HAS_PLR_MODULE)
 		#define POWER_LOSS_DETECT_PIN 32 //zyf 32		//PF2
 	#else
 		#define POWER_LOSS_DETECT_PIN 32
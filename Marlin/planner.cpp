@@ -109,8 +109,8 @@ int languageID = 0;
 int tl_SLEEP_TIME = 0;
 int iTempErrID = 0;
 int tl_ECO_MODE = 0;
-String sTempErrMsg = "";
-String sShortErrMsg = "";
+char sTempErrMsg[32] = "";
+char sShortErrMsg[16] = "";
 
 int dwnMessageID = -1;
 long lLEDTimeTimecount = 0;
@@ -138,10 +138,16 @@ float max_e_jerk;
 float mintravelfeedrate;
 unsigned long axis_steps_per_sqr_second[NUM_AXIS];
 
+#ifdef LIN_ADVANCE
+float extruder_advance_k[EXTRUDERS];
+#endif
+
 // The current position of the tool in absolute steps
 long position[4];                    //rescaled from extern when axis_steps_per_unit are changed by gcode
 static float previous_speed[4];      // Speed of previous path line segment
 static float previous_nominal_speed; // Nominal speed of previous path line segment
+static float mm_per_step[4];         // 1/axis_steps_per_unit, so plan_buffer_line() multiplies instead of divides
+static float mm_per_step_of[4];      // axis_steps_per_unit mm_per_step[] was taken from (M92 and the screen change them)
 
 #ifdef AUTOTEMP
 float autotemp_max = 250;
@@ -231,6 +237,30 @@ FORCE_INLINE float intersection_distance(float initial_rate, float final_rate, f
   }
 }
 
+#ifdef S_CURVE_ACCELERATION
+// Converts the length of a Bezier ramp in stepper timer ticks into the scale the stepper interrupt
+// uses to get t in 1/65536 with 16 bit multiplies. Ramps too short or too long for that stay trapezoids.
+static void calculate_bezier_ramp(float ticks, unsigned long &ramp_ticks, unsigned short &inv, unsigned char &shift)
+{
+  if (ticks < 128 || ticks > 16777215.0)
+  {
+    ramp_ticks = 0;
+    inv = 0;
+    shift = 0;
+    return;
+  }
+  ramp_ticks = (unsigned long)ticks;
+  unsigned long n = ramp_ticks << 8;
+  shift = 0;
+  while (n > 65535)
+  {
+    n >>= 1;
+    shift++;
+  }
+  inv = min(65535UL, 0x7FFFFFFFUL / n);
+}
+#endif
+
 // Calculates trapezoid parameters so that the entry- and exit-speed is compensated by the provided factors.
 
 void calculate_trapezoid_for_block(block_t *block, float entry_factor, float exit_factor)
@@ -268,6 +298,29 @@ void calculate_trapezoid_for_block(block_t *block, float entry_factor, float exi
     plateau_steps = 0;
   }
 
+#if defined(S_CURVE_ACCELERATION) || defined(PRINT_TIME_ESTIMATE)
+  // Rate at the end of the acceleration. The Bezier ramps cover the same steps in the same time as the trapezoid ramps
+  unsigned long cruise_rate = block->nominal_rate;
+  if (plateau_steps == 0)
+    cruise_rate = min(cruise_rate, (unsigned long)sqrt((float)initial_rate * initial_rate + 2.0 * acceleration * accelerate_steps));
+#endif
+#ifdef S_CURVE_ACCELERATION
+  unsigned long accel_ticks, decel_ticks;
+  unsigned short accel_inv, decel_inv;
+  unsigned char accel_shift, decel_shift;
+  float ticks_per_rate = (F_CPU / 8.0) / acceleration;
+  calculate_bezier_ramp((cruise_rate > initial_rate) ? (cruise_rate - initial_rate) * ticks_per_rate : 0, accel_ticks, accel_inv, accel_shift);
+  calculate_bezier_ramp((cruise_rate > final_rate) ? (cruise_rate - final_rate) * ticks_per_rate : 0, decel_ticks, decel_inv, decel_shift);
+#endif
+#ifdef PRINT_TIME_ESTIMATE
+  float duration = (float)plateau_steps / block->nominal_rate;
+  if (cruise_rate > initial_rate)
+    duration += (float)(cruise_rate - initial_rate) / acceleration;
+  if (cruise_rate > final_rate)
+    duration += (float)(cruise_rate - final_rate) / acceleration;
+  unsigned long duration_us = duration * 1000000.0;
+#endif
+
   // block->accelerate_until = accelerate_steps;
   // block->decelerate_after = accelerate_steps+plateau_steps;
   CRITICAL_SECTION_START; // Fill variables used by the stepper in a critical section
@@ -277,6 +330,18 @@ void calculate_trapezoid_for_block(block_t *block, float entry_factor, float exi
     block->decelerate_after = accelerate_steps + plateau_steps;
     block->initial_rate = initial_rate;
     block->final_rate = final_rate;
+#ifdef S_CURVE_ACCELERATION
+    block->cruise_rate = cruise_rate;
+    block->accel_ticks = accel_ticks;
+    block->accel_inv = accel_inv;
+    block->accel_shift = accel_shift;
+    block->decel_ticks = decel_ticks;
+    block->decel_inv = decel_inv;
+    block->decel_shift = decel_shift;
+#endif
+#ifdef PRINT_TIME_ESTIMATE
+    block->duration_us = duration_us;
+#endif
   }
   CRITICAL_SECTION_END;
 }
@@ -666,12 +731,31 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
   //Searching the height point by "dichotomy" -- by zyf
   if (!PrintFromZHeightFound && card.sdprinting == 1)
   {
+#ifdef BINARY_GCODE
+    if (card.binary)
+    { // records can not be bisected, the file is read on up to the height
+      if (z < print_from_z_target - 0.001)
+        return;
+      lPrintZStart = 1;
+      lPrintZEnd = 1;
+    }
+#endif
     if ((z != print_from_z_target && lPrintZEnd - lPrintZStart > 1024) || lPrintZEnd == 0)
     {
       //Seaching ....
       bool bSetIndex = true;
       if (lPrintZEnd == 0)
       {
+#ifdef Z_LAYER_INDEX
+        if (card.zindexSeek(print_from_z_target))
+        { // the next move read is the first one of the layer
+          discard_queued_commands();
+          lPrintZStart = card.sdpos;
+          lPrintZEnd = card.sdpos;
+          zLast = 0.0;
+          return;
+        }
+#endif
         lPrintZEnd = card.filesize - 1;
       }
       else if (z == zLast || z == 0)
@@ -732,11 +816,17 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
 
   // If the buffer is full: good! That means we are well ahead of the robot.
   // Rest here until there is room in the buffer.
-  while (block_buffer_tail == next_buffer_head)
+  // Only an actual wait is profiled, so "planner full" counts waits for a free block
+  if (block_buffer_tail == next_buffer_head)
   {
-    manage_heater();
-    manage_inactivity();
-    tenlog_status_screen();
+    PROFILE_BEGIN(profile_t);
+    while (block_buffer_tail == next_buffer_head)
+    {
+      manage_heater();
+      manage_inactivity();
+      tenlog_status_screen();
+    }
+    PROFILE_END(PROFILE_PLANNER_FULL, profile_t);
   }
 
   // The target position of the tool in absolute steps
@@ -748,6 +838,15 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
   target[Z_AXIS] = lround(z * axis_steps_per_unit[Z_AXIS]);
   target[E_AXIS] = lround(e * axis_steps_per_unit[E_AXIS]);
 
+  for (int8_t i = 0; i < NUM_AXIS; i++)
+  {
+    if (mm_per_step_of[i] != axis_steps_per_unit[i])
+    {
+      mm_per_step_of[i] = axis_steps_per_unit[i];
+      mm_per_step[i] = 1.0 / axis_steps_per_unit[i];
+    }
+  }
+
 #ifdef PREVENT_DANGEROUS_EXTRUDE
   if (target[E_AXIS] != position[E_AXIS])
   {
@@ -776,13 +875,18 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
   block->busy = false;
 
   // Number of steps for each axis
+  long delta_steps[4];
+  delta_steps[X_AXIS] = target[X_AXIS] - position[X_AXIS];
+  delta_steps[Y_AXIS] = target[Y_AXIS] - position[Y_AXIS];
+  delta_steps[Z_AXIS] = target[Z_AXIS] - position[Z_AXIS];
+  delta_steps[E_AXIS] = target[E_AXIS] - position[E_AXIS];
 
   // default non-h-bot planning
-  block->steps_x = labs(target[X_AXIS] - position[X_AXIS]);
-  block->steps_y = labs(target[Y_AXIS] - position[Y_AXIS]);
+  block->steps_x = labs(delta_steps[X_AXIS]);
+  block->steps_y = labs(delta_steps[Y_AXIS]);
 
-  block->steps_z = labs(target[Z_AXIS] - position[Z_AXIS]);
-  block->steps_e = labs(target[E_AXIS] - position[E_AXIS]);
+  block->steps_z = labs(delta_steps[Z_AXIS]);
+  block->steps_e = labs(delta_steps[E_AXIS]);
   block->steps_e *= extrudemultiply;
   block->steps_e /= 100;
   block->step_event_count = max(block->steps_x, max(block->steps_y, max(block->steps_z, block->steps_e)));
@@ -801,20 +905,20 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
 
   // Compute direction bits for this block
   block->direction_bits = 0;
-  if (target[X_AXIS] < position[X_AXIS])
+  if (delta_steps[X_AXIS] < 0)
   {
     block->direction_bits |= (1 << X_AXIS);
   }
-  if (target[Y_AXIS] < position[Y_AXIS])
+  if (delta_steps[Y_AXIS] < 0)
   {
     block->direction_bits |= (1 << Y_AXIS);
   }
 
-  if (target[Z_AXIS] < position[Z_AXIS])
+  if (delta_steps[Z_AXIS] < 0)
   {
     block->direction_bits |= (1 << Z_AXIS);
   }
-  if (target[E_AXIS] < position[E_AXIS])
+  if (delta_steps[E_AXIS] < 0)
   {
     block->direction_bits |= (1 << E_AXIS);
   }
@@ -868,10 +972,10 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
   }
 
   float delta_mm[4];
-  delta_mm[X_AXIS] = (target[X_AXIS] - position[X_AXIS]) / axis_steps_per_unit[X_AXIS];
-  delta_mm[Y_AXIS] = (target[Y_AXIS] - position[Y_AXIS]) / axis_steps_per_unit[Y_AXIS];
-  delta_mm[Z_AXIS] = (target[Z_AXIS] - position[Z_AXIS]) / axis_steps_per_unit[Z_AXIS];
-  delta_mm[E_AXIS] = ((target[E_AXIS] - position[E_AXIS]) / axis_steps_per_unit[E_AXIS]) * extrudemultiply / 100.0;
+  delta_mm[X_AXIS] = delta_steps[X_AXIS] * mm_per_step[X_AXIS];
+  delta_mm[Y_AXIS] = delta_steps[Y_AXIS] * mm_per_step[Y_AXIS];
+  delta_mm[Z_AXIS] = delta_steps[Z_AXIS] * mm_per_step[Z_AXIS];
+  delta_mm[E_AXIS] = delta_steps[E_AXIS] * mm_per_step[E_AXIS] * (extrudemultiply * 0.01);
   if (block->steps_x <= dropsegments && block->steps_y <= dropsegments && block->steps_z <= dropsegments)
   {
     block->millimeters = fabs(delta_mm[E_AXIS]);
@@ -890,7 +994,12 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
   // slow down when de buffer starts to empty, rather than wait at the corner for a buffer refill
 #ifdef OLD_SLOWDOWN
   if (moves_queued < (BLOCK_BUFFER_SIZE * 0.5) && moves_queued > 1)
+  {
     feed_rate = feed_rate * moves_queued / (BLOCK_BUFFER_SIZE * 0.5);
+#ifdef PLANNER_STATS
+    planner_stats.slowdowns++;
+#endif
+  }
 #endif
 
 #ifdef SLOWDOWN
@@ -901,6 +1010,9 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
     if (segment_time < minsegmenttime)
     { // buffer is draining, add extra time.  The amount of time added increases if the buffer is still emptied more.
       inverse_second = 1000000.0 / (segment_time + lround(2 * (minsegmenttime - segment_time) / moves_queued));
+#ifdef PLANNER_STATS
+      planner_stats.slowdowns++;
+#endif
 #ifdef XY_FREQUENCY_LIMIT
       segment_time = lround(1000000.0 / inverse_second);
 #endif
@@ -969,7 +1081,7 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
   }
 
   // Compute and limit the acceleration rate for the trapezoid generator.
-  float steps_per_mm = block->step_event_count / block->millimeters;
+  float steps_per_mm = block->step_event_count * inverse_millimeters;
   if (block->steps_x == 0 && block->steps_y == 0 && block->steps_z == 0)
   {
     block->acceleration_st = ceil(retract_acceleration * steps_per_mm); // convert to: acceleration steps/sec^2
@@ -977,19 +1089,33 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
   else
   {
     block->acceleration_st = ceil(acceleration * steps_per_mm); // convert to: acceleration steps/sec^2
-    // Limit acceleration per axis
-    if (((float)block->acceleration_st * (float)block->steps_x / (float)block->step_event_count) > axis_steps_per_sqr_second[X_AXIS])
+    // Limit acceleration per axis, acceleration_st * steps / step_event_count > limit without the divides
+    float event_count = (float)block->step_event_count;
+    if ((float)block->acceleration_st * (float)block->steps_x > axis_steps_per_sqr_second[X_AXIS] * event_count)
       block->acceleration_st = axis_steps_per_sqr_second[X_AXIS];
-    if (((float)block->acceleration_st * (float)block->steps_y / (float)block->step_event_count) > axis_steps_per_sqr_second[Y_AXIS])
+    if ((float)block->acceleration_st * (float)block->steps_y > axis_steps_per_sqr_second[Y_AXIS] * event_count)
       block->acceleration_st = axis_steps_per_sqr_second[Y_AXIS];
-    if (((float)block->acceleration_st * (float)block->steps_e / (float)block->step_event_count) > axis_steps_per_sqr_second[E_AXIS])
+    if ((float)block->acceleration_st * (float)block->steps_e > axis_steps_per_sqr_second[E_AXIS] * event_count)
       block->acceleration_st = axis_steps_per_sqr_second[E_AXIS];
-    if (((float)block->acceleration_st * (float)block->steps_z / (float)block->step_event_count) > axis_steps_per_sqr_second[Z_AXIS])
+    if ((float)block->acceleration_st * (float)block->steps_z > axis_steps_per_sqr_second[Z_AXIS] * event_count)
       block->acceleration_st = axis_steps_per_sqr_second[Z_AXIS];
   }
   block->acceleration = block->acceleration_st / steps_per_mm;
   block->acceleration_rate = (long)((float)block->acceleration_st * (16777216.0 / (F_CPU / 8.0)));
 
+#ifdef LIN_ADVANCE
+  // Extra E steps the stepper keeps ahead are advance_rate * step_rate / 65536 (K * E steps/sec).
+  // Only printing moves get an advance; retracts, E only moves and travels let it run out again.
+  block->advance_rate = 0;
+  float advance_k = extruder_advance_k[extruder];
+  if (advance_k > 0 && block->steps_e != 0 && (block->direction_bits & (1 << E_AXIS)) == 0 &&
+      (block->steps_x != 0 || block->steps_y != 0))
+  {
+    float advance_rate = advance_k * (float)block->steps_e / (float)block->step_event_count * 65536.0;
+    block->advance_rate = (advance_rate > 65535.0) ? 65535 : lround(advance_rate);
+  }
+#endif
+
 #if 0 // Use old jerk for now
   // Compute path unit vector
   double unit_vec[3];
@@ -1042,13 +1168,14 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
 
   if ((moves_queued > 1) && (previous_nominal_speed > 0.0001))
   {
-    float jerk = sqrt(pow((current_speed[X_AXIS] - previous_speed[X_AXIS]), 2) + pow((current_speed[Y_AXIS] - previous_speed[Y_AXIS]), 2));
+    // Squared, so the sqrt is only taken when the jerk is over the limit
+    float jerk_sq = square(current_speed[X_AXIS] - previous_speed[X_AXIS]) + square(current_speed[Y_AXIS] - previous_speed[Y_AXIS]);
     //    if((fabs(previous_speed[X_AXIS]) > 0.0001) || (fabs(previous_speed[Y_AXIS]) > 0.0001)) {
     vmax_junction = block->nominal_speed;
     //    }
-    if (jerk > max_xy_jerk)
+    if (jerk_sq > square(max_xy_jerk))
     {
-      vmax_junction_factor = (max_xy_jerk / jerk);
+      vmax_junction_factor = (max_xy_jerk / sqrt(jerk_sq));
     }
     if (fabs(current_speed[Z_AXIS] - previous_speed[Z_AXIS]) > max_z_jerk)
     {
@@ -1116,6 +1243,24 @@ void plan_set_position(const float &x, const float &y, const float &z, const flo
   previous_speed[3] = 0.0;
 }
 
+#ifdef TOOLCHANGE_PIPELINED
+// Like plan_set_position(), but the blocks already in the buffer finish in the old coordinates and the
+// stepper takes the new position when it gets to the next block planned. Used for the tool change offsets.
+void plan_set_position_queued(const float &x, const float &y, const float &z, const float &e)
+{
+  position[X_AXIS] = lround(x * axis_steps_per_unit[X_AXIS]);
+  position[Y_AXIS] = lround(y * axis_steps_per_unit[Y_AXIS]);
+  position[Z_AXIS] = lround(z * axis_steps_per_unit[Z_AXIS]);
+  position[E_AXIS] = lround(e * axis_steps_per_unit[E_AXIS]);
+  st_queue_position(position[X_AXIS], position[Y_AXIS], position[Z_AXIS], position[E_AXIS], block_buffer_head);
+  previous_nominal_speed = 0.0; // The X carriage changes, so the junction is planned as a start from rest.
+  previous_speed[0] = 0.0;
+  previous_speed[1] = 0.0;
+  previous_speed[2] = 0.0;
+  previous_speed[3] = 0.0;
+}
+#endif
+
 void plan_set_e_position(const float &e)
 {
   position[E_AXIS] = lround(e * axis_steps_per_unit[E_AXIS]);
@@ -1127,6 +1272,56 @@ uint8_t movesplanned()
   return (block_buffer_head - block_buffer_tail + BLOCK_BUFFER_SIZE) & (BLOCK_BUFFER_SIZE - 1);
 }
 
+#ifdef PLANNER_STATS
+planner_stats_t planner_stats;
+
+// M1045
+void plan_report_stats(bool reset)
+{
+  planner_stats_t s;
+  CRITICAL_SECTION_START;
+  s = planner_stats;
+  if (reset)
+    memset(&planner_stats, 0, sizeof(planner_stats));
+  CRITICAL_SECTION_END;
+
+  SERIAL_ECHO_START;
+  SERIAL_ECHOPGM("Blocks queued when one finished:");
+  for (uint8_t i = 0; i < BLOCK_BUFFER_SIZE; i++)
+  {
+    SERIAL_ECHOPAIR(" ", (unsigned long)i);
+    SERIAL_ECHOPAIR(":", s.fill[i]);
+  }
+  SERIAL_ECHOLN("");
+  SERIAL_ECHO_START;
+  SERIAL_ECHOPAIR("Slowdowns:", s.slowdowns);
+  SERIAL_ECHOPAIR(" starved:", s.starved);
+  SERIAL_ECHOPAIR(" starved ms:", s.starved_ms);
+  SERIAL_ECHOLN("");
+}
+#endif //PLANNER_STATS
+
+#ifdef PRINT_TIME_ESTIMATE
+planner_time_t planner_time;
+
+unsigned long plan_move_seconds()
+{
+  unsigned long seconds;
+  CRITICAL_SECTION_START;
+  seconds = planner_time.seconds;
+  CRITICAL_SECTION_END;
+  return seconds;
+}
+
+void plan_reset_time()
+{
+  CRITICAL_SECTION_START;
+  planner_time.seconds = 0;
+  planner_time.us = 0;
+  CRITICAL_SECTION_END;
+}
+#endif //PRINT_TIME_ESTIMATE
+
 #ifdef PREVENT_DANGEROUS_EXTRUDE
 void set_extrude_min_temp(float temp)
 {
@@ -57,9 +57,22 @@ typedef struct
   unsigned long final_rate;      // The minimal rate at exit
   unsigned long acceleration_st; // acceleration steps/sec^2
   unsigned long fan_speed;
+#ifdef S_CURVE_ACCELERATION
+  unsigned long cruise_rate;     // The step rate at the end of the acceleration
+  unsigned long accel_ticks;     // Length of the acceleration in timer ticks, 0 uses the trapezoid
+  unsigned long decel_ticks;     // Length of the deceleration in timer ticks, 0 uses the trapezoid
+  unsigned short accel_inv, decel_inv;    // 2^31 / (ticks << 8 >> shift)
+  unsigned char accel_shift, decel_shift; // Scales ticks << 8 into 16 bits
+#endif
+#ifdef LIN_ADVANCE
+  unsigned long advance_rate;    // K*steps_e/step_event_count, advance steps per step_events/sec in 1/65536
+#endif
 #ifdef BARICUDA
   unsigned long valve_pressure;
   unsigned long e_to_p_pressure;
+#endif
+#ifdef PRINT_TIME_ESTIMATE
+  unsigned long duration_us;     // Time the trapezoid takes
 #endif
   volatile char busy;
 
@@ -75,6 +88,10 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
 // Set position. Used for G92 instructions.
 void plan_set_position(const float &x, const float &y, const float &z, const float &e);
 void plan_set_e_position(const float &e);
+#ifdef TOOLCHANGE_PIPELINED
+// Set position once the blocks in the buffer are done, without waiting for them. Used for tool changes.
+void plan_set_position_queued(const float &x, const float &y, const float &z, const float &e);
+#endif
 
 void check_axes_activity();
 uint8_t movesplanned(); //return the nr of buffered moves
@@ -123,8 +140,8 @@ extern int tl_TouchScreenType;
 extern int languageID;
 extern int tl_SLEEP_TIME;
 extern int iTempErrID;
-extern String sTempErrMsg;
-extern String sShortErrMsg;
+extern char sTempErrMsg[32];  // "E2 Heating Error :2" and the like
+extern char sShortErrMsg[16];
 extern int tl_ECO_MODE;
 
 //only for dwn screen
@@ -152,6 +169,10 @@ extern float max_e_jerk;
 extern float mintravelfeedrate;
 extern unsigned long axis_steps_per_sqr_second[NUM_AXIS];
 
+#ifdef LIN_ADVANCE
+extern float extruder_advance_k[EXTRUDERS]; // Use M900 to override by software
+#endif
+
 #ifdef AUTOTEMP
 extern bool autotemp_enabled;
 extern float autotemp_max;
@@ -162,13 +183,48 @@ extern float autotemp_factor;
 extern block_t block_buffer[BLOCK_BUFFER_SIZE];  // A ring buffer for motion instfructions
 extern volatile unsigned char block_buffer_head; // Index of the next block to be pushed
 extern volatile unsigned char block_buffer_tail;
+
+#ifdef PLANNER_STATS
+struct planner_stats_t
+{
+  unsigned long fill[BLOCK_BUFFER_SIZE]; // blocks still queued when one was finished, [0] = the buffer ran empty
+  unsigned long slowdowns;               // moves SLOWDOWN made longer
+  unsigned long starved;                 // times the stepper ran out of blocks during an SD print
+  unsigned long starved_ms;              // and how long it waited for the next one
+};
+extern planner_stats_t planner_stats;
+void plan_report_stats(bool reset);
+#endif
+
+#ifdef PRINT_TIME_ESTIMATE
+struct planner_time_t
+{
+  unsigned long seconds; // time of the blocks the stepper finished
+  unsigned long us;      // and the part of it below one second
+};
+extern planner_time_t planner_time;
+unsigned long plan_move_seconds();
+void plan_reset_time();
+#endif
+
 // Called when the current block is no longer needed. Discards the block and makes the memory
 // availible for new blocks.
 FORCE_INLINE void plan_discard_current_block()
 {
   if (block_buffer_head != block_buffer_tail)
   {
+#ifdef PRINT_TIME_ESTIMATE
+    planner_time.us += block_buffer[block_buffer_tail].duration_us;
+    while (planner_time.us >= 1000000)
+    {
+      planner_time.us -= 1000000;
+      planner_time.seconds++;
+    }
+#endif
     block_buffer_tail = (block_buffer_tail + 1) & (BLOCK_BUFFER_SIZE - 1);
+#ifdef PLANNER_STATS
+    planner_stats.fill[(block_buffer_head - block_buffer_tail) & (BLOCK_BUFFER_SIZE - 1)]++;
+#endif
   }
 }
 
@@ -53,9 +53,56 @@ volatile static unsigned long step_events_completed; // The number of step event
 static long acceleration_time, deceleration_time;
 //static unsigned long accelerate_until, decelerate_after, acceleration_rate, initial_rate, final_rate, nominal_rate;
 static unsigned short acc_step_rate; // needed for deccelaration start point
+#ifdef S_CURVE_ACCELERATION
+static unsigned short dec_step_rate; // last rate of the Bezier deceleration
+#endif
 static char step_loops;
 static unsigned short OCR1A_nominal;
 static unsigned short step_loops_nominal;
+#if defined(PLANNER_STATS) || defined(JOB_LOG)
+static bool had_block = false;
+static unsigned long starved_since = 0; // millis() | 1 when the blocks ran out during an SD print
+#endif
+#ifdef STEP_TIMER_FRACTION_BITS
+static unsigned char timer_fraction;         // 1/2^STEP_TIMER_FRACTION_BITS ticks calc_timer() dropped
+static unsigned char timer_fraction_nominal;
+static unsigned char timer_remainder;        // dropped fractions not yet added to a period
+#endif
+#ifdef DUAL_X_CARRIAGE
+// X and E drivers the current block steps. Resolved from extruder_carriage_mode and the block's extruder
+// when the block starts, so the step and direction code only tests bits.
+#define X_DRIVER 1
+#define X2_DRIVER 2
+#define X2_DIR_REVERSED 4                 // mirror mode
+static unsigned char x_drivers;           // X_DRIVER | X2_DRIVER | X2_DIR_REVERSED
+static unsigned char e_drivers;           // bit 0 = E0, bit 1 = E1, used by WRITE_E_STEP/NORM_E_DIR/REV_E_DIR
+#endif
+#ifdef LIN_ADVANCE
+static long e_adv_steps; // E steps currently pushed ahead of the planned E position
+#endif
+#ifdef TOOLCHANGE_PIPELINED
+static volatile unsigned char queued_position_block = 0xFF; // block that starts at queued_position[], 0xFF = none
+static long queued_position[NUM_AXIS];
+#endif
+#ifdef HOMING_XY_TOGETHER
+static volatile bool homing_together = false; // endstops stop only their own axis / X carriage, see st_home_together()
+#endif
+#ifdef INPUT_SHAPING
+#define SHAPING_HISTORY 64       // X/Y positions kept for the shaper, power of 2
+#define SHAPING_SAMPLE_SHIFT 11  // one position every 2048 timer ticks (1.024ms)
+static unsigned long shaping_clock;                // timer ticks executed, wraps
+static unsigned long shaping_sample;               // index of the next position sample
+static short shaping_history[2][SHAPING_HISTORY];  // low 16 bits of count_position[X/Y] per sample
+static long shaping_position[2];                   // position the X/Y drivers are at
+static unsigned long shaping_delay[2][2];          // delay of the 2nd and 3rd impulse in timer ticks
+static unsigned short shaping_amp[2][2];           // amplitude of the 2nd and 3rd impulse in 1/32768
+#ifdef DUAL_X_CARRIAGE
+static unsigned char shaping_x_drivers;            // x_drivers of the last X block
+#endif
+static unsigned long shaping_moved;                // shaping_clock of the last sample that changed
+float shaping_frequency[2];
+float shaping_zeta[2];
+#endif
 
 volatile long endstops_trigsteps[3] = {0, 0, 0};
 volatile long endstops_stepsTotal, endstops_stepsDone;
@@ -230,6 +277,15 @@ void enable_endstops(bool check, int Axis)
   }
 }
 
+#ifdef HOMING_XY_TOGETHER
+// While on, an endstop hit stops only the axis (or X carriage) it belongs to and the block goes on until
+// every axis of it stopped. Turn on for moves towards the endstops only.
+void st_home_together(bool on)
+{
+  homing_together = on;
+}
+#endif
+
 //         __________________________
 //        /|                        |\     _________________         ^
 //       / |                        | \   /|               |\        |
@@ -252,6 +308,16 @@ void st_wake_up()
   ENABLE_STEPPER_DRIVER_INTERRUPT();
 }
 
+#if defined(PLANNER_STATS) || defined(JOB_LOG)
+void st_reset_starved()
+{
+  CRITICAL_SECTION_START;
+  starved_since = 0;
+  had_block = false;
+  CRITICAL_SECTION_END;
+}
+#endif
+
 void step_wait()
 {
   for (int8_t i = 0; i < 6; i++)
@@ -259,19 +325,68 @@ void step_wait()
   }
 }
 
+#ifdef DUAL_X_CARRIAGE
+FORCE_INLINE void set_block_drivers()
+{
+  if (extruder_carriage_mode == 2 || extruder_carriage_mode == 3)
+  {
+    x_drivers = X_DRIVER | X2_DRIVER;
+    if (extruder_carriage_mode == 3)
+      x_drivers |= X2_DIR_REVERSED;
+    e_drivers = 3;
+  }
+  else
+  {
+#ifdef MIX_COLOR_TEST
+    x_drivers = X_DRIVER;
+#else
+    if (current_block->active_extruder == 1)
+      x_drivers = X2_DRIVER;
+    else if (current_block->active_extruder == 0)
+      x_drivers = X_DRIVER;
+    else
+      x_drivers = 0;
+#endif
+    e_drivers = (current_block->active_extruder == 1) ? 2 : 1;
+  }
+}
+
+FORCE_INLINE void write_x_dir(unsigned char drivers, bool dir)
+{
+  if (drivers & X_DRIVER)
+    WRITE(X_DIR_PIN, dir);
+  if (drivers & X2_DRIVER)
+    WRITE(X2_DIR_PIN, (drivers & X2_DIR_REVERSED) ? !dir : dir);
+}
+
+FORCE_INLINE void write_x_step(unsigned char drivers, bool v)
+{
+  if (drivers & X_DRIVER)
+    WRITE(X_STEP_PIN, v);
+  if (drivers & X2_DRIVER)
+    WRITE(X2_STEP_PIN, v);
+}
+#endif
+
+#if MAX_STEP_FREQUENCY > 4 * DOUBLE_STEP_FREQUENCY
+#error MAX_STEP_FREQUENCY must not be above 4 * DOUBLE_STEP_FREQUENCY
+#endif
+// Shortest timer period, half the period of the highest rate calc_timer() steps once per interrupt for
+#define MIN_STEP_TIMER ((F_CPU / 16) / DOUBLE_STEP_FREQUENCY)
+
 FORCE_INLINE unsigned short calc_timer(unsigned short step_rate)
 {
   unsigned short timer;
   if (step_rate > MAX_STEP_FREQUENCY)
     step_rate = MAX_STEP_FREQUENCY;
 
-  if (step_rate > 20000)
-  { // If steprate > 20kHz >> step 4 times
+  if (step_rate > 2 * DOUBLE_STEP_FREQUENCY)
+  { // If steprate > 2 * DOUBLE_STEP_FREQUENCY >> step 4 times
     step_rate = (step_rate >> 2) & 0x3fff;
     step_loops = 4;
   }
-  else if (step_rate > 10000)
-  { // If steprate > 10kHz >> step 2 times
+  else if (step_rate > DOUBLE_STEP_FREQUENCY)
+  { // If steprate > DOUBLE_STEP_FREQUENCY >> step 2 times
     step_rate = (step_rate >> 1) & 0x7fff;
     step_loops = 2;
   }
@@ -285,11 +400,15 @@ FORCE_INLINE unsigned short calc_timer(unsigned short step_rate)
   step_rate -= (F_CPU / 500000); // Correct for minimal speed
   if (step_rate >= (8 * 256))
   { // higher step rate
-    unsigned short table_address = (unsigned short)&speed_lookuptable_fast[(unsigned char)(step_rate >> 8)][0];
-    unsigned char tmp_step_rate = (step_rate & 0x00ff);
+    unsigned short table_address = (unsigned short)&speed_lookuptable_fast[(step_rate - 8 * 256) >> SPEED_TABLE_SHIFT][0];
+    unsigned char tmp_step_rate = (step_rate & ((1 << SPEED_TABLE_SHIFT) - 1)) << (8 - SPEED_TABLE_SHIFT);
     unsigned short gain = (unsigned short)pgm_read_word_near(table_address + 2);
     MultiU16X8toH16(timer, tmp_step_rate, gain);
     timer = (unsigned short)pgm_read_word_near(table_address) - timer;
+#ifdef STEP_TIMER_FRACTION_BITS
+    timer_fraction = timer & ((1 << STEP_TIMER_FRACTION_BITS) - 1);
+    timer >>= STEP_TIMER_FRACTION_BITS;
+#endif
   }
   else
   { // lower step rates
@@ -297,16 +416,327 @@ FORCE_INLINE unsigned short calc_timer(unsigned short step_rate)
     table_address += ((step_rate) >> 1) & 0xfffc;
     timer = (unsigned short)pgm_read_word_near(table_address);
     timer -= (((unsigned short)pgm_read_word_near(table_address + 2) * (unsigned char)(step_rate & 0x0007)) >> 3);
+#ifdef STEP_TIMER_FRACTION_BITS
+    timer_fraction = 0;
+#endif
   }
-  if (timer < 100)
+  if (timer < MIN_STEP_TIMER)
   {
-    timer = 100;
+    timer = MIN_STEP_TIMER;
     MYSERIAL.print(MSG_STEPPER_TOO_HIGH);
     MYSERIAL.println(step_rate);
-  } //(20kHz this should never happen)
+  } //(never happens with MAX_STEP_FREQUENCY <= 4 * DOUBLE_STEP_FREQUENCY)
   return timer;
 }
 
+#ifdef STEP_TIMER_FRACTION_BITS
+// One tick more whenever the tick fractions calc_timer() dropped add up to a whole tick, so the
+// average period of a rate is exact to 1/2^STEP_TIMER_FRACTION_BITS tick
+FORCE_INLINE unsigned char timer_carry(unsigned char fraction)
+{
+  timer_remainder += fraction;
+  if (timer_remainder < (1 << STEP_TIMER_FRACTION_BITS))
+    return 0;
+  timer_remainder -= (1 << STEP_TIMER_FRACTION_BITS);
+  return 1;
+}
+#endif
+
+#ifdef S_CURVE_ACCELERATION
+// 10t^3-15t^4+6t^5 in 1/65536 for t in 1/65536, t <= 32768
+FORCE_INLINE unsigned short bezier_ramp(unsigned short t)
+{
+  unsigned short t2 = ((unsigned long)t * t) >> 16;
+  unsigned short t3 = ((unsigned long)t2 * t) >> 16;
+  // 10-15t+6t^2 in 1/4096, 1..10 for t in [0,1]
+  unsigned short p = (10UL * 65536 - 15UL * t + 6UL * t2) >> 4;
+  return ((unsigned long)t3 * p) >> 12;
+}
+
+// Step rate on a Bezier ramp from rate_from to rate_to, elapsed timer ticks into a ramp of ramp_ticks.
+// The second half is mirrored from the first (s(t) = 1-s(1-t)) to keep the rounding monotonic.
+FORCE_INLINE unsigned short bezier_step_rate(unsigned short rate_from, unsigned short rate_to, unsigned long elapsed,
+                                             unsigned long ramp_ticks, unsigned short inv, unsigned char shift)
+{
+  if (elapsed > ramp_ticks)
+    elapsed = ramp_ticks;
+  unsigned long t = ((unsigned long)(unsigned short)((elapsed << 8) >> shift) * inv) >> 15;
+  if (t > 65535)
+    t = 65535;
+  unsigned short s;
+  if (t < 32768)
+    s = bezier_ramp(t);
+  else
+    s = 65535 - bezier_ramp(65535 - t);
+  if (rate_to >= rate_from)
+    return rate_from + (((unsigned long)(rate_to - rate_from) * s) >> 16);
+  else
+    return rate_from - (((unsigned long)(rate_from - rate_to) * s) >> 16);
+}
+#endif
+
+#ifdef LIN_ADVANCE
+// Extra E steps on the drivers of the current block; the direction is set again from out_bits at the
+// start of the next interrupt
+FORCE_INLINE void e_adv_step(long steps)
+{
+  if (steps > 0)
+    NORM_E_DIR();
+  else
+    REV_E_DIR();
+  _delay_us(1);
+  e_adv_steps += steps;
+  for (long i = labs(steps); i > 0; i--)
+  {
+    WRITE_E_STEP(!INVERT_E_STEP_PIN);
+    _delay_us(2);
+    WRITE_E_STEP(INVERT_E_STEP_PIN);
+    _delay_us(2);
+  }
+}
+
+// The advance belongs to the filament of the finishing block's extruder: take it back on that extruder
+// before a block of another extruder (or the next queued one, whatever it will be) gets the E drivers.
+// LIN_ADVANCE_MAX_STEPS per interrupt like the advance itself, at least at the 1kHz idle rate; the
+// finished block stays current until this returns true.
+FORCE_INLINE bool e_adv_release()
+{
+  if (e_adv_steps == 0)
+    return true;
+  unsigned char next = (block_buffer_tail + 1) & (BLOCK_BUFFER_SIZE - 1);
+  if (next != block_buffer_head && block_buffer[next].active_extruder == current_block->active_extruder)
+    return true;
+  long steps = e_adv_steps;
+  if (steps > LIN_ADVANCE_MAX_STEPS)
+    steps = LIN_ADVANCE_MAX_STEPS;
+  else if (steps < -LIN_ADVANCE_MAX_STEPS)
+    steps = -LIN_ADVANCE_MAX_STEPS;
+  e_adv_step(-steps);
+  if (OCR1A > 2000)
+    OCR1A = 2000;
+  return e_adv_steps == 0;
+}
+#endif
+
+#ifdef INPUT_SHAPING
+FORCE_INLINE void shaping_x_dir(bool dir)
+{
+#ifdef DUAL_X_CARRIAGE
+  write_x_dir(shaping_x_drivers, dir);
+#else
+  WRITE(X_DIR_PIN, dir);
+#endif
+}
+
+FORCE_INLINE void shaping_x_step(bool v)
+{
+#ifdef DUAL_X_CARRIAGE
+  write_x_step(shaping_x_drivers, v);
+#else
+  WRITE(X_STEP_PIN, v);
+#endif
+}
+
+FORCE_INLINE void shaping_y_dir(bool dir)
+{
+#ifdef TL_DUAL_Z
+  digitalWrite(tl_Y_DIR_PIN, dir);
+#else
+  WRITE(Y_DIR_PIN, dir);
+#endif
+}
+
+FORCE_INLINE void shaping_y_step(bool v)
+{
+#ifdef TL_DUAL_Z
+  digitalWrite(tl_Y_STEP_PIN, v);
+#else
+  WRITE(Y_STEP_PIN, v);
+#endif
+}
+
+// Planned position of an axis delay ticks ago, interpolated between the samples
+FORCE_INLINE short shaping_past_position(unsigned char axis, unsigned long delay)
+{
+  unsigned long t = shaping_clock - delay;
+  unsigned long k = t >> SHAPING_SAMPLE_SHIFT;
+  short p0 = shaping_history[axis][k & (SHAPING_HISTORY - 1)];
+  short p1 = shaping_history[axis][(k + 1) & (SHAPING_HISTORY - 1)];
+  return p0 + (short)(((long)(short)(p1 - p0) * (t & ((1 << SHAPING_SAMPLE_SHIFT) - 1))) >> SHAPING_SAMPLE_SHIFT);
+}
+
+// Adds the planned X/Y position for every sample time passed since the last interrupt.
+// Taken before this interrupt steps, so each sample is the position at its sample time.
+FORCE_INLINE void shaping_take_samples()
+{
+  shaping_clock += OCR1A; // the period that just ended
+  unsigned long last = shaping_clock >> SHAPING_SAMPLE_SHIFT;
+  if ((long)(last - shaping_sample) >= SHAPING_HISTORY)
+    shaping_sample = last - (SHAPING_HISTORY - 1);
+  while ((long)(last - shaping_sample) >= 0)
+  {
+    unsigned char i = shaping_sample & (SHAPING_HISTORY - 1);
+    unsigned char j = (shaping_sample - 1) & (SHAPING_HISTORY - 1);
+    shaping_history[X_AXIS][i] = (short)count_position[X_AXIS];
+    shaping_history[Y_AXIS][i] = (short)count_position[Y_AXIS];
+    if (shaping_history[X_AXIS][i] != shaping_history[X_AXIS][j] || shaping_history[Y_AXIS][i] != shaping_history[Y_AXIS][j])
+      shaping_moved = shaping_clock;
+    shaping_sample++;
+  }
+  if (shaping_clock - shaping_moved > 0x40000000UL)
+    shaping_moved = shaping_clock - 0x40000000UL; // stay clear of the wrap of shaping_clock
+}
+
+// Forget the position history, the drivers are at count_position. Called with interrupts off.
+static void shaping_reset()
+{
+  for (unsigned char axis = 0; axis < 2; axis++)
+  {
+    shaping_position[axis] = count_position[axis];
+    for (unsigned char i = 0; i < SHAPING_HISTORY; i++)
+      shaping_history[axis][i] = (short)count_position[axis];
+  }
+  shaping_sample = (shaping_clock >> SHAPING_SAMPLE_SHIFT) + 1;
+}
+
+// Step the X/Y drivers towards the shaped position: the planned position now and the
+// planned positions half a period (and a period for ZVD) ago, weighted by the impulse amplitudes.
+FORCE_INLINE void shaping_step(bool shaping_on)
+{
+  for (unsigned char axis = 0; axis < 2; axis++)
+  {
+    long target = count_position[axis];
+    if (shaping_on && shaping_amp[axis][0] != 0)
+    {
+      short now = (short)target;
+      long lag = (long)(short)(shaping_past_position(axis, shaping_delay[axis][0]) - now) * shaping_amp[axis][0];
+#ifdef SHAPING_ZVD
+      lag += (long)(short)(shaping_past_position(axis, shaping_delay[axis][1]) - now) * shaping_amp[axis][1];
+#endif
+      target += lag >> 15;
+    }
+
+    long steps = target - shaping_position[axis];
+    if (steps == 0)
+      continue;
+    if (steps > SHAPING_MAX_STEPS)
+      steps = SHAPING_MAX_STEPS;
+    else if (steps < -SHAPING_MAX_STEPS)
+      steps = -SHAPING_MAX_STEPS;
+    shaping_position[axis] += steps;
+
+    if (axis == X_AXIS)
+    {
+      shaping_x_dir((steps < 0) ? INVERT_X_DIR : !INVERT_X_DIR);
+      _delay_us(1);
+      for (int8_t i = abs(steps); i > 0; i--)
+      {
+        shaping_x_step(!INVERT_X_STEP_PIN);
+        _delay_us(1);
+        shaping_x_step(INVERT_X_STEP_PIN);
+        _delay_us(1);
+      }
+    }
+    else
+    {
+#ifdef TL_DUAL_Z
+      shaping_y_dir((steps < 0) ? rep_INVERT_Y_DIR : !rep_INVERT_Y_DIR);
+#else
+      shaping_y_dir((steps < 0) ? INVERT_Y_DIR : !INVERT_Y_DIR);
+#endif
+      _delay_us(1);
+      for (int8_t i = abs(steps); i > 0; i--)
+      {
+        shaping_y_step(!INVERT_Y_STEP_PIN);
+        _delay_us(1);
+        shaping_y_step(INVERT_Y_STEP_PIN);
+        _delay_us(1);
+      }
+    }
+  }
+}
+
+// Recalculates the impulse delays and amplitudes from shaping_frequency[] and shaping_zeta[]
+void st_set_shaping()
+{
+  for (unsigned char axis = 0; axis < 2; axis++)
+  {
+    unsigned long delay[2] = {0, 0};
+    unsigned short amp[2] = {0, 0};
+    float zeta = constrain(shaping_zeta[axis], 0.0, 0.99);
+    if (shaping_frequency[axis] > 0)
+    {
+      float damped = sqrt(1.0 - zeta * zeta);
+      float K = exp(-zeta * M_PI / damped);
+      float period = (F_CPU / 8.0) / (shaping_frequency[axis] * damped); // timer ticks
+#ifdef SHAPING_ZVD
+      float max_delay = period;
+#else
+      float max_delay = period / 2;
+#endif
+      // the 2nd sample of the interpolation must exist and the oldest must not be overwritten yet
+      if (period / 2 >= (1 << SHAPING_SAMPLE_SHIFT) && max_delay <= (float)(SHAPING_HISTORY - 2) * (1 << SHAPING_SAMPLE_SHIFT))
+      {
+        delay[0] = period / 2;
+        delay[1] = period;
+#ifdef SHAPING_ZVD
+        amp[0] = 32768.0 * 2 * K / ((1 + K) * (1 + K));
+        amp[1] = 32768.0 * K * K / ((1 + K) * (1 + K));
+#else
+        amp[0] = 32768.0 * K / (1 + K);
+#endif
+      }
+      else
+      {
+        SERIAL_ECHO_START;
+        SERIAL_ECHOPAIR("Input shaping frequency out of range, off for axis ", (unsigned long)axis);
+        SERIAL_ECHOLN("");
+      }
+    }
+    CRITICAL_SECTION_START;
+    shaping_delay[axis][0] = delay[0];
+    shaping_delay[axis][1] = delay[1];
+    shaping_amp[axis][0] = amp[0];
+    shaping_amp[axis][1] = amp[1];
+    CRITICAL_SECTION_END;
+  }
+}
+
+// True while the X/Y drivers have not caught up with the planned position
+bool st_shaping_busy()
+{
+  bool busy;
+  CRITICAL_SECTION_START;
+  busy = shaping_position[X_AXIS] != count_position[X_AXIS] || shaping_position[Y_AXIS] != count_position[Y_AXIS] ||
+         shaping_clock - shaping_moved < ((unsigned long)SHAPING_HISTORY << SHAPING_SAMPLE_SHIFT);
+  CRITICAL_SECTION_END;
+  return busy;
+}
+#endif
+
+#ifdef TOOLCHANGE_PIPELINED
+// Called with no block running. When the blocks planned before st_queue_position() are done the
+// stepper takes over the new position. Returns false while the shaper still moves X/Y in the old frame.
+FORCE_INLINE bool take_queued_position()
+{
+  if (queued_position_block != block_buffer_tail)
+    return true;
+#ifdef INPUT_SHAPING
+  if (st_shaping_busy())
+    return false;
+#endif
+  count_position[X_AXIS] = queued_position[X_AXIS];
+  count_position[Y_AXIS] = queued_position[Y_AXIS];
+  count_position[Z_AXIS] = queued_position[Z_AXIS];
+  count_position[E_AXIS] = queued_position[E_AXIS];
+#ifdef INPUT_SHAPING
+  shaping_reset();
+#endif
+  queued_position_block = 0xFF;
+  return true;
+}
+#endif
+
 // Initializes the trapezoid generator from the current block. Called whenever a new
 // block begins.
 FORCE_INLINE void trapezoid_generator_reset()
@@ -316,11 +746,94 @@ FORCE_INLINE void trapezoid_generator_reset()
   OCR1A_nominal = calc_timer(current_block->nominal_rate);
   // make a note of the number of step loops required at nominal speed
   step_loops_nominal = step_loops;
+#ifdef STEP_TIMER_FRACTION_BITS
+  timer_fraction_nominal = timer_fraction;
+#endif
   acc_step_rate = current_block->initial_rate;
+#ifdef S_CURVE_ACCELERATION
+  dec_step_rate = 0xFFFF;
+#endif
   acceleration_time = calc_timer(acc_step_rate);
   OCR1A = acceleration_time;
 }
 
+#ifdef HOMING_XY_TOGETHER
+// Endstop checks of a st_home_together() block. X1 stops on X min and X2 on X max. A stopped X carriage
+// loses its driver bit, a stopped axis its steps, so the step loop does not need to know about it.
+FORCE_INLINE void home_together_endstops()
+{
+  bool x_min_dir = (out_bits & (1 << X_AXIS)) != 0;
+#if defined(X_MIN_PIN) && X_MIN_PIN > -1
+  if (x_min_dir && (x_drivers & X_DRIVER))
+  {
+    bool x_min_endstop = (READ(X_MIN_PIN) != X_ENDSTOPS_INVERTING);
+    if (x_min_endstop && old_x_min_endstop)
+    {
+      endstops_trigsteps[X_AXIS] = count_position[X_AXIS];
+      endstop_x_hit = true;
+      x_drivers &= ~X_DRIVER;
+#ifdef INPUT_SHAPING
+      shaping_x_drivers = x_drivers; // the shaper must not push the stopped carriage on either
+#endif
+    }
+    old_x_min_endstop = x_min_endstop;
+  }
+#endif
+#if defined(X_MAX_PIN) && X_MAX_PIN > -1
+  if (x_min_dir == ((x_drivers & X2_DIR_REVERSED) != 0) && (x_drivers & X2_DRIVER))
+  {
+    bool x_max_endstop = (READ(X_MAX_PIN) != X_ENDSTOPS_INVERTING);
+    if (x_max_endstop && old_x_max_endstop)
+    {
+      endstops_trigsteps[X_AXIS] = count_position[X_AXIS];
+      endstop_x_hit = true;
+      x_drivers &= ~X2_DRIVER;
+#ifdef INPUT_SHAPING
+      shaping_x_drivers = x_drivers;
+#endif
+    }
+    old_x_max_endstop = x_max_endstop;
+  }
+#endif
+  if (!(x_drivers & (X_DRIVER | X2_DRIVER)))
+    current_block->steps_x = 0;
+
+  if ((out_bits & (1 << Y_AXIS)) != 0)
+  {
+#if defined(Y_MIN_PIN) && Y_MIN_PIN > -1
+#ifdef TL_DUAL_Z
+    bool y_min_endstop = (digitalRead(tl_Y_MIN_PIN) != tl_Y_ENDSTOPS_INVERTING);
+#else
+    bool y_min_endstop = (READ(Y_MIN_PIN) != Y_ENDSTOPS_INVERTING);
+#endif
+    if (y_min_endstop && old_y_min_endstop && (current_block->steps_y > 0))
+    {
+      endstops_trigsteps[Y_AXIS] = count_position[Y_AXIS];
+      endstop_y_hit = true;
+      current_block->steps_y = 0;
+    }
+    old_y_min_endstop = y_min_endstop;
+#endif
+  }
+  else
+  {
+#if defined(Y_MAX_PIN) && Y_MAX_PIN > -1
+    bool y_max_endstop = (READ(Y_MAX_PIN) != Y_ENDSTOPS_INVERTING);
+    if (y_max_endstop && old_y_max_endstop && (current_block->steps_y > 0))
+    {
+      endstops_trigsteps[Y_AXIS] = count_position[Y_AXIS];
+      endstop_y_hit = true;
+      current_block->steps_y = 0;
+    }
+    old_y_max_endstop = y_max_endstop;
+#endif
+  }
+
+  if (current_block->steps_x == 0 && current_block->steps_y == 0 && current_block->steps_z == 0)
+    step_events_completed = current_block->step_event_count;
+}
+#endif
+
 static int old_a_endstops = 0;
 static unsigned long a_endstops_start = 0;
 
@@ -329,6 +842,11 @@ static unsigned long a_endstops_start = 0;
 
 void Step_Controll()
 {
+#ifdef INPUT_SHAPING
+  shaping_take_samples();
+  bool shaping_on = !(CHECK_ENDSTOPS_ANY || check_endstops_all);
+#endif
+
   //Check endstops;
   int iXMin = (READ(X_MIN_PIN) != X_ENDSTOPS_INVERTING);
   #ifdef TL_DUAL_Z
@@ -364,11 +882,28 @@ void Step_Controll()
   if (current_block == NULL)
   {
     // Anything in the buffer?
-
-    current_block = plan_get_current_block();
+#ifdef TOOLCHANGE_PIPELINED
+    if (take_queued_position())
+#endif
+      current_block = plan_get_current_block();
     
     if (current_block != NULL)
     {
+#if defined(PLANNER_STATS) || defined(JOB_LOG)
+      had_block = true;
+      if (starved_since && card.sdprinting == 1)
+      {
+        unsigned long starved_ms = millis() - starved_since;
+#ifdef PLANNER_STATS
+        planner_stats.starved++;
+        planner_stats.starved_ms += starved_ms;
+#endif
+#ifdef JOB_LOG
+        job_stats.starved_ms += starved_ms;
+#endif
+      }
+      starved_since = 0;
+#endif
       current_block->busy = true;
       trapezoid_generator_reset();
       counter_x = -(current_block->step_event_count >> 1);
@@ -376,6 +911,13 @@ void Step_Controll()
       counter_z = counter_x;
       counter_e = counter_x;
       step_events_completed = 0;
+#ifdef DUAL_X_CARRIAGE
+      set_block_drivers();
+#endif
+#if defined(INPUT_SHAPING) && defined(DUAL_X_CARRIAGE)
+      if (current_block->steps_x != 0)
+        shaping_x_drivers = x_drivers;
+#endif
 
 #ifdef Z_LATE_ENABLE
       if (current_block->steps_z > 0)
@@ -388,10 +930,28 @@ void Step_Controll()
     }
     else
     {
+#if defined(PLANNER_STATS) || defined(JOB_LOG)
+      // counted once the next block comes, so the drain at the end of a print is not
+      if (had_block && card.sdprinting == 1)
+        starved_since = millis() | 1;
+      had_block = false;
+#endif
       OCR1A = 2000; // 1kHz.
     }
   }
 
+#ifdef LIN_ADVANCE
+  // All steps of the block are done, only its advance is still being taken back
+  if (current_block != NULL && step_events_completed >= current_block->step_event_count)
+  {
+    if (e_adv_release())
+    {
+      current_block = NULL;
+      plan_discard_current_block();
+    }
+  }
+  else
+#endif
   if (current_block != NULL)
   {
     // Set directions TO DO This should be done once during init of trapezoid. Endstops -> interrupt
@@ -403,27 +963,7 @@ void Step_Controll()
     if ((out_bits & (1 << X_AXIS)) != 0)
     {
 #ifdef DUAL_X_CARRIAGE
-      if (extruder_carriage_mode == 2)
-      {
-        WRITE(X_DIR_PIN, bXDir);
-        WRITE(X2_DIR_PIN, bXDir);
-      }
-      else if (extruder_carriage_mode == 3)
-      {
-        WRITE(X_DIR_PIN, bXDir);
-        WRITE(X2_DIR_PIN, !bXDir);
-      }
-      else
-      {
-        #ifdef MIX_COLOR_TEST
-          WRITE(X_DIR_PIN, bXDir);
-        #else
-        if (current_block->active_extruder != 0)
-          WRITE(X2_DIR_PIN, bXDir);
-        else
-          WRITE(X_DIR_PIN, bXDir);
-        #endif
-      }
+      write_x_dir(x_drivers, bXDir);
 #else
       WRITE(X_DIR_PIN, bXDir);
 #endif
@@ -432,27 +972,7 @@ void Step_Controll()
     else
     {
 #ifdef DUAL_X_CARRIAGE
-      if (extruder_carriage_mode == 2)
-      {
-        WRITE(X_DIR_PIN, !bXDir);
-        WRITE(X2_DIR_PIN, !bXDir);
-      }
-      else if (extruder_carriage_mode == 3)
-      {
-        WRITE(X_DIR_PIN, !bXDir);
-        WRITE(X2_DIR_PIN, bXDir);
-      }
-      else
-      {
-        #ifdef MIX_COLOR_TEST
-          WRITE(X_DIR_PIN, !bXDir);
-        #else
-        if (current_block->active_extruder != 0)
-          WRITE(X2_DIR_PIN, !bXDir);
-        else
-          WRITE(X_DIR_PIN, !bXDir);
-        #endif
-      }
+      write_x_dir(x_drivers, !bXDir);
 #else
       WRITE(X_DIR_PIN, !bXDir);
 #endif
@@ -478,6 +998,11 @@ void Step_Controll()
     }
 
     // Set direction en check limit switches
+#ifdef HOMING_XY_TOGETHER
+    if (homing_together)
+      home_together_endstops();
+    else
+#endif
     if ((out_bits & (1 << X_AXIS)) != 0)
     { // stepping along -X axis
       bool bChecked = false;
@@ -541,6 +1066,9 @@ void Step_Controll()
       }
     }
 
+#ifdef HOMING_XY_TOGETHER
+    if (!homing_together) // Y is checked by home_together_endstops()
+#endif
     if ((out_bits & (1 << Y_AXIS)) != 0)
     { // -direction
       bool bChecked = false;
@@ -697,53 +1225,39 @@ void Step_Controll()
       counter_x += current_block->steps_x;
       if (counter_x > 0)
       {
-#ifdef DUAL_X_CARRIAGE
-
+#ifdef INPUT_SHAPING
+        if (shaping_on)
+        { // the driver is stepped by shaping_step()
 #ifdef ELECTROMAGNETIC_VALVE
-        bOhassteps = true;
+          bOhassteps = true;
 #endif
-
-        if (extruder_carriage_mode == 2 || extruder_carriage_mode == 3)
-        {
-          WRITE(X_STEP_PIN, !INVERT_X_STEP_PIN);
-          WRITE(X2_STEP_PIN, !INVERT_X_STEP_PIN);
+          counter_x -= current_block->step_event_count;
+          count_position[X_AXIS] += count_direction[X_AXIS];
         }
         else
+#endif
         {
-        #ifdef MIX_COLOR_TEST
-            WRITE(X_STEP_PIN, !INVERT_X_STEP_PIN);
-        #else 
-          if (current_block->active_extruder == 1)
-            WRITE(X2_STEP_PIN, !INVERT_X_STEP_PIN);
-          else if (current_block->active_extruder == 0)
-            WRITE(X_STEP_PIN, !INVERT_X_STEP_PIN);
-        #endif
-        }
+#ifdef DUAL_X_CARRIAGE
+
+#ifdef ELECTROMAGNETIC_VALVE
+          bOhassteps = true;
+#endif
+
+          write_x_step(x_drivers, !INVERT_X_STEP_PIN);
 #else
-        WRITE(X_STEP_PIN, !INVERT_X_STEP_PIN);
+          WRITE(X_STEP_PIN, !INVERT_X_STEP_PIN);
+#endif
+          counter_x -= current_block->step_event_count;
+          count_position[X_AXIS] += count_direction[X_AXIS];
+#ifdef INPUT_SHAPING
+          shaping_position[X_AXIS] += count_direction[X_AXIS]; // the driver is where the plan is
 #endif
-        counter_x -= current_block->step_event_count;
-        count_position[X_AXIS] += count_direction[X_AXIS];
 #ifdef DUAL_X_CARRIAGE
-        if (extruder_carriage_mode == 2 || extruder_carriage_mode == 3)
-        {
-          WRITE(X_STEP_PIN, INVERT_X_STEP_PIN);
-          WRITE(X2_STEP_PIN, INVERT_X_STEP_PIN);
-        }
-        else
-        {
-        #ifdef MIX_COLOR_TEST
-            WRITE(X_STEP_PIN, INVERT_X_STEP_PIN);
-        #else 
-          if (current_block->active_extruder == 1)
-            WRITE(X2_STEP_PIN, INVERT_X_STEP_PIN);
-          else if (current_block->active_extruder == 0)
-            WRITE(X_STEP_PIN, INVERT_X_STEP_PIN);
-         #endif
-        }
+          write_x_step(x_drivers, INVERT_X_STEP_PIN);
 #else
-        WRITE(X_STEP_PIN, INVERT_X_STEP_PIN);
+          WRITE(X_STEP_PIN, INVERT_X_STEP_PIN);
 #endif
+        }
       }
 
       counter_y += current_block->steps_y;
@@ -754,17 +1268,30 @@ void Step_Controll()
         bOhassteps = true;
 #endif
 
+#ifdef INPUT_SHAPING
+        if (shaping_on)
+        { // the driver is stepped by shaping_step()
+          counter_y -= current_block->step_event_count;
+          count_position[Y_AXIS] += count_direction[Y_AXIS];
+        }
+        else
+#endif
+        {
 #ifdef TL_DUAL_Z
-        digitalWrite(tl_Y_STEP_PIN, !INVERT_Y_STEP_PIN);
-        counter_y -= current_block->step_event_count;
-        count_position[Y_AXIS] += count_direction[Y_AXIS];
-        digitalWrite(tl_Y_STEP_PIN, INVERT_Y_STEP_PIN);
+          digitalWrite(tl_Y_STEP_PIN, !INVERT_Y_STEP_PIN);
+          counter_y -= current_block->step_event_count;
+          count_position[Y_AXIS] += count_direction[Y_AXIS];
+          digitalWrite(tl_Y_STEP_PIN, INVERT_Y_STEP_PIN);
 #else
-        WRITE(Y_STEP_PIN, !INVERT_Y_STEP_PIN);
-        counter_y -= current_block->step_event_count;
-        count_position[Y_AXIS] += count_direction[Y_AXIS];
-        WRITE(Y_STEP_PIN, INVERT_Y_STEP_PIN);
+          WRITE(Y_STEP_PIN, !INVERT_Y_STEP_PIN);
+          counter_y -= current_block->step_event_count;
+          count_position[Y_AXIS] += count_direction[Y_AXIS];
+          WRITE(Y_STEP_PIN, INVERT_Y_STEP_PIN);
+#endif
+#ifdef INPUT_SHAPING
+          shaping_position[Y_AXIS] += count_direction[Y_AXIS];
 #endif
+        }
       }
 
       counter_z += current_block->steps_z;
@@ -900,9 +1427,21 @@ void Step_Controll()
     unsigned short step_rate;
     if (step_events_completed <= (unsigned long int)current_block->accelerate_until)
     {
-
-      MultiU24X24toH16(acc_step_rate, acceleration_time, current_block->acceleration_rate);
-      acc_step_rate += current_block->initial_rate;
+#ifdef S_CURVE_ACCELERATION
+      if (current_block->accel_ticks != 0)
+      {
+        // the rounding in bezier_ramp() can come out 1-2 steps/s below the last interrupt, never go back
+        step_rate = bezier_step_rate(current_block->initial_rate, current_block->cruise_rate, acceleration_time,
+                                     current_block->accel_ticks, current_block->accel_inv, current_block->accel_shift);
+        if (step_rate > acc_step_rate)
+          acc_step_rate = step_rate;
+      }
+      else
+#endif
+      {
+        MultiU24X24toH16(acc_step_rate, acceleration_time, current_block->acceleration_rate);
+        acc_step_rate += current_block->initial_rate;
+      }
 
       // upper limit
       if (acc_step_rate > current_block->nominal_rate)
@@ -910,20 +1449,36 @@ void Step_Controll()
 
       // step_rate to timer interval
       timer = calc_timer(acc_step_rate);
+#ifdef STEP_TIMER_FRACTION_BITS
+      timer += timer_carry(timer_fraction);
+#endif
       OCR1A = timer;
       acceleration_time += timer;
     }
     else if (step_events_completed > (unsigned long int)current_block->decelerate_after)
     {
-      MultiU24X24toH16(step_rate, deceleration_time, current_block->acceleration_rate);
-
-      if (step_rate > acc_step_rate)
-      { // Check step_rate stays positive
-        step_rate = current_block->final_rate;
+#ifdef S_CURVE_ACCELERATION
+      if (current_block->decel_ticks != 0)
+      {
+        step_rate = bezier_step_rate(acc_step_rate, current_block->final_rate, deceleration_time,
+                                     current_block->decel_ticks, current_block->decel_inv, current_block->decel_shift);
+        if (step_rate > dec_step_rate)
+          step_rate = dec_step_rate;
+        dec_step_rate = step_rate;
       }
       else
+#endif
       {
-        step_rate = acc_step_rate - step_rate; // Decelerate from aceleration end point.
+        MultiU24X24toH16(step_rate, deceleration_time, current_block->acceleration_rate);
+
+        if (step_rate > acc_step_rate)
+        { // Check step_rate stays positive
+          step_rate = current_block->final_rate;
+        }
+        else
+        {
+          step_rate = acc_step_rate - step_rate; // Decelerate from aceleration end point.
+        }
       }
 
       // lower limit
@@ -932,30 +1487,76 @@ void Step_Controll()
 
       // step_rate to timer interval
       timer = calc_timer(step_rate);
+#ifdef STEP_TIMER_FRACTION_BITS
+      timer += timer_carry(timer_fraction);
+#endif
       OCR1A = timer;
       deceleration_time += timer;
     }
     else
     {
+#ifdef STEP_TIMER_FRACTION_BITS
+      OCR1A = OCR1A_nominal + timer_carry(timer_fraction_nominal);
+#else
       OCR1A = OCR1A_nominal;
+#endif
       // ensure we're running at the correct step rate, even if we just came off an acceleration
       step_loops = step_loops_nominal;
     }
 
+#ifdef LIN_ADVANCE
+    // Move the filament towards K * current E speed, a few steps per interrupt
+    if (current_block->advance_rate != 0 || e_adv_steps != 0)
+    {
+      unsigned long advance_step_rate;
+      if (step_events_completed <= (unsigned long int)current_block->accelerate_until)
+        advance_step_rate = acc_step_rate;
+      else if (step_events_completed > (unsigned long int)current_block->decelerate_after)
+        advance_step_rate = step_rate;
+      else
+        advance_step_rate = current_block->nominal_rate;
+
+      long advance_delta = (long)((advance_step_rate * current_block->advance_rate) >> 16) - e_adv_steps;
+      if (advance_delta > LIN_ADVANCE_MAX_STEPS)
+        advance_delta = LIN_ADVANCE_MAX_STEPS;
+      else if (advance_delta < -LIN_ADVANCE_MAX_STEPS)
+        advance_delta = -LIN_ADVANCE_MAX_STEPS;
+
+      if (advance_delta != 0)
+        e_adv_step(advance_delta);
+    }
+#endif
+
     // If current block is finished, reset pointer
     if (step_events_completed >= current_block->step_event_count)
     {
-      current_block = NULL;
-      plan_discard_current_block();
+#ifdef LIN_ADVANCE
+      if (e_adv_release())
+#endif
+      {
+        current_block = NULL;
+        plan_discard_current_block();
+      }
     }
   }
+
+#ifdef INPUT_SHAPING
+  shaping_step(shaping_on);
+  // keep stepping out the shaped tail of the last move faster than the 1kHz idle rate
+  if (current_block == NULL && OCR1A > 500 && st_shaping_busy())
+    OCR1A = 500;
+#endif
 }
 
 ISR(TIMER1_COMPA_vect)
 {
   if (bQuickStop)
     return;
-#ifdef POWER_LOSS_TRIGGER_BY_PIN
+#if defined(POWER_LOSS_DETECT_BY_INTERRUPT)
+  // the pin is watched by Power_Loss_Init(), only the latched state is tested here
+  if (!bPowerLossActive)
+    Step_Controll();
+#elif defined(POWER_LOSS_TRIGGER_BY_PIN)
   bool bRet = Check_Power_Loss();
   //bool bRet = false;
   if (!bRet)
@@ -965,6 +1566,16 @@ ISR(TIMER1_COMPA_vect)
 #else
   Step_Controll();
 #endif
+#ifdef JOB_LOG
+  // Timer1 counts from the compare match, so it holds the run time of this interrupt
+  uint16_t ticks = TCNT1;
+  uint16_t period = OCR1A;
+  if ((uint32_t)ticks * job_stats.isr_period > (uint32_t)job_stats.isr_ticks * period)
+  {
+    job_stats.isr_ticks = ticks;
+    job_stats.isr_period = period;
+  }
+#endif
 }
 
 void st_init()
@@ -1170,8 +1781,7 @@ void st_init()
   // Set the timer pre-scaler
   // Generally we use a divider of 8, resulting in a 2MHz timer
   // frequency on a 16MHz MCU. If you are going to change this, be
-  // sure to regenerate speed_lookuptable.h with
-  // create_speed_lookuptable.py
+  // sure to change SPEED_TIMER in speed_lookuptable.h to match
   TCCR1B = (TCCR1B & ~(0x07 << CS10)) | (2 << CS10);
 
   OCR1A = 0x4000;
@@ -1189,7 +1799,14 @@ void st_init()
 // Block until all buffered steps are executed
 void st_synchronize()
 {
-  while (blocks_queued())
+  while (blocks_queued()
+#ifdef INPUT_SHAPING
+         || st_shaping_busy()
+#endif
+#ifdef TOOLCHANGE_PIPELINED
+         || queued_position_block != 0xFF
+#endif
+  )
   {
     manage_heater();
     manage_inactivity();
@@ -1204,9 +1821,32 @@ void st_set_position(const long &x, const long &y, const long &z, const long &e)
   count_position[Y_AXIS] = y;
   count_position[Z_AXIS] = z;
   count_position[E_AXIS] = e;
+#ifdef INPUT_SHAPING
+  shaping_reset();
+#endif
+#ifdef TOOLCHANGE_PIPELINED
+  queued_position_block = 0xFF;
+#endif
   CRITICAL_SECTION_END;
 }
 
+#ifdef TOOLCHANGE_PIPELINED
+void st_queue_position(const long &x, const long &y, const long &z, const long &e, unsigned char block_index)
+{
+  while (queued_position_block != 0xFF)
+  { // only one position change can wait for its block
+    manage_heater();
+    manage_inactivity();
+    tenlog_status_screen();
+  }
+  queued_position[X_AXIS] = x;
+  queued_position[Y_AXIS] = y;
+  queued_position[Z_AXIS] = z;
+  queued_position[E_AXIS] = e;
+  queued_position_block = block_index;
+}
+#endif
+
 void st_set_e_position(const long &e)
 {
   CRITICAL_SECTION_START;
@@ -1247,6 +1887,12 @@ void quickStop()
   while (blocks_queued())
     plan_discard_current_block();
   current_block = NULL;
+#ifdef LIN_ADVANCE
+  e_adv_steps = 0;
+#endif
+#ifdef TOOLCHANGE_PIPELINED
+  queued_position_block = 0xFF; // callers set the position after a quick stop
+#endif
   ENABLE_STEPPER_DRIVER_INTERRUPT();
   bQuickStop = false;
 }
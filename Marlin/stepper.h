@@ -116,53 +116,39 @@
   }
 #else
 extern int extruder_carriage_mode;
-#define WRITE_E_STEP(v)                                             \
-  {                                                                 \
-    if (extruder_carriage_mode == 2 || extruder_carriage_mode == 3) \
-    {                                                               \
-      WRITE(E0_STEP_PIN, v);                                        \
-      WRITE(E1_STEP_PIN, v);                                        \
-    }                                                               \
-    else if (current_block->active_extruder == 1)                   \
-    {                                                               \
-      WRITE(E1_STEP_PIN, v);                                        \
-    }                                                               \
-    else                                                            \
-    {                                                               \
-      WRITE(E0_STEP_PIN, v);                                        \
-    }                                                               \
+// e_drivers (stepper.cpp) holds the E drivers of the current block, bit 0 = E0, bit 1 = E1
+#define WRITE_E_STEP(v)      \
+  {                          \
+    if (e_drivers & 1)       \
+    {                        \
+      WRITE(E0_STEP_PIN, v); \
+    }                        \
+    if (e_drivers & 2)       \
+    {                        \
+      WRITE(E1_STEP_PIN, v); \
+    }                        \
   }
-#define NORM_E_DIR()                                                \
-  {                                                                 \
-    if (extruder_carriage_mode == 2 || extruder_carriage_mode == 3) \
-    {                                                               \
-      WRITE(E0_DIR_PIN, !INVERT_E0_DIR);                            \
-      WRITE(E1_DIR_PIN, !INVERT_E1_DIR);                            \
-    }                                                               \
-    else if (current_block->active_extruder == 1)                   \
-    {                                                               \
-      WRITE(E1_DIR_PIN, !INVERT_E1_DIR);                            \
-    }                                                               \
-    else                                                            \
-    {                                                               \
-      WRITE(E0_DIR_PIN, !INVERT_E0_DIR);                            \
-    }                                                               \
+#define NORM_E_DIR()                      \
+  {                                       \
+    if (e_drivers & 1)                    \
+    {                                     \
+      WRITE(E0_DIR_PIN, !INVERT_E0_DIR);  \
+    }                                     \
+    if (e_drivers & 2)                    \
+    {                                     \
+      WRITE(E1_DIR_PIN, !INVERT_E1_DIR);  \
+    }                                     \
   }
-#define REV_E_DIR()                                                 \
-  {                                                                 \
-    if (extruder_carriage_mode == 2 || extruder_carriage_mode == 3) \
-    {                                                               \
-      WRITE(E0_DIR_PIN, INVERT_E0_DIR);                             \
-      WRITE(E1_DIR_PIN, INVERT_E1_DIR);                             \
-    }                                                               \
-    else if (current_block->active_extruder == 1)                   \
-    {                                                               \
-      WRITE(E1_DIR_PIN, INVERT_E1_DIR);                             \
-    }                                                               \
-    else                                                            \
-    {                                                               \
-      WRITE(E0_DIR_PIN, INVERT_E0_DIR);                             \
-    }                                                               \
+#define REV_E_DIR()                       \
+  {                                       \
+    if (e_drivers & 1)                    \
+    {                                     \
+      WRITE(E0_DIR_PIN, INVERT_E0_DIR);   \
+    }                                     \
+    if (e_drivers & 2)                    \
+    {                                     \
+      WRITE(E1_DIR_PIN, INVERT_E1_DIR);   \
+    }                                     \
   }
 #endif
 #else
@@ -184,6 +170,10 @@ void st_synchronize();
 // Set current position in steps
 void st_set_position(const long &x, const long &y, const long &z, const long &e);
 void st_set_e_position(const long &e);
+#ifdef TOOLCHANGE_PIPELINED
+// Set current position in steps once the blocks planned so far are done, i.e. when the stepper gets to block_index
+void st_queue_position(const long &x, const long &y, const long &z, const long &e, unsigned char block_index);
+#endif
 
 // Get current position in steps
 long st_get_position(uint8_t axis);
@@ -192,10 +182,18 @@ long st_get_position(uint8_t axis);
 // to notify the subsystem that it is time to go to work.
 void st_wake_up();
 
+#if defined(PLANNER_STATS) || defined(JOB_LOG)
+// Forgets a wait for blocks, for when the SD print stops, pauses or a new one starts
+void st_reset_starved();
+#endif
+
 void checkHitEndstops();        //call from somwhere to create an serial error message with the locations the endstops where hit, in case they were triggered
 void endstops_hit_on_purpose(); //avoid creation of the message, i.e. after homeing and before a routine call of checkHitEndstops();
 
 void enable_endstops(bool check, int Axis); // Enable/disable endstop checking
+#ifdef HOMING_XY_TOGETHER
+void st_home_together(bool on); // endstops stop only their own axis, for moving X1, X2 and Y home at once
+#endif
 
 void checkStepperErrors(); //Print errors detected by the stepper
 
@@ -205,6 +203,13 @@ extern block_t *current_block; // A pointer to the block currently being traced
 
 void quickStop();
 
+#ifdef INPUT_SHAPING
+extern float shaping_frequency[2]; // X, Y in Hz, 0 = off
+extern float shaping_zeta[2];      // X, Y damping ratio
+void st_set_shaping();             // apply shaping_frequency[] and shaping_zeta[]
+bool st_shaping_busy();
+#endif
+
 void digitalPotWrite(int address, int value);
 void microstep_ms(uint8_t driver, int8_t ms1, int8_t ms2);
 void microstep_mode(uint8_t driver, uint8_t stepping);
@@ -103,6 +103,98 @@ static unsigned char soft_pwm_bed;
 #ifdef FAN_SOFT_PWM
 static unsigned char soft_pwm_fan;
 #endif
+
+#ifdef HEATER_HW_PWM
+// Mega2560 pins on a free PWM timer: Timer2 (D9,D10), Timer3 (D2,D3,D5), Timer4 (D6,D7,D8), Timer5 (D44,D45)
+#define HW_PWM_PIN(p) ((p) == 2 || (p) == 3 || (p) == 5 || (p) == 6 || (p) == 7 || (p) == 8 || (p) == 9 || (p) == 10 || (p) == 44 || (p) == 45)
+#if defined(HEATER_0_PIN) && HW_PWM_PIN(HEATER_0_PIN)
+#define HEATER_0_HW_PWM
+#endif
+#if (EXTRUDERS > 1) && defined(HEATER_1_PIN) && HW_PWM_PIN(HEATER_1_PIN)
+#define HEATER_1_HW_PWM
+#endif
+#if (EXTRUDERS > 2) && defined(HEATER_2_PIN) && HW_PWM_PIN(HEATER_2_PIN)
+#define HEATER_2_HW_PWM
+#endif
+// The bed is only moved when it sits on Timer4, which is slowed down for the SSR.
+#if defined(HEATER_BED_PIN) && (HEATER_BED_PIN == 6 || HEATER_BED_PIN == 7 || HEATER_BED_PIN == 8)
+#define HEATER_BED_HW_PWM
+#if BED_HW_PWM_FREQUENCY < 1
+#error "BED_HW_PWM_FREQUENCY must be at least 1Hz"
+#endif
+#define BED_HW_PWM_TOP (F_CPU / 1024 / BED_HW_PWM_FREQUENCY - 1)
+#if HEATER_BED_PIN == 6
+#define BED_HW_PWM_OCR OCR4A
+#define BED_HW_PWM_COM COM4A1
+#elif HEATER_BED_PIN == 7
+#define BED_HW_PWM_OCR OCR4B
+#define BED_HW_PWM_COM COM4B1
+#else
+#define BED_HW_PWM_OCR OCR4C
+#define BED_HW_PWM_COM COM4C1
+#endif
+#endif
+
+// soft_pwm values are 0..127 (128 = always on), scale them to the 8 bit timer range
+#define HW_PWM_DUTY(v) ((v) >= 128 ? 255 : ((v) << 1))
+
+// Push soft_pwm[] / soft_pwm_bed to the hardware channels. Only touches a timer when the value changed.
+static void updateHeaterPWM()
+{
+#ifdef HEATER_0_HW_PWM
+  static unsigned char hw_pwm_0 = 0xff;
+  if (soft_pwm[0] != hw_pwm_0)
+  {
+    hw_pwm_0 = soft_pwm[0];
+    CRITICAL_SECTION_START;
+    analogWrite(HEATER_0_PIN, HW_PWM_DUTY(hw_pwm_0));
+    CRITICAL_SECTION_END;
+  }
+#endif
+#ifdef HEATER_1_HW_PWM
+  static unsigned char hw_pwm_1 = 0xff;
+  if (soft_pwm[1] != hw_pwm_1)
+  {
+    hw_pwm_1 = soft_pwm[1];
+    CRITICAL_SECTION_START;
+    analogWrite(HEATER_1_PIN, HW_PWM_DUTY(hw_pwm_1));
+    CRITICAL_SECTION_END;
+  }
+#endif
+#ifdef HEATER_2_HW_PWM
+  static unsigned char hw_pwm_2 = 0xff;
+  if (soft_pwm[2] != hw_pwm_2)
+  {
+    hw_pwm_2 = soft_pwm[2];
+    CRITICAL_SECTION_START;
+    analogWrite(HEATER_2_PIN, HW_PWM_DUTY(hw_pwm_2));
+    CRITICAL_SECTION_END;
+  }
+#endif
+#ifdef HEATER_BED_HW_PWM
+  static unsigned char hw_pwm_b = 0xff;
+  if (soft_pwm_bed != hw_pwm_b)
+  {
+    hw_pwm_b = soft_pwm_bed;
+    CRITICAL_SECTION_START;
+    if (hw_pwm_b == 0)
+    {
+      TCCR4A &= ~(1 << BED_HW_PWM_COM);
+      WRITE(HEATER_BED_PIN, LOW);
+    }
+    else
+    {
+      if (hw_pwm_b >= 128)
+        BED_HW_PWM_OCR = BED_HW_PWM_TOP;
+      else
+        BED_HW_PWM_OCR = (unsigned int)(((unsigned long)hw_pwm_b * (BED_HW_PWM_TOP + 1)) >> 7);
+      TCCR4A |= (1 << BED_HW_PWM_COM);
+    }
+    CRITICAL_SECTION_END;
+  }
+#endif
+}
+#endif //HEATER_HW_PWM
 #if (defined(EXTRUDER_0_AUTO_FAN_PIN) && EXTRUDER_0_AUTO_FAN_PIN > -1) || \
     (defined(EXTRUDER_1_AUTO_FAN_PIN) && EXTRUDER_1_AUTO_FAN_PIN > -1) || \
     (defined(EXTRUDER_2_AUTO_FAN_PIN) && EXTRUDER_2_AUTO_FAN_PIN > -1)
@@ -212,6 +304,9 @@ void PID_autotune(float temp, int extruder, int ncycles)
 
   for (;;)
   {
+#ifdef HEATER_HW_PWM
+    updateHeaterPWM();
+#endif
 
     if (temp_meas_ready == true)
     { // temp sample ready
@@ -439,6 +534,11 @@ void manage_heater()
   float pid_input;
   float pid_output;
 
+#ifdef HEATER_HW_PWM
+  // apply the outputs of the previous pass (manage_heater has several early returns)
+  updateHeaterPWM();
+#endif
+
   if (temp_meas_ready != true) //better readability
     return;
 
@@ -553,8 +653,8 @@ void manage_heater()
       SERIAL_ECHO_START;
       SERIAL_ECHOLNPGM("Heating failed");
 
-      sTempErrMsg = "E" + String(e + 1) + " Heating Error :" + String(iHF);
-      sShortErrMsg = "E" + String(e + 1) + " Err" + String(iHF);
+      snprintf_P(sTempErrMsg, sizeof(sTempErrMsg), PSTR("E%d Heating Error :%d"), e + 1, iHF);
+      snprintf_P(sShortErrMsg, sizeof(sShortErrMsg), PSTR("E%d Err%d"), e + 1, iHF);
       iTempErrID = MSG_NOZZLE_HEATING_ERROR;
 
       return;
@@ -823,6 +923,13 @@ void tp_init()
 #if defined(HEATER_BED_PIN) && (HEATER_BED_PIN > -1)
   SET_OUTPUT(HEATER_BED_PIN);
 #endif
+#ifdef HEATER_BED_HW_PWM
+  // Timer4: fast PWM with ICR4 as TOP (mode 14), clk/1024, for a slow SSR friendly period
+  TCCR4A = (1 << WGM41);
+  TCCR4B = (1 << WGM43) | (1 << WGM42) | (1 << CS42) | (1 << CS40);
+  ICR4 = BED_HW_PWM_TOP;
+  BED_HW_PWM_OCR = 0;
+#endif
 #if defined(FAN_PIN) && (FAN_PIN > -1)
   SET_OUTPUT(FAN_PIN);
 #ifdef FAST_PWM_FAN
@@ -1055,6 +1162,11 @@ void disable_heater()
   WRITE(HEATER_BED_PIN, LOW);
 #endif
 #endif
+
+#ifdef HEATER_HW_PWM
+  // WRITE() has no effect while a timer still owns the pin
+  updateHeaterPWM();
+#endif
 }
 
 void max_temp_error(uint8_t e)
@@ -1066,8 +1178,8 @@ void max_temp_error(uint8_t e)
     SERIAL_ERRORLN((int)e);
     SERIAL_ERRORLNPGM(": Extruder switched off. MAXTEMP triggered !");
     //LCD_ALERTMESSAGEPGM("Err: MAXTEMP");
-    sShortErrMsg = "E" + String(e + 1);
-    sTempErrMsg = "E" + String(e + 1) + ", MAXTEMP Error!";
+    snprintf_P(sShortErrMsg, sizeof(sShortErrMsg), PSTR("E%d"), e + 1);
+    snprintf_P(sTempErrMsg, sizeof(sTempErrMsg), PSTR("E%d, MAXTEMP Error!"), e + 1);
     iTempErrID = MSG_NOZZLE_HIGH_TEMP_ERROR;
   }
 #ifndef BOGUS_TEMPERATURE_FAILSAFE_OVERRIDE
@@ -1083,8 +1195,8 @@ void min_temp_error(uint8_t e)
     SERIAL_ERROR_START;
     SERIAL_ERRORLN((int)e);
     SERIAL_ERRORLNPGM(": Extruder switched off. MINTEMP triggered !");
-    sShortErrMsg = "E" + String(e + 1);
-    sTempErrMsg = "E" + String(e + 1) + ", MINTEMP Error!";
+    snprintf_P(sShortErrMsg, sizeof(sShortErrMsg), PSTR("E%d"), e + 1);
+    snprintf_P(sTempErrMsg, sizeof(sTempErrMsg), PSTR("E%d, MINTEMP Error!"), e + 1);
     iTempErrID = MSG_NOZZLE_LOW_TEMP_ERROR;
   }
 
@@ -1104,7 +1216,7 @@ void bed_max_temp_error(void)
     SERIAL_ERRORLNPGM("Temperature heated bed switched off. MAXTEMP triggered !!");
     //LCD_ALERTMESSAGEPGM("Err: MAXTEMP BED");
 
-    sTempErrMsg = "Bed MAXTEMP Error!";
+    strcpy_P(sTempErrMsg, PSTR("Bed MAXTEMP Error!"));
     iTempErrID = MSG_BED_HIGH_TEMP_ERROR;
   }
 #ifndef BOGUS_TEMPERATURE_FAILSAFE_OVERRIDE
@@ -1123,7 +1235,7 @@ void bed_min_temp_error(void)
     SERIAL_ERRORLNPGM("Temperature heated bed switched off. MINTEMP triggered !!");
     //LCD_ALERTMESSAGEPGM("Err: MINTEMP BED");
 
-    sTempErrMsg = "Bed MINTEMP Error!";
+    strcpy_P(sTempErrMsg, PSTR("Bed MINTEMP Error!"));
     iTempErrID = MSG_BED_LOW_TEMP_ERROR;
   }
 #ifndef BOGUS_TEMPERATURE_FAILSAFE_OVERRIDE
@@ -1208,37 +1320,37 @@ void Temp_Controll()
   static unsigned long raw_temp_bed_value = 0;
   static unsigned char temp_state = 0;
   static unsigned char pwm_count = (1 << SOFT_PWM_SCALE);
+#if defined(HEATER_0_PIN) && (HEATER_0_PIN > -1) && !defined(HEATER_0_HW_PWM)
   static unsigned char soft_pwm_0;
-#if EXTRUDERS > 1
+#endif
+#if EXTRUDERS > 1 && defined(HEATER_1_PIN) && (HEATER_1_PIN > -1) && !defined(HEATER_1_HW_PWM)
   static unsigned char soft_pwm_1;
 #endif
-#if EXTRUDERS > 2
+#if EXTRUDERS > 2 && !defined(HEATER_2_HW_PWM)
   static unsigned char soft_pwm_2;
 #endif
-#if HEATER_BED_PIN > -1
+#if defined(HEATER_BED_PIN) && (HEATER_BED_PIN > -1) && !defined(HEATER_BED_HW_PWM)
   static unsigned char soft_pwm_b;
 #endif
 
   if (pwm_count == 0)
   {
+#if defined(HEATER_0_PIN) && (HEATER_0_PIN > -1) && !defined(HEATER_0_HW_PWM)
     soft_pwm_0 = soft_pwm[0];
-#if defined(HEATER_0_PIN) && (HEATER_0_PIN > -1)
     if (soft_pwm_0 > 0)
       WRITE(HEATER_0_PIN, 1);
 #endif
-#if EXTRUDERS > 1
+#if EXTRUDERS > 1 && defined(HEATER_1_PIN) && (HEATER_1_PIN > -1) && !defined(HEATER_1_HW_PWM)
     soft_pwm_1 = soft_pwm[1];
-#if defined(HEATER_1_PIN) && (HEATER_1_PIN > -1)
     if (soft_pwm_1 > 0)
       WRITE(HEATER_1_PIN, 1);
 #endif
-#endif
-#if EXTRUDERS > 2
+#if EXTRUDERS > 2 && !defined(HEATER_2_HW_PWM)
     soft_pwm_2 = soft_pwm[2];
     if (soft_pwm_2 > 0)
       WRITE(HEATER_2_PIN, 1);
 #endif
-#if defined(HEATER_BED_PIN) && HEATER_BED_PIN > -1
+#if defined(HEATER_BED_PIN) && (HEATER_BED_PIN > -1) && !defined(HEATER_BED_HW_PWM)
     soft_pwm_b = soft_pwm_bed;
     if (soft_pwm_b > 0)
       WRITE(HEATER_BED_PIN, 1);
@@ -1249,21 +1361,19 @@ void Temp_Controll()
       WRITE(FAN_PIN, 1);
 #endif
   }
-#if defined(HEATER_0_PIN) && (HEATER_0_PIN > -1)
+#if defined(HEATER_0_PIN) && (HEATER_0_PIN > -1) && !defined(HEATER_0_HW_PWM)
   if (soft_pwm_0 <= pwm_count)
     WRITE(HEATER_0_PIN, 0);
 #endif
-#if EXTRUDERS > 1
-#if defined(HEATER_1_PIN) && (HEATER_1_PIN > -1)
+#if EXTRUDERS > 1 && defined(HEATER_1_PIN) && (HEATER_1_PIN > -1) && !defined(HEATER_1_HW_PWM)
   if (soft_pwm_1 <= pwm_count)
     WRITE(HEATER_1_PIN, 0);
 #endif
-#endif
-#if EXTRUDERS > 2
+#if EXTRUDERS > 2 && !defined(HEATER_2_HW_PWM)
   if (soft_pwm_2 <= pwm_count)
     WRITE(HEATER_2_PIN, 0);
 #endif
-#if defined(HEATER_BED_PIN) && HEATER_BED_PIN > -1
+#if defined(HEATER_BED_PIN) && (HEATER_BED_PIN > -1) && !defined(HEATER_BED_HW_PWM)
   if (soft_pwm_b <= pwm_count)
     WRITE(HEATER_BED_PIN, 0);
 #endif
@@ -1542,7 +1652,10 @@ void Temp_Controll()
 // Timer 0 is shared with millies
 ISR(TIMER0_COMPB_vect)
 {
-#ifdef POWER_LOSS_TRIGGER_BY_PIN
+#if defined(POWER_LOSS_DETECT_BY_INTERRUPT)
+  if (!bPowerLossActive)
+    Temp_Controll();
+#elif defined(POWER_LOSS_TRIGGER_BY_PIN)
   bool bRet = Check_Power_Loss();
   //bool bRet = false;
   if (!bRet)
@@ -8,8 +8,8 @@
 
 float fECOZ = 0;
 bool bECOSeted = false;
-String gsM117 = "";
-String gsPrinting = "";
+char gsM117[SCREEN_MESSAGE_LENGTH] = "";
+char gsPrinting[SCREEN_MESSAGE_LENGTH] = "";
 long dwn_command[255] = {0};
 bool bLogoGot = false;
 int i_print_page_id = 0;
@@ -29,10 +29,44 @@ bool bAtv = false;
 int iOldLogoID = 0;
 long lAtvCode = 0;
 
-String file_name_list[6]={""};
-String file_name_long_list[6]={""};
+char file_name_list[6][13];
+char file_name_long_list[6][LONG_FILENAME_LENGTH];
 bool b_is_last_page = false;
 
+// Lower-cased copy of an SD file name, always terminated.
+static void copy_lower(char *dst, const char *src, size_t size)
+{
+    size_t i = 0;
+    for (; i < size - 1 && src[i]; i++)
+        dst[i] = tolower(src[i]);
+    dst[i] = '\0';
+}
+
+void set_printing_message(const char *sFileName)
+{
+    strcpy_P(gsPrinting, PSTR("Printing "));
+    strncat(gsPrinting, sFileName, SCREEN_MESSAGE_LENGTH - 1 - strlen(gsPrinting));
+}
+
+#ifdef PRINT_TIME_ESTIMATE
+// Remaining print time as hh<sep>mm, "--<sep>--" while it is not known
+static void remaining_time_text(char *sText, const char *pSep)
+{
+    long lRemain = card.remainingTime();
+    if (lRemain < 0)
+    {
+        strcpy_P(sText, PSTR("--"));
+        strcat_P(sText, pSep);
+        strcat_P(sText, PSTR("--"));
+        return;
+    }
+    uint16_t time = lRemain / 60;
+    strcpy(sText, itostr2(time / 60));
+    strcat_P(sText, pSep);
+    strcat(sText, itostr2(time % 60));
+}
+#endif
+
 void tenlog_status_screen()
 {
     if (tenlog_status_update_delay)
@@ -128,13 +162,16 @@ void tenlog_screen_update_dwn()
     DWN_Data(0x6052, feedmultiply, 2);
     _delay_ms(5);
 
-    String sTime = "-- :--";
+    char sTime[8];
+    strcpy_P(sTime, PSTR("-- :--"));
     int iTimeS = 0;
     int iPercent = 0;
     if (card.sdprinting == 1)
     {
         uint16_t time = millis() / 60000 - starttime / 60000;
-        sTime = String(itostr2(time / 60)) + " :" + String(itostr2(time % 60));
+        strcpy(sTime, itostr2(time / 60));
+        strcat_P(sTime, PSTR(" :"));
+        strcat(sTime, itostr2(time % 60));
         iPercent = card.percentDone();
         DWN_Data(0x6051, iPercent, 2);
         _delay_ms(5);
@@ -160,6 +197,12 @@ void tenlog_screen_update_dwn()
 	DWN_Text(0x7540, 8, sTime);
     _delay_ms(5);
 
+#ifdef PRINT_TIME_ESTIMATE
+    remaining_time_text(sTime, PSTR(" :"));
+    DWN_Text(0x7550, 8, sTime);
+    _delay_ms(5);
+#endif
+
     DWN_Data(0x8841, iTimeS, 2);
     _delay_ms(5);
 
@@ -230,10 +273,10 @@ void tenlog_screen_update_dwn()
     DWN_Data(0x8805, active_extruder, 2);
     _delay_ms(5);
 
-	if (gsM117 != "" && gsM117 != "Printing...")
+	if (gsM117[0] && strcmp_P(gsM117, PSTR("Printing...")) != 0)
     { 
 		//Do not display "Printing..."
-        String sPrinting = "";
+        const char *sPrinting = "";
         static int icM117;
 
         if (icM117 > 0)
@@ -325,7 +368,7 @@ Nozzle Low Temp error	 	10
 Bed High temp error	 	    11
 Bed Low temp error	 	    12
 */
-void DWN_Message(const int MsgID, const String sMsg, const bool PowerOff)
+void DWN_Message(const int MsgID, const char *sMsg, const bool PowerOff)
 {
     dwnMessageID = MsgID;
     int iSend = dwnMessageID + languageID * 13;
@@ -376,7 +419,7 @@ void DWN_MessageBoxHandler(const bool ISOK)
     case MSG_START_PRINT:
         if (ISOK)
         {
-            if (file_name_list[iPrintID] != "")
+            if (file_name_list[iPrintID][0])
             {
 
                 if (print_from_z_target > 0)
@@ -389,15 +432,15 @@ void DWN_MessageBoxHandler(const bool ISOK)
                     st_synchronize();
                     card.closefile();
                 }
-                const char *str0 = file_name_list[iPrintID].c_str();
-                const char *str1 = file_name_long_list[iPrintID].c_str();
+                char *str0 = file_name_list[iPrintID];
+                char *str1 = file_name_long_list[iPrintID];
 
                 feedrate = 4000;
                 card.openFile(str1, str0, true);
                 card.startFileprint();
                 starttime = millis();
                 DWN_Page(DWN_P_PRINTING);
-                gsPrinting = "Printing " + file_name_long_list[iPrintID];
+                set_printing_message(file_name_long_list[iPrintID]);
                 DWN_Text(0x7500, 32, gsPrinting, true);
             }
         }
@@ -467,28 +510,23 @@ void CheckTempError_tjc()
 {
     if (iTempErrID > 0)
     {
-        String strMessage = sTempErrMsg;
+        char sSend[8];
 
         TLSTJC_printconstln(F("sleep=0"));
         TLSTJC_printconstln(F("msgbox.vaFromPageID.val=1"));
         TLSTJC_printconstln(F("msgbox.vaToPageID.val=1"));
         TLSTJC_printconst(F("msgbox.vaMID.val="));
-        strMessage = "" + String(iTempErrID) + "";
-        const char *str1 = strMessage.c_str();
-        TLSTJC_println(str1);
-
-        TLSTJC_printconst(F("msgbox.vtMS.txt=\""));
-        strMessage = " " + sShortErrMsg + "";
-        str1 = strMessage.c_str();
-        TLSTJC_print(str1);
+        TLSTJC_println(itoa(iTempErrID, sSend, 10));
+
+        // both texts get " " + sShortErrMsg, as before
+        TLSTJC_printconst(F("msgbox.vtMS.txt=\" "));
+        TLSTJC_print(sShortErrMsg);
         TLSTJC_printconstln(F("\""));
-        sShortErrMsg = "";
 
-        TLSTJC_printconst(F("msgbox.tMessage.txt=\""));
-        strMessage = "" + strMessage + "";
-        str1 = strMessage.c_str();
-        TLSTJC_print(str1);
+        TLSTJC_printconst(F("msgbox.tMessage.txt=\" "));
+        TLSTJC_print(sShortErrMsg);
         TLSTJC_printconstln(F("\""));
+        sShortErrMsg[0] = 0;
         TLSTJC_printconstln(F("page msgbox"));
         
 #ifdef HAS_PLR_MODULE
@@ -670,135 +708,81 @@ void Init_TLScreen_tjc()
 #endif
 }
 
-void tenlog_screen_update_tjc()
+// Sends one status field followed by the '|' separator.
+static void tjc_status_field(long lN)
 {
-    String strAll = "main.sStatus.txt=\"";
-    long lN = current_position[X_AXIS] * 10.0; //1
-    String sSend = String(lN);
-    strAll = strAll + sSend + "|";              //6
-
-    lN = current_position[Y_AXIS] * 10.0; //2
-    sSend = String(lN);
-    strAll = strAll + sSend + "|";              //12
-
-    lN = current_position[Z_AXIS] * 10.0; //3
-    sSend = String(lN);
-    strAll = strAll + sSend + "|";              //18
-
-    lN = current_position[E_AXIS] * 10.0; //4
-    sSend = String(lN);
-    strAll = strAll + "|"; //do not sent E Position    //19
-    //strAll = strAll + sSend + "|";
-
-    lN = int(degTargetHotend(0) + 0.5); //5
-    sSend = String(lN);
-    strAll = strAll + sSend + "|";              //23
-
-    lN = int(degHotend(0) + 0.5); //6
-    sSend = String(lN);
-    strAll = strAll + sSend + "|";              //27
-
-    lN = int(degTargetHotend(1) + 0.5); //7
-    sSend = String(lN);
-    strAll = strAll + sSend + "|";              //31
-
-    lN = int(degHotend(1) + 0.5); //8
-    sSend = String(lN);
-    strAll = strAll + sSend + "|";              //35
-
-    lN = int(degTargetBed() + 0.5); //9
-    sSend = String(lN);
-    strAll = strAll + sSend + "|";              //3
-
-    lN = int(degBed() + 0.5); //10
-    sSend = String(lN);
-    strAll = strAll + sSend + "|";
+    char sSend[12];
+    TLSTJC_print(ltoa(lN, sSend, 10));
+    TLSTJC_printconst(F("|"));
+}
 
-    lN = fanSpeed * 100.0 / 255.0 + 0.5; //11
-    sSend = String(lN);
-    strAll = strAll + sSend + "|";
+static void tjc_status_flag(bool bOn)
+{
+    TLSTJC_printconst(bOn ? F("1|") : F("0|"));
+}
 
-    lN = feedmultiply; //12
-    sSend = String(lN);
-    strAll = strAll + sSend + "|";
+void tenlog_screen_update_tjc()
+{
+    TLSTJC_printconst(F("main.sStatus.txt=\""));
+    tjc_status_field(current_position[X_AXIS] * 10.0); //1
+    tjc_status_field(current_position[Y_AXIS] * 10.0); //2
+    tjc_status_field(current_position[Z_AXIS] * 10.0); //3
+    TLSTJC_printconst(F("|")); //4 do not sent E Position
+
+    tjc_status_field(int(degTargetHotend(0) + 0.5)); //5
+    tjc_status_field(int(degHotend(0) + 0.5));       //6
+    tjc_status_field(int(degTargetHotend(1) + 0.5)); //7
+    tjc_status_field(int(degHotend(1) + 0.5));       //8
+    tjc_status_field(int(degTargetBed() + 0.5));     //9
+    tjc_status_field(int(degBed() + 0.5));           //10
+    tjc_status_field(fanSpeed * 100.0 / 255.0 + 0.5); //11
+    tjc_status_field(feedmultiply);                  //12
 
     int iPercent = 0;
     if (card.sdprinting == 1) //13
     {
-        strAll = strAll + "1|";
-        lN = card.percentDone();
+        TLSTJC_printconst(F("1|"));
         iPercent = card.percentDone();
-        sSend = String(lN); //14
-        strAll = strAll + sSend + "|";
+        tjc_status_field(iPercent); //14
     }
     else if (card.sdprinting == 0)
     {
-        strAll = strAll + "0|0|";
+        TLSTJC_printconst(F("0|0|"));
     }
     else if (card.sdprinting == 2)
     {
-        strAll = strAll + "2|0|";
+        TLSTJC_printconst(F("2|0|"));
     }
 
-    lN = active_extruder; //15
-    sSend = String(lN);
-    strAll = strAll + sSend + "|";
-
-    lN = dual_x_carriage_mode; //16
-    sSend = String(lN);
-    strAll = strAll + sSend + "|";
+    tjc_status_field(active_extruder);      //15
+    tjc_status_field(dual_x_carriage_mode); //16
 
-    //lN=dual_x_carriage_mode;                //17 time
     if (IS_SD_PRINTING)
-    {
+    { //17 time
         uint16_t time = millis() / 60000 - starttime / 60000;
-        sSend = String(itostr2(time / 60)) + ":" + String(itostr2(time % 60));
-        strAll = strAll + sSend + "|";
-    }
-    else
-    {
-        strAll = strAll + "00:00|";
-    }
-
-    if (card.isFileOpen())
-    { //18 is file open
-        strAll = strAll + "1|";
-    }
-    else
-    {
-        strAll = strAll + "0|";
-    }
-
-    if (isHeatingHotend(0))
-    { //19 is heating nozzle 0
-        strAll = strAll + "1|";
+        TLSTJC_print(itostr2(time / 60));
+        TLSTJC_printconst(F(":"));
+        TLSTJC_print(itostr2(time % 60));
+        TLSTJC_printconst(F("|"));
     }
     else
     {
-        strAll = strAll + "0|";
+        TLSTJC_printconst(F("00:00|"));
     }
 
-    if (isHeatingHotend(1))
-    { //20 is heating nozzle 1
-        strAll = strAll + "1|";
-    }
-    else
-    {
-        strAll = strAll + "0|";
-    }
+    tjc_status_flag(card.isFileOpen());   //18 is file open
+    tjc_status_flag(isHeatingHotend(0)); //19 is heating nozzle 0
+    tjc_status_flag(isHeatingHotend(1)); //20 is heating nozzle 1
+    tjc_status_flag(isHeatingBed());     //21 is heating Bed
 
-    if (isHeatingBed())
-    { //21 is heating Bed
-        strAll = strAll + "1|";
-    }
-    else
-    {
-        strAll = strAll + "0|";
-    }
+#ifdef PRINT_TIME_ESTIMATE
+    char sRemain[8];
+    remaining_time_text(sRemain, PSTR(":")); //22 remaining time
+    TLSTJC_print(sRemain);
+    TLSTJC_printconst(F("|"));
+#endif
 
-    strAll = strAll + "\"";
-    const char *strAll0 = strAll.c_str();
-    TLSTJC_println(strAll0);
+    TLSTJC_printconstln(F("\""));
 
     static int iECOBedT;
     if (current_position[Z_AXIS] >= ECO_HEIGHT && !bECOSeted && iPercent > 1 && tl_ECO_MODE == 1)
@@ -817,7 +801,7 @@ void tenlog_screen_update_tjc()
         bECOSeted = false;
     }
 
-    if (gsM117 != "" && gsM117 != "Printing...")
+    if (gsM117[0] && strcmp_P(gsM117, PSTR("Printing...")) != 0)
     { //Do not display "Printing..."
         static int icM117;
 
@@ -830,9 +814,7 @@ void tenlog_screen_update_tjc()
         {
             _delay_ms(50);
             TLSTJC_printconst(F("printing.tM117.txt=\""));            
-            String strM117 = "" + gsM117 + "";
-            const char *strM1170 = strM117.c_str();
-            TLSTJC_println(strM1170);
+            TLSTJC_println(gsM117);
             TLSTJC_printconstln(F("\""));
             icM117 = 60;
         }
@@ -896,34 +878,27 @@ void sdcard_tlcontroller_dwn()
     for (int i = 0; i < 6; i++)
     {
         DWN_Text(0x7300 + i * 0x30, 32, "");
-        file_name_list[i] = "";
-        file_name_long_list[i] = "";
+        file_name_list[i][0] = '\0';
+        file_name_long_list[i][0] = '\0';
     }
 
     for (uint16_t i = 0; i < fileCnt; i++)
     {
         card.getfilename(fileCnt - 1 - i);
-        String strFN = String(card.filename);
 
-        if (!card.filenameIsDir && strFN.length() > 0)
+        if (!card.filenameIsDir && card.filename[0])
         {
-            if (strISAscii(strFN))
+            if (strISAscii(card.filename))
             {
-                strFN = String(card.longFilename);
-                strFN.toLowerCase();
-                String strLFN = strFN;
                 iFileID++;
                 if (iFileID >= (i_print_page_id)*6 + 1 && iFileID <= (i_print_page_id + 1) * 6)
                 {
                     int iFTemp = iFileID - (i_print_page_id)*6;
-
-                    strFN = String(card.filename);
-                    strFN.toLowerCase();
-                    if (strLFN == "")
-                        strLFN = strFN;
-                    DWN_Text(0x7300 + (iFTemp - 1) * 0x30, 32, strLFN.c_str());
-                    file_name_list[iFTemp - 1] = strFN.c_str();
-                    file_name_long_list[iFTemp - 1] = strLFN.c_str();
+                    char *strFN = file_name_list[iFTemp - 1];
+                    char *strLFN = file_name_long_list[iFTemp - 1];
+                    copy_lower(strFN, card.filename, sizeof(file_name_list[0]));
+                    copy_lower(strLFN, card.longFilename[0] ? card.longFilename : card.filename, sizeof(file_name_long_list[0]));
+                    DWN_Text(0x7300 + (iFTemp - 1) * 0x30, 32, strLFN);
                 }
             }
         }
@@ -966,13 +941,14 @@ void sdcard_tlcontroller_tjc()
     //Clear the boxlist
     for (int i = 1; i < 7; i++)
     {
+        char sID[2] = {(char)('0' + i), '\0'};
         TLSTJC_print("select_file.tL");
-        TLSTJC_print(String(i).c_str());
+        TLSTJC_print(sID);
         TLSTJC_print(".txt=\"\"");
         TLSTJC_printend();
 
         TLSTJC_print("select_file.sL");
-        TLSTJC_print(String(i).c_str());
+        TLSTJC_print(sID);
         TLSTJC_print(".txt=\"\"");
         TLSTJC_printend();
     }
@@ -980,37 +956,31 @@ void sdcard_tlcontroller_tjc()
     for (uint16_t i = 0; i < fileCnt; i++)
     {
         card.getfilename(fileCnt - 1 - i);    //card.getfilename(i);   // card.getfilename(fileCnt-1-i); //By Zyf sort by time desc
-        String strFN = String(card.filename); // + " | " + String(card.filename);
 
-        if (!card.filenameIsDir && strFN.length() > 0)
+        if (!card.filenameIsDir && card.filename[0])
         {
-            if (strISAscii(strFN))
+            if (strISAscii(card.filename))
             {
-                strFN = String(card.longFilename);
-                strFN.toLowerCase();
-                String strLFN = strFN;
                 iFileID++;
                 if (iFileID >= (i_print_page_id)*6 + 1 && iFileID <= (i_print_page_id + 1) * 6)
                 {
-                    strFN = String(card.filename);
-                    strFN.toLowerCase();
-
-                    if (strLFN == "")
-                        strLFN = strFN;
+                    char strFN[13];
+                    char strLFN[LONG_FILENAME_LENGTH];
+                    copy_lower(strFN, card.filename, sizeof(strFN));
+                    copy_lower(strLFN, card.longFilename[0] ? card.longFilename : card.filename, sizeof(strLFN));
 
-                    int iFTemp = iFileID - (i_print_page_id)*6;
+                    char sID[2] = {(char)('0' + iFileID - (i_print_page_id)*6), '\0'};
                     TLSTJC_print("select_file.tL");
-                    TLSTJC_print(String(iFTemp).c_str());
+                    TLSTJC_print(sID);
                     TLSTJC_print(".txt=\"");
-                    strLFN.toLowerCase();
-                    TLSTJC_print(strLFN.c_str());
+                    TLSTJC_print(strLFN);
                     TLSTJC_print("\"");
                     TLSTJC_printend();
 
                     TLSTJC_print("select_file.sL");
-                    TLSTJC_print(String(iFTemp).c_str());
+                    TLSTJC_print(sID);
                     TLSTJC_print(".txt=\"");
-                    TLSTJC_print(strFN.c_str());
+                    TLSTJC_print(strFN);
                     TLSTJC_print("\"");
                     TLSTJC_printend();
                 }
@@ -1020,7 +990,8 @@ void sdcard_tlcontroller_tjc()
     }
 
     TLSTJC_printconst(F("select_file.vPageID.val="));
-    TLSTJC_print(String(i_print_page_id).c_str());
+    char sPageID[7];
+    TLSTJC_print(itoa(i_print_page_id, sPageID, 10));
     TLSTJC_printend();
 
     if ((i_print_page_id + 1) * 6 >= iFileID)
@@ -3,6 +3,7 @@
 #define TL_TOUCH_SCREEN_H
 
 #include "Arduino.h"
+#include "SdFatConfig.h"
 
 //Setting for DWIN touch screen
 #define DWN_P_LOADING 21
@@ -55,11 +56,14 @@ void DWN_MessageBoxHandler(bool ISOK);
 void DWN_LED(int LED) ;
 void DWN_Get_Ver();
 void DWN_Page(int ID);
-void DWN_Text(long ID, int Len, String s, bool Center = false);
+void DWN_Text(long ID, int Len, const char *s, bool Center = false);
+void DWN_Text(long ID, int Len, const __FlashStringHelper *s, bool Center = false);
+inline void DWN_Text(long ID, int Len, const String &s, bool Center = false) { DWN_Text(ID, Len, s.c_str(), Center); }
 void DWN_Language(int ID);
 void DWN_Data(long ID, long Data, int DataLen);
 void process_command_dwn();
-void DWN_Message(int MsgID, String sMsg, bool PowerOff);
+void DWN_Message(int MsgID, const char *sMsg, bool PowerOff);
+inline void DWN_Message(int MsgID, const String &sMsg, bool PowerOff) { DWN_Message(MsgID, sMsg.c_str(), PowerOff); }
 void DWN_NORFData(long NorID, long ID, int Lenth, bool WR);
 void DWN_RData(long ID, int DataLen);
 void DWN_VClick(int X, int Y);
@@ -72,8 +76,8 @@ void Init_TLScreen_dwn();
 void CheckTempError_tjc();
 
 void TLSTJC_println(const char s[]);
-void TLSTJC_printconstln(const String s);
-void TLSTJC_printconst(const String s);
+void TLSTJC_printconstln(const __FlashStringHelper *s);
+void TLSTJC_printconst(const __FlashStringHelper *s);
 void TLSTJC_print(const char s[]);
 void TLSTJC_printend();
 void TLSTJC_printEmptyend();
@@ -89,14 +93,16 @@ void sdcard_tlcontroller_dwn();
 
 extern int i_print_page_id;
 extern bool b_is_last_page;
-extern String file_name_list[6];
-extern String file_name_long_list[6];
+extern char file_name_list[6][13];                   // 8.3 names of the files on the shown page, lower case
+extern char file_name_long_list[6][LONG_FILENAME_LENGTH];
 extern int iDWNPageID;
 static float feedrate = 1500.0, next_feedrate, saved_feedrate;
 
 extern int iPrintID;
-extern String gsM117;
-extern String gsPrinting;
+#define SCREEN_MESSAGE_LENGTH 32
+extern char gsM117[SCREEN_MESSAGE_LENGTH];
+extern char gsPrinting[SCREEN_MESSAGE_LENGTH];
+void set_printing_message(const char *sFileName);
 
 extern long dwn_command[255];
 extern bool bLogoGot;
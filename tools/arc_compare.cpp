@@ -0,0 +1,259 @@
+// Compares the arc segmentation of mc_arc() (motion_control.cpp) with fixed MM_PER_ARC_SEGMENT chords and
+// with the adaptive ARC_MAX_DEVIATION chords: segment count and the largest distance of the chords from the
+// true arc, for a range of radii and feedrates. The segment points are generated the way mc_arc() does, in
+// single precision like the AVR (small angle rotation with a correction every N_ARC_CORRECTION segments).
+// Given a G-code file, the G2/G3 moves of the file are compared instead (I/J centre offsets, as
+// get_arc_coordinates() reads them, at the F of the move and 100% feed multiplier).
+//
+// Build: g++ -O2 -o arc_compare arc_compare.cpp
+// Usage: arc_compare [-e <ARC_MAX_DEVIATION mm>] [-a <degrees of each arc>] [file.gcode]
+//        exits 1 if an adaptive arc deviates more than its limit allows
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Configuration_adv.h
+#define MM_PER_ARC_SEGMENT 1
+#define N_ARC_CORRECTION 25
+#define ARC_MIN_SEGMENT_MM 0.1
+#define ARC_MAX_SEGMENT_MM 10.0
+#define ARC_MIN_SEGMENT_TIME 10
+
+struct Point
+{
+    float x, y;
+};
+
+// Chord length mc_arc() uses, deviation <= 0 for fixed MM_PER_ARC_SEGMENT chords
+static float segment_length(float radius, float feed_rate, float deviation)
+{
+    if (deviation <= 0)
+        return MM_PER_ARC_SEGMENT;
+    float mm_per_arc_segment = (radius > deviation) ? 2 * sqrtf(deviation * (2 * radius - deviation)) : ARC_MAX_SEGMENT_MM;
+    mm_per_arc_segment = fmaxf(mm_per_arc_segment, feed_rate * (ARC_MIN_SEGMENT_TIME / 1000.0f));
+    return fminf(fmaxf(mm_per_arc_segment, ARC_MIN_SEGMENT_MM), ARC_MAX_SEGMENT_MM);
+}
+
+// The points mc_arc() hands to the planner for a counter clockwise arc around (0,0) starting at (radius,0).
+// linear_travel is the Z of a helix, it only lengthens the travel the segments are counted from.
+static std::vector<Point> arc_points(float radius, float angle, float feed_rate, float deviation, float linear_travel = 0)
+{
+    std::vector<Point> points;
+    float offset[2] = {-radius, 0};
+    float r_axis0 = -offset[0], r_axis1 = -offset[1];
+    points.push_back((Point){r_axis0, r_axis1});
+
+    float millimeters_of_travel = hypotf(angle * radius, fabsf(linear_travel));
+    float mm_per_arc_segment = segment_length(radius, feed_rate, deviation);
+    unsigned short segments = (deviation > 0) ? ceilf(millimeters_of_travel / mm_per_arc_segment) : floorf(millimeters_of_travel / mm_per_arc_segment);
+    if (segments == 0)
+        segments = 1;
+    float theta_per_segment = angle / segments;
+    float cos_T = 1 - 0.5f * theta_per_segment * theta_per_segment;
+    float sin_T = theta_per_segment;
+    if (deviation > 0 && fabsf(theta_per_segment) > 0.05f)
+    {
+        cos_T = cosf(theta_per_segment);
+        sin_T = sinf(theta_per_segment);
+    }
+    int count = 0;
+    for (unsigned short i = 1; i < segments; i++)
+    {
+        if (count < N_ARC_CORRECTION)
+        {
+            float r_axisi = r_axis0 * sin_T + r_axis1 * cos_T;
+            r_axis0 = r_axis0 * cos_T - r_axis1 * sin_T;
+            r_axis1 = r_axisi;
+            count++;
+        }
+        else
+        {
+            float cos_Ti = cosf(i * theta_per_segment);
+            float sin_Ti = sinf(i * theta_per_segment);
+            r_axis0 = -offset[0] * cos_Ti + offset[1] * sin_Ti;
+            r_axis1 = -offset[0] * sin_Ti - offset[1] * cos_Ti;
+            count = 0;
+        }
+        points.push_back((Point){r_axis0, r_axis1});
+    }
+    points.push_back((Point){radius * cosf(angle), radius * sinf(angle)});
+    return points;
+}
+
+// Largest distance between the chords and the arc: the radial error of the points and the sagitta of each
+// chord (distance of its middle from the arc)
+static double chord_error(const std::vector<Point> &points, double radius)
+{
+    double error = 0;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        error = fmax(error, fabs(hypot(points[i].x, points[i].y) - radius));
+        if (i == 0)
+            continue;
+        double mx = (points[i - 1].x + points[i].x) / 2.0, my = (points[i - 1].y + points[i].y) / 2.0;
+        error = fmax(error, fabs(radius - hypot(mx, my)));
+    }
+    return error;
+}
+
+// The deviation an adaptive arc may have: more than ARC_MAX_DEVIATION only where the chord was lengthened for
+// the minimum segment time or capped by ARC_MAX_SEGMENT_MM; allow for float rounding on top
+static double error_limit(float radius, float feed_rate, float deviation)
+{
+    double chord = segment_length(radius, feed_rate, deviation);
+    return fmax(deviation, radius - sqrt(fmax(0.0, (double)radius * radius - chord * chord / 4))) + 1e-4;
+}
+
+// Value of the word letter on the line, false if it's not there
+static bool word(const char *line, char letter, float &value)
+{
+    for (const char *p = line; *p && *p != ';'; p++)
+    {
+        if (*p == letter)
+        {
+            value = strtof(p + 1, NULL);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Replays the moves of a G-code file and compares every G2/G3 with both segmentations
+static int compare_file(const char *name, float deviation)
+{
+    FILE *in = fopen(name, "r");
+    if (!in)
+    {
+        fprintf(stderr, "can't open %s\n", name);
+        return 1;
+    }
+    float position[3] = {0, 0, 0};
+    float feedrate = 1500; // mm/min
+    bool relative = false;
+    unsigned long arcs = 0, fixed_segments = 0, adaptive_segments = 0, lineno = 0;
+    double fixed_worst = 0, adaptive_worst = 0;
+    int failed = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), in))
+    {
+        lineno++;
+        float g, v;
+        if (line[0] != 'G' || !word(line, 'G', g))
+            continue;
+        int code = (int)g;
+        if (code == 90 || code == 91)
+        {
+            relative = (code == 91);
+            continue;
+        }
+        if (code == 92)
+        {
+            for (int a = 0; a < 3; a++)
+                if (word(line, "XYZ"[a], v))
+                    position[a] = v;
+            continue;
+        }
+        if (code > 3)
+            continue;
+        float target[3];
+        for (int a = 0; a < 3; a++)
+            target[a] = word(line, "XYZ"[a], v) ? (relative ? position[a] + v : v) : position[a];
+        if (word(line, 'F', v) && v > 0)
+            feedrate = v;
+        if (code >= 2)
+        {
+            // prepare_arc_move() and the angle of mc_arc()
+            float offset[2] = {0, 0};
+            word(line, 'I', offset[0]);
+            word(line, 'J', offset[1]);
+            float radius = hypotf(offset[0], offset[1]);
+            float r_axis0 = -offset[0], r_axis1 = -offset[1];
+            float rt_axis0 = target[0] - (position[0] + offset[0]);
+            float rt_axis1 = target[1] - (position[1] + offset[1]);
+            float angular_travel = atan2f(r_axis0 * rt_axis1 - r_axis1 * rt_axis0, r_axis0 * rt_axis0 + r_axis1 * rt_axis1);
+            if (angular_travel < 0)
+                angular_travel += 2 * M_PI;
+            if (code == 2)
+                angular_travel -= 2 * M_PI;
+            float linear_travel = target[2] - position[2];
+            float feed_rate = feedrate / 60;
+            if (hypotf(angular_travel * radius, fabsf(linear_travel)) >= 0.001f)
+            {
+                // the chords of a clockwise arc are the mirror image of the counter clockwise ones
+                float angle = fabsf(angular_travel);
+                std::vector<Point> fixed = arc_points(radius, angle, feed_rate, 0, linear_travel);
+                std::vector<Point> adaptive = arc_points(radius, angle, feed_rate, deviation, linear_travel);
+                double fixed_error = chord_error(fixed, radius);
+                double adaptive_error = chord_error(adaptive, radius);
+                double limit = error_limit(radius, feed_rate, deviation);
+                if (adaptive_error > limit)
+                {
+                    if (failed++ < 10)
+                        fprintf(stderr, "%s:%lu: r %.3f, %.0f mm/s: deviation %.5f, limit %.5f\n", name, lineno, radius, feed_rate,
+                                adaptive_error, limit);
+                }
+                arcs++;
+                fixed_segments += fixed.size() - 1;
+                adaptive_segments += adaptive.size() - 1;
+                fixed_worst = fmax(fixed_worst, fixed_error);
+                adaptive_worst = fmax(adaptive_worst, adaptive_error);
+            }
+        }
+        memcpy(position, target, sizeof(position));
+    }
+    fclose(in);
+
+    printf("%s: %lu arcs, fixed %d mm chords vs ARC_MAX_DEVIATION %.3f mm\n", name, arcs, MM_PER_ARC_SEGMENT, deviation);
+    printf("%10s %10s %12s\n", "", "segments", "worst err");
+    printf("%10s %10lu %12.5f\n", "fixed", fixed_segments, fixed_worst);
+    printf("%10s %10lu %12.5f\n", "adaptive", adaptive_segments, adaptive_worst);
+    if (failed)
+        printf("%d arcs EXCEEDED the limit\n", failed);
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    float deviation = 0.01f; // ARC_MAX_DEVIATION
+    float degrees = 90;
+    const char *file = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+            deviation = atof(argv[++i]);
+        else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc)
+            degrees = atof(argv[++i]);
+        else
+            file = argv[i];
+    }
+    if (file)
+        return compare_file(file, deviation);
+
+    static const float radii[] = {0.5f, 1, 2, 5, 10, 25, 50, 100, 150};
+    static const float feedrates[] = {20, 60, 150}; // mm/s, as mc_arc() gets them
+    float angle = degrees * M_PI / 180.0f;
+
+    printf("%.0f degree arcs, fixed %d mm chords vs ARC_MAX_DEVIATION %.3f mm\n", degrees, MM_PER_ARC_SEGMENT, deviation);
+    printf("%8s %8s | %9s %11s | %9s %11s %11s\n", "radius", "mm/s", "fixed seg", "fixed err", "adapt seg", "adapt err", "limit");
+    int failed = 0;
+    for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); r++)
+    {
+        for (size_t f = 0; f < sizeof(feedrates) / sizeof(feedrates[0]); f++)
+        {
+            std::vector<Point> fixed = arc_points(radii[r], angle, feedrates[f], 0);
+            std::vector<Point> adaptive = arc_points(radii[r], angle, feedrates[f], deviation);
+            double fixed_error = chord_error(fixed, radii[r]);
+            double adaptive_error = chord_error(adaptive, radii[r]);
+            double limit = error_limit(radii[r], feedrates[f], deviation);
+            bool ok = adaptive_error <= limit;
+            if (!ok)
+                failed++;
+            printf("%8.1f %8.0f | %9zu %11.5f | %9zu %11.5f %11.5f%s\n", radii[r], feedrates[f], fixed.size() - 1, fixed_error,
+                   adaptive.size() - 1, adaptive_error, limit, ok ? "" : "  EXCEEDED");
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,637 @@
+// Streams G-code to the printer in BINARY_SERIAL frames (see Configuration_adv.h): every command becomes the
+// TLB1 record gcode2tlb stores for it, sent as 0xB5, sequence, length, record and CRC-16/XMODEM. Up to BUFSIZE
+// frames are in flight; "ok B<n>" retires the oldest, "rs B<n>" sends again from n, and without an answer for
+// a second the frames in flight are sent again (the printer drops the copies it already has). The first frame
+// after either goes out behind a newline: a frame whose sync byte was hit is read as text by get_command(),
+// and so is everything after it until the text line ends, so the newline puts the printer back between lines.
+//
+// -t runs the same sender against a copy of the firmware receiver over a BAUDRATE link that corrupts, drops and
+// duplicates frames: get_frame_byte() and the text path of get_command() (Marlin_main.cpp), the RX_BUFFER_SIZE
+// ring of MarlinSerial that loses bytes when full, and BUFSIZE command rows answered by ClearToSend() after a
+// random run time. A frame with a corrupted sync byte is read as a text line, as the firmware does; such lines
+// are counted, not checked. The records the receiver hands on must be those of the file, in order, and the
+// stream has to finish; exit status 1 if not.
+//
+// Build: g++ -O2 -o frame_sender frame_sender.cpp
+// Usage: frame_sender [-b baud] in.gcode /dev/ttyUSB0              stream a file to the printer
+//        frame_sender -t [-p probability] [-s seed] [in.gcode]     loopback test, each fault with probability
+//                                                                  p per frame (default 0.02)
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// Configuration_adv.h, Configuration_xy.h, Marlin_main.cpp, cardreader.h
+#define BUFSIZE 4
+#define MAX_CMD_SIZE 96
+#define RX_BUFFER_SIZE 128
+#define BAUDRATE 115200
+#define BINARY_SERIAL_SYNC 0xB5
+#define BINARY_GCODE_MOVE 0x01
+#define BINARY_GCODE_ASCII 0x80
+#define MAX_ASCII_LENGTH (MAX_CMD_SIZE - 5) // n + 2 record bytes, get_frame_byte() takes at most MAX_CMD_SIZE - 3
+
+static const char AXES[] = "XYZEF"; // order of the mask bits
+
+// gcode2tlb.cpp
+
+static std::string strip(const std::string &line)
+{
+    std::string s = line.substr(0, line.find(';'));
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos)
+        return "";
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+static bool parse_move(const std::string &cmd, unsigned char &mask, long values[5])
+{
+    const char *p = cmd.c_str();
+    if (p[0] != 'G' || (strncmp(p, "G1", 2) != 0 && strncmp(p, "G0", 2) != 0) || (p[2] != ' ' && p[2] != 0))
+        return false;
+    mask = 0;
+    p += 2;
+    while (*p)
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (!*p)
+            break;
+        const char *axis = strchr(AXES, *p);
+        if (!axis)
+            return false;
+        int bit = axis - AXES;
+        char *end;
+        double v = strtod(p + 1, &end);
+        if (end == p + 1 || (mask & (1 << bit)) || fabs(v) * 1000.0 > 2147483647.0)
+            return false;
+        mask |= 1 << bit;
+        values[bit] = lround(v * 1000.0);
+        p = end;
+        if (*p && *p != ' ' && *p != '\t')
+            return false;
+    }
+    return mask != 0;
+}
+
+static void put_long(std::string &out, long l)
+{
+    for (int i = 0; i < 4; i++)
+        out += (char)((unsigned long)l >> (8 * i));
+}
+
+static bool encode(const std::string &cmd, std::string &out)
+{
+    unsigned char mask;
+    long values[5];
+    if (parse_move(cmd, mask, values))
+    {
+        out += (char)mask;
+        for (int i = 0; i < 5; i++)
+            if (mask & (1 << i))
+                put_long(out, values[i]);
+        return true;
+    }
+    if (cmd.size() < 1 || cmd.size() > MAX_ASCII_LENGTH)
+        return false;
+    out += (char)BINARY_GCODE_ASCII;
+    out += (char)cmd.size();
+    out += cmd;
+    return true;
+}
+
+// _crc_xmodem_update() of avr-libc
+static uint16_t crc_xmodem_update(uint16_t crc, uint8_t data)
+{
+    crc ^= (uint16_t)data << 8;
+    for (int i = 0; i < 8; i++)
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    return crc;
+}
+
+static std::string make_frame(uint8_t seq, const std::string &record)
+{
+    std::string frame;
+    frame += (char)BINARY_SERIAL_SYNC;
+    frame += (char)seq;
+    frame += (char)record.size();
+    frame += record;
+    uint16_t crc = 0;
+    for (size_t i = 1; i < frame.size(); i++)
+        crc = crc_xmodem_update(crc, frame[i]);
+    frame += (char)(crc & 0xFF);
+    frame += (char)(crc >> 8);
+    return frame;
+}
+
+// The host side of the protocol
+struct Sender
+{
+    std::vector<std::string> records;
+    size_t acked; // records answered with "ok B"
+    size_t next;  // record the next frame carries
+    bool resync;  // end a text line the printer may be in before the next frame
+    unsigned long frames, resends, timeouts;
+
+    bool done() const { return acked == records.size(); }
+    bool can_send() const { return next < records.size() && next - acked < BUFSIZE; }
+    std::string send()
+    {
+        frames++;
+        size_t i = next++;
+        std::string frame = resync ? "\n" : "";
+        resync = false;
+        return frame + make_frame(i & 0xFF, records[i]);
+    }
+    // A line from the printer, anything but "ok B" and "rs B" is not for the sender
+    void answer(const char *line)
+    {
+        unsigned int seq;
+        if (sscanf(line, "ok B%u", &seq) == 1)
+        {
+            if (acked < next && seq == (acked & 0xFF))
+                acked++;
+        }
+        else if (sscanf(line, "rs B%u", &seq) == 1)
+        {
+            for (size_t i = acked; i <= next && i < records.size(); i++)
+                if ((i & 0xFF) == seq)
+                {
+                    next = i;
+                    resync = true;
+                    resends++;
+                    break;
+                }
+        }
+    }
+    void timeout()
+    {
+        next = acked;
+        resync = true;
+        timeouts++;
+    }
+};
+
+static bool read_records(const char *path, Sender &sender)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    char buf[1024];
+    unsigned long line = 0;
+    bool ok = true;
+    while (ok && fgets(buf, sizeof(buf), f))
+    {
+        line++;
+        std::string cmd = strip(buf), record;
+        if (cmd.empty())
+            continue;
+        ok = encode(cmd, record);
+        if (ok)
+            sender.records.push_back(record);
+        else
+            fprintf(stderr, "line %lu: can not be sent (longer than %d characters?): %s\n", line, MAX_ASCII_LENGTH, cmd.c_str());
+    }
+    fclose(f);
+    return ok;
+}
+
+// The printer side: a copy of get_frame_byte() and the text path of get_command() over MarlinSerial's ring
+struct Receiver
+{
+    unsigned char rx[RX_BUFFER_SIZE];
+    unsigned int rx_head, rx_tail;
+    unsigned long rx_lost;
+
+    char cmdbuffer[BUFSIZE][MAX_CMD_SIZE];
+    int16_t frame_seq[BUFSIZE];
+    int bufindw, bufindr, buflen;
+    int serial_count;
+    bool comment_mode;
+    uint8_t frame_pos, frame_len, frame_seq_rx, frame_next_seq;
+    uint16_t frame_crc;
+    bool frame_resend;
+    std::deque<std::string> answers;
+
+    // store_char() of the RX interrupt
+    void store_char(unsigned char c)
+    {
+        unsigned int i = (rx_head + 1) % RX_BUFFER_SIZE;
+        if (i == rx_tail)
+        {
+            rx_lost++;
+            return;
+        }
+        rx[rx_head] = c;
+        rx_head = i;
+    }
+
+    void get_frame_byte(uint8_t c)
+    {
+        char *row = cmdbuffer[bufindw];
+        uint8_t pos = frame_pos++;
+        if (pos == 0)
+        {
+            if (c != BINARY_SERIAL_SYNC)
+                frame_pos = 0;
+            frame_crc = 0;
+            return;
+        }
+        if (pos < 3 + frame_len)
+            frame_crc = crc_xmodem_update(frame_crc, c);
+        if (pos == 1)
+            frame_seq_rx = c;
+        else if (pos == 2)
+        {
+            frame_len = c;
+            if (c == 0 || c > MAX_CMD_SIZE - 3)
+                frame_pos = 0;
+        }
+        else if (pos < 3 + frame_len)
+            row[2 + pos - 3] = c;
+        else if (pos == 3 + frame_len)
+            frame_crc ^= c;
+        else
+        {
+            frame_pos = 0;
+            frame_crc ^= (uint16_t)c << 8;
+        }
+        if (frame_pos != 0)
+            return;
+
+        bool ok = frame_len != 0 && frame_len <= MAX_CMD_SIZE - 3 && frame_crc == 0;
+        if (ok && frame_seq_rx != frame_next_seq)
+        {
+            if ((uint8_t)(frame_next_seq - frame_seq_rx) <= BUFSIZE)
+                return;
+            ok = false;
+        }
+        if (ok)
+        {
+            uint8_t type = row[2];
+            if (type < 0x20)
+            {
+                uint8_t fields = 0;
+                for (uint8_t m = type; m; m >>= 1)
+                    fields += m & 1;
+                ok = frame_len == 1 + fields * 4; // sizeof(long) on the AVR
+                row[0] = BINARY_GCODE_MOVE;
+                row[1] = 0;
+            }
+            else if (type == BINARY_GCODE_ASCII)
+            {
+                uint8_t n = row[3];
+                ok = n != 0 && frame_len == n + 2;
+                if (ok)
+                {
+                    memmove(row, row + 4, n);
+                    row[n] = 0;
+                }
+            }
+            else
+                ok = false;
+        }
+        if (!ok)
+        {
+            if (!frame_resend)
+            {
+                frame_resend = true;
+                char line[16];
+                snprintf(line, sizeof(line), "rs B%d", frame_next_seq);
+                answers.push_back(line);
+            }
+            return;
+        }
+        frame_resend = false;
+        frame_seq[bufindw] = frame_next_seq++;
+        bufindw = (bufindw + 1) % BUFSIZE;
+        buflen += 1;
+    }
+
+    // Line numbers and checksums of text lines are not checked, a text line always takes a row
+    void get_command()
+    {
+        while (rx_head != rx_tail && buflen < BUFSIZE)
+        {
+            unsigned char serial_char = rx[rx_tail];
+            rx_tail = (rx_tail + 1) % RX_BUFFER_SIZE;
+            if (frame_pos != 0 || frame_resend || (serial_count == 0 && !comment_mode && serial_char == BINARY_SERIAL_SYNC))
+            {
+                get_frame_byte(serial_char);
+                continue;
+            }
+            if (serial_char == '\n' || serial_char == '\r' || (serial_char == ':' && !comment_mode) || serial_count >= MAX_CMD_SIZE - 1)
+            {
+                if (!serial_count)
+                {
+                    comment_mode = false;
+                    return;
+                }
+                cmdbuffer[bufindw][serial_count] = 0;
+                if (!comment_mode)
+                {
+                    frame_seq[bufindw] = -1;
+                    bufindw = (bufindw + 1) % BUFSIZE;
+                    buflen += 1;
+                }
+                comment_mode = false;
+                serial_count = 0;
+            }
+            else
+            {
+                if (serial_char == ';')
+                    comment_mode = true;
+                if (!comment_mode)
+                    cmdbuffer[bufindw][serial_count++] = serial_char;
+            }
+        }
+    }
+
+    // Runs the oldest command and answers it like ClearToSend(). The record of a frame goes to record,
+    // false for a text line.
+    bool run_command(std::string &record)
+    {
+        const char *row = cmdbuffer[bufindr];
+        int16_t seq = frame_seq[bufindr];
+        bool frame = seq >= 0;
+        record.clear();
+        if (frame && row[0] == BINARY_GCODE_MOVE)
+        {
+            uint8_t type = row[2], fields = 0;
+            for (uint8_t m = type; m; m >>= 1)
+                fields += m & 1;
+            record.assign(row + 2, 1 + fields * 4);
+        }
+        else if (frame)
+        {
+            record += (char)BINARY_GCODE_ASCII;
+            record += (char)strlen(row);
+            record += row;
+        }
+        char line[16];
+        if (frame)
+            snprintf(line, sizeof(line), "ok B%d", seq);
+        else
+            snprintf(line, sizeof(line), "ok");
+        answers.push_back(line);
+        bufindr = (bufindr + 1) % BUFSIZE;
+        buflen -= 1;
+        return frame;
+    }
+};
+
+static const char *const TEST_LINES[] = {
+    "G28",
+    "M104 S210",
+    "G1 X10 Y20.5 F3000",
+    "G0 X-0.001 Y123.4567",
+    "G1 E-2.5 F2400",
+    "G1 Z0.3",
+    "G1 X1 Y2 Z3 E4 F5",
+    "M117 A message long enough to fill most of a command buffer row, to see the RX ring fill up",
+    "G92 E0",
+    "T1",
+};
+
+// The sender and the receiver over a link of one byte per tick (a byte time at BAUDRATE)
+static int loopback(Sender &sender, double p, unsigned int seed)
+{
+    srand(seed);
+    if (sender.records.empty())
+        for (int r = 0; r < 200; r++)
+            for (size_t i = 0; i < sizeof(TEST_LINES) / sizeof(TEST_LINES[0]); i++)
+            {
+                std::string record;
+                encode(TEST_LINES[i], record);
+                sender.records.push_back(record);
+            }
+
+    Receiver rcv = Receiver();
+    const unsigned long ticks_per_s = BAUDRATE / 10;
+    std::string wire;            // bytes on their way to the printer
+    std::deque<std::string> back; // answers on their way to the host
+    unsigned long back_busy = 0;  // ticks until the line to the host is free
+    unsigned long run_left = 0;   // ticks until the oldest command has run
+    unsigned long last_answer = 0, tick = 0;
+    unsigned long limit = (sender.records.size() + 100) * 2 * ticks_per_s / 10;
+    unsigned long dropped = 0, corrupted = 0, duplicated = 0, text_lines = 0, mismatches = 0;
+    size_t delivered = 0;
+
+    while (!sender.done() && tick < limit)
+    {
+        tick++;
+        // host: answers, time out, next frame when the wire is idle
+        while (!back.empty() && back_busy == 0)
+        {
+            sender.answer(back.front().c_str());
+            last_answer = tick;
+            back_busy = back.front().size() + 1;
+            back.pop_front();
+        }
+        if (back_busy)
+            back_busy--;
+        if (tick - last_answer > ticks_per_s && sender.acked < sender.next)
+        {
+            sender.timeout();
+            last_answer = tick;
+        }
+        if (wire.empty() && sender.can_send())
+        {
+            std::string frame = sender.send();
+            double r = rand() / (RAND_MAX + 1.0);
+            if (r < p)
+                dropped++;
+            else if (r < 2 * p)
+            {
+                size_t i = rand() % frame.size();
+                frame[i] ^= 1 << (rand() % 8);
+                wire += frame;
+                corrupted++;
+            }
+            else if (r < 3 * p)
+            {
+                wire += frame + frame;
+                duplicated++;
+            }
+            else
+                wire += frame;
+        }
+
+        // printer: one byte arrives, get_command(), the oldest command runs
+        if (!wire.empty())
+        {
+            rcv.store_char(wire[0]);
+            wire.erase(0, 1);
+        }
+        rcv.get_command();
+        if (rcv.buflen > 0)
+        {
+            if (run_left == 0)
+                run_left = 1 + rand() % (ticks_per_s / 50); // up to 20ms, a move waiting for the planner
+            else if (--run_left == 0)
+            {
+                std::string record;
+                if (!rcv.run_command(record))
+                    text_lines++;
+                else if (delivered >= sender.records.size() || record != sender.records[delivered++])
+                {
+                    if (mismatches++ < 10)
+                        fprintf(stderr, "record %zu differs from the one sent\n", delivered - 1);
+                }
+            }
+        }
+        while (!rcv.answers.empty())
+        {
+            back.push_back(rcv.answers.front());
+            rcv.answers.pop_front();
+        }
+    }
+
+    bool finished = sender.done() && delivered == sender.records.size();
+    printf("%zu records in %lu frames, %.1f s at %d baud\n", sender.records.size(), sender.frames, (double)tick / ticks_per_s, BAUDRATE);
+    printf("injected: %lu dropped, %lu corrupted, %lu duplicated\n", dropped, corrupted, duplicated);
+    printf("recovered: %lu rs B, %lu timeouts, %lu bytes lost in the RX ring, %lu text lines from bad sync bytes\n",
+           sender.resends, sender.timeouts, rcv.rx_lost, text_lines);
+    if (!finished)
+        printf("stream did not finish: %zu of %zu records delivered\n", delivered, sender.records.size());
+    printf("%s\n", (finished && !mismatches) ? "loopback ok" : "FAILED");
+    return (finished && !mismatches) ? 0 : 1;
+}
+
+static speed_t baud_constant(long baud)
+{
+    switch (baud)
+    {
+    case 57600:
+        return B57600;
+    case 115200:
+        return B115200;
+    case 230400:
+        return B230400;
+    default:
+        return 0;
+    }
+}
+
+static double now_s()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int stream(Sender &sender, const char *port, long baud)
+{
+    speed_t speed = baud_constant(baud);
+    if (!speed)
+    {
+        fprintf(stderr, "unsupported baud rate %ld\n", baud);
+        return 1;
+    }
+    int fd = open(port, O_RDWR | O_NOCTTY);
+    termios tio;
+    if (fd < 0 || tcgetattr(fd, &tio) != 0)
+    {
+        fprintf(stderr, "cannot open %s\n", port);
+        return 1;
+    }
+    cfmakeraw(&tio);
+    cfsetspeed(&tio, speed);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 1; // reads return after 100ms without data
+    tcsetattr(fd, TCSANOW, &tio);
+
+    std::string line;
+    double last_answer = now_s();
+    while (!sender.done())
+    {
+        while (sender.can_send())
+        {
+            std::string frame = sender.send();
+            if (write(fd, frame.data(), frame.size()) != (ssize_t)frame.size())
+            {
+                fprintf(stderr, "write to %s failed\n", port);
+                close(fd);
+                return 1;
+            }
+        }
+        char buf[64];
+        ssize_t n = read(fd, buf, sizeof(buf));
+        for (ssize_t i = 0; i < n; i++)
+        {
+            if (buf[i] == '\n' || buf[i] == '\r')
+            {
+                if (!line.empty())
+                {
+                    sender.answer(line.c_str());
+                    if (line.compare(0, 4, "ok B") != 0)
+                        fprintf(stderr, "%s\n", line.c_str());
+                }
+                line.clear();
+                last_answer = now_s();
+            }
+            else
+                line += buf[i];
+        }
+        if (now_s() - last_answer > 1.0 && sender.acked < sender.next)
+        {
+            sender.timeout();
+            last_answer = now_s();
+        }
+    }
+    close(fd);
+    printf("%zu records in %lu frames, %lu rs B, %lu timeouts\n", sender.records.size(), sender.frames, sender.resends, sender.timeouts);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    bool test = false;
+    double p = 0.02;
+    unsigned int seed = 1;
+    long baud = BAUDRATE;
+    std::vector<const char *> files;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0)
+            test = true;
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            p = atof(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            seed = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            baud = atol(argv[++i]);
+        else
+            files.push_back(argv[i]);
+    }
+
+    Sender sender = Sender();
+    if (test)
+    {
+        if (!files.empty() && !read_records(files[0], sender))
+            return 1;
+        return loopback(sender, p, seed);
+    }
+    if (files.size() != 2)
+    {
+        fprintf(stderr, "usage: %s [-b baud] in.gcode port | -t [-p probability] [-s seed] [in.gcode]\n", argv[0]);
+        return 1;
+    }
+    if (!read_records(files[0], sender))
+        return 1;
+    return stream(sender, files[1], baud);
+}
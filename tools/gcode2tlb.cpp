@@ -0,0 +1,317 @@
+// Converts text G-code to the binary "TLB1" format the firmware prints with BINARY_GCODE
+// (see Configuration_adv.h and CardReader::getBinaryCommand()) and back.
+//
+// Build: g++ -O2 -o gcode2tlb gcode2tlb.cpp
+// Usage: gcode2tlb in.gcode out.tlb   text to binary
+//        gcode2tlb -d in.tlb out.gcode  binary to text
+//        gcode2tlb -t [in.gcode]      round trip test: converts the file (or built in lines) to binary and
+//                                     back and checks every command comes out the same, exit status 1 if not
+//
+// G0/G1 lines with nothing but X Y Z E F words become move records, everything else is stored as text
+// without comment. Move values are rounded to 1/1000 mm (mm/min for F), as the firmware reads them.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define BINARY_GCODE_MAGIC "TLB1"
+#define BINARY_GCODE_ASCII 0x80
+#define MAX_ASCII_LENGTH 95 // MAX_CMD_SIZE - 1, the firmware row also needs the terminator
+
+static const char AXES[] = "XYZEF"; // order of the mask bits
+
+// Text without comment and surrounding blanks
+static std::string strip(const std::string &line)
+{
+    std::string s = line.substr(0, line.find(';'));
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos)
+        return "";
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+// A G0/G1 command with only axis words; mask and values in 1/1000 units
+static bool parse_move(const std::string &cmd, unsigned char &mask, long values[5])
+{
+    const char *p = cmd.c_str();
+    if (p[0] != 'G' || (strncmp(p, "G1", 2) != 0 && strncmp(p, "G0", 2) != 0) || (p[2] != ' ' && p[2] != 0))
+        return false;
+    mask = 0;
+    p += 2;
+    while (*p)
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (!*p)
+            break;
+        const char *axis = strchr(AXES, *p);
+        if (!axis)
+            return false;
+        int bit = axis - AXES;
+        char *end;
+        double v = strtod(p + 1, &end);
+        if (end == p + 1 || (mask & (1 << bit)) || fabs(v) * 1000.0 > 2147483647.0)
+            return false;
+        mask |= 1 << bit;
+        values[bit] = lround(v * 1000.0);
+        p = end;
+        if (*p && *p != ' ' && *p != '\t')
+            return false;
+    }
+    return mask != 0;
+}
+
+static void put_long(std::string &out, long l)
+{
+    for (int i = 0; i < 4; i++)
+        out += (char)((unsigned long)l >> (8 * i));
+}
+
+// Appends the record of one command, false if it can not be stored
+static bool encode(const std::string &cmd, std::string &out)
+{
+    unsigned char mask;
+    long values[5];
+    if (parse_move(cmd, mask, values))
+    {
+        out += (char)mask;
+        for (int i = 0; i < 5; i++)
+            if (mask & (1 << i))
+                put_long(out, values[i]);
+        return true;
+    }
+    if (cmd.size() < 1 || cmd.size() > MAX_ASCII_LENGTH)
+        return false;
+    out += (char)BINARY_GCODE_ASCII;
+    out += (char)cmd.size();
+    out += cmd;
+    return true;
+}
+
+static bool encode_file(const std::vector<std::string> &lines, std::string &out)
+{
+    out = BINARY_GCODE_MAGIC;
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        std::string cmd = strip(lines[i]);
+        if (cmd.empty())
+            continue;
+        if (!encode(cmd, out))
+        {
+            fprintf(stderr, "line %zu: can not be stored (longer than %d characters?): %s\n", i + 1, MAX_ASCII_LENGTH, cmd.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads records the way CardReader::getBinaryCommand() does
+static bool decode_file(const std::string &in, std::vector<std::string> &cmds)
+{
+    if (in.compare(0, 4, BINARY_GCODE_MAGIC) != 0)
+        return false;
+    size_t pos = 4;
+    while (pos < in.size())
+    {
+        unsigned char type = in[pos++];
+        if (type == BINARY_GCODE_ASCII)
+        {
+            if (pos >= in.size())
+                return false;
+            unsigned char n = in[pos++];
+            if (n == 0 || n > MAX_ASCII_LENGTH || pos + n > in.size())
+                return false;
+            cmds.push_back(in.substr(pos, n));
+            pos += n;
+        }
+        else if (type < 0x20)
+        {
+            std::string cmd = "G1";
+            for (int i = 0; i < 5; i++)
+            {
+                if (!(type & (1 << i)))
+                    continue;
+                if (pos + 4 > in.size())
+                    return false;
+                unsigned long u = 0;
+                for (int b = 0; b < 4; b++)
+                    u |= (unsigned long)(unsigned char)in[pos++] << (8 * b);
+                long l = (long)(int)u;
+                char text[24];
+                snprintf(text, sizeof(text), " %c%s%ld.%03ld", AXES[i], l < 0 ? "-" : "", labs(l) / 1000, labs(l) % 1000);
+                cmd += text;
+            }
+            cmds.push_back(cmd);
+        }
+        else
+            return false;
+    }
+    return true;
+}
+
+// Same command: moves by value at the stored precision, the rest by text
+static bool same(const std::string &a, const std::string &b)
+{
+    unsigned char ma, mb;
+    long va[5], vb[5];
+    bool move_a = parse_move(a, ma, va), move_b = parse_move(b, mb, vb);
+    if (move_a != move_b)
+        return false;
+    if (!move_a)
+        return a == b;
+    if (ma != mb)
+        return false;
+    for (int i = 0; i < 5; i++)
+        if ((ma & (1 << i)) && va[i] != vb[i])
+            return false;
+    return true;
+}
+
+static int round_trip(const std::vector<std::string> &lines)
+{
+    std::string bin;
+    if (!encode_file(lines, bin))
+        return 1;
+    std::vector<std::string> cmds;
+    if (!decode_file(bin, cmds))
+    {
+        fprintf(stderr, "binary output does not decode\n");
+        return 1;
+    }
+    size_t n = 0, moves = 0, text_bytes = 0, errors = 0;
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        std::string cmd = strip(lines[i]);
+        if (cmd.empty())
+            continue;
+        text_bytes += cmd.size() + 1;
+        unsigned char mask;
+        long values[5];
+        if (parse_move(cmd, mask, values))
+            moves++;
+        if (n >= cmds.size() || !same(cmd, cmds[n]))
+        {
+            fprintf(stderr, "line %zu: %s came back as %s\n", i + 1, cmd.c_str(), n < cmds.size() ? cmds[n].c_str() : "nothing");
+            errors++;
+        }
+        n++;
+    }
+    if (n != cmds.size())
+    {
+        fprintf(stderr, "%zu commands in, %zu out\n", n, cmds.size());
+        errors++;
+    }
+    printf("%zu commands, %zu moves, %zu text bytes, %zu binary bytes, %s\n", n, moves, text_bytes, bin.size(),
+           errors ? "FAILED" : "round trip ok");
+    return errors ? 1 : 0;
+}
+
+static const char *const TEST_LINES[] = {
+    "; comment only",
+    "G28",
+    "M104 S210 ; set temperature",
+    "G1 X10 Y20.5 F3000",
+    "G0 X-0.001 Y123.4567",
+    "G1 E-2.5 F2400",
+    "G1 Z0.3",
+    "G1 X1 Y2 Z3 E4 F5",
+    "G1 X100 Y100 R2",   // R is only understood as text
+    "G1 X5 S1",
+    "G1",
+    "G92 E0",
+    "   G1 X0.0005   ",
+    "M117 Printing...",
+    "T1",
+    "G10",
+    "G1 X-2147483.647",
+};
+
+static bool read_lines(const char *path, std::vector<std::string> &lines)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    char buf[1024];
+    while (fgets(buf, sizeof(buf), f))
+        lines.push_back(buf);
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> lines;
+    if (argc >= 2 && strcmp(argv[1], "-t") == 0)
+    {
+        if (argc >= 3)
+        {
+            if (!read_lines(argv[2], lines))
+            {
+                fprintf(stderr, "cannot open %s\n", argv[2]);
+                return 2;
+            }
+        }
+        else
+            lines.assign(TEST_LINES, TEST_LINES + sizeof(TEST_LINES) / sizeof(TEST_LINES[0]));
+        return round_trip(lines);
+    }
+
+    bool decode = argc == 4 && strcmp(argv[1], "-d") == 0;
+    if (argc != 3 && !decode)
+    {
+        fprintf(stderr, "usage: %s in.gcode out.tlb | -d in.tlb out.gcode | -t [in.gcode]\n", argv[0]);
+        return 2;
+    }
+    const char *in_path = argv[argc - 2], *out_path = argv[argc - 1];
+    FILE *in = fopen(in_path, "rb");
+    if (!in)
+    {
+        fprintf(stderr, "cannot open %s\n", in_path);
+        return 2;
+    }
+    std::string data;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+        data.append(buf, n);
+    fclose(in);
+
+    std::string out;
+    if (decode)
+    {
+        std::vector<std::string> cmds;
+        if (!decode_file(data, cmds))
+        {
+            fprintf(stderr, "%s is not a valid TLB1 file\n", in_path);
+            return 1;
+        }
+        for (size_t i = 0; i < cmds.size(); i++)
+            out += cmds[i] + "\n";
+    }
+    else
+    {
+        size_t start = 0;
+        while (start < data.size())
+        {
+            size_t end = data.find('\n', start);
+            if (end == std::string::npos)
+                end = data.size();
+            lines.push_back(data.substr(start, end - start));
+            start = end + 1;
+        }
+        if (!encode_file(lines, out))
+            return 1;
+    }
+    FILE *f = fopen(out_path, "wb");
+    if (!f || fwrite(out.data(), 1, out.size(), f) != out.size())
+    {
+        fprintf(stderr, "cannot write %s\n", out_path);
+        return 2;
+    }
+    fclose(f);
+    return 0;
+}
@@ -0,0 +1,84 @@
+// Pre-pass for PRINT_TIME_ESTIMATE: plans a G-code file with the planner of planner.cpp (planner_model.h, the
+// block set-up planner_compare checks) and adds up the duration_us of the trapezoids the way the stepper does
+// in plan_discard_current_block(). The result goes in front of the file as M1047 S<seconds>, which the printer
+// takes as the move time of the whole file; an M1047 S line already at the top is replaced.
+//
+// Dwells, heating and tool changes are not move time and are not counted, as on the printer. The planner
+// settings have to be those of the printer (M201/M203/M204/M205 and M92 are not read from the file).
+//
+// Build: g++ -O2 -o gcode_estimate gcode_estimate.cpp
+// Usage: gcode_estimate [-a <acceleration>] [-j <XY jerk>] in.gcode [out.gcode]
+//        without out.gcode the M1047 line is printed; exit status 1 if a file can't be read or written
+
+#include "planner_model.h"
+
+static unsigned long seconds, us, blocks;
+
+static void add_block(const Block &block)
+{
+    us += block.duration_us;
+    while (us >= 1000000)
+    {
+        us -= 1000000;
+        seconds++;
+    }
+    blocks++;
+}
+
+int main(int argc, char **argv)
+{
+    const char *in_path = NULL, *out_path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-a") == 0 && i + 1 < argc)
+            acceleration = atof(argv[++i]);
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            max_xy_jerk = atof(argv[++i]);
+        else if (!in_path)
+            in_path = argv[i];
+        else
+            out_path = argv[i];
+    }
+    if (!in_path)
+    {
+        fprintf(stderr, "usage: %s [-a acceleration] [-j xy jerk] in.gcode [out.gcode]\n", argv[0]);
+        return 1;
+    }
+
+    plan_init();
+    block_done = add_block;
+    if (!plan_file(in_path))
+    {
+        fprintf(stderr, "cannot open %s\n", in_path);
+        return 1;
+    }
+    fprintf(stderr, "%lu blocks, %lu:%02lu:%02lu of moves\n", blocks, seconds / 3600, seconds / 60 % 60, seconds % 60);
+    if (!out_path)
+    {
+        printf("M1047 S%lu\n", seconds);
+        return 0;
+    }
+
+    FILE *in = fopen(in_path, "rb");
+    FILE *out = fopen(out_path, "wb");
+    if (!in || !out)
+    {
+        fprintf(stderr, "cannot write %s\n", out_path);
+        return 1;
+    }
+    fprintf(out, "M1047 S%lu\n", seconds);
+    char line[256];
+    bool first = true;
+    while (fgets(line, sizeof(line), in))
+    {
+        if (first && strncmp(line, "M1047 S", 7) == 0)
+        {
+            first = false;
+            continue;
+        }
+        first = false;
+        fputs(line, out);
+    }
+    fclose(in);
+    return fclose(out) == 0 ? 0 : 1;
+}
@@ -0,0 +1,402 @@
+// Replays a G-code file through the block set-up of plan_buffer_line() (planner.cpp) twice: as it was before
+// the reciprocal steps/mm change and as it is now, and compares every block. Step counts, direction bits and
+// step_event_count have to be identical; nominal_rate and acceleration_st may differ by one where the float
+// in front of ceil() lands on the other side of an integer; the float fields have to agree within -t (plus
+// the one step/s^2 for the fields that follow acceleration_st).
+//
+// All arithmetic is single precision with float literals, as avr-gcc does with double == float, so the
+// results are those of the printer as long as the host rounds like the AVR float library (IEEE single, round
+// to nearest for + - * / and sqrt). The full buffer case is replayed (moves_queued > BLOCK_BUFFER_SIZE / 2, no
+// SLOWDOWN), with the default Configuration_tenlog.h / Configuration_xy.h machine.
+//
+// Build: g++ -O2 -o planner_compare planner_compare.cpp
+// Usage: planner_compare [-t <relative float tolerance, default 1e-5>] file.gcode
+//        exit status 1 on an integer mismatch or a float outside the tolerance
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define NUM_AXIS 4
+#define X_AXIS 0
+#define Y_AXIS 1
+#define Z_AXIS 2
+#define E_AXIS 3
+#define F_CPU 16000000.0f
+#define MINIMUM_PLANNER_SPEED 0.05f
+static const unsigned int dropsegments = 5;
+
+static float axis_steps_per_unit[NUM_AXIS] = {80, 80, 800, 395};
+static float max_feedrate[NUM_AXIS] = {70, 70, 6, 25};
+static unsigned long max_acceleration_units_per_sq_second[NUM_AXIS] = {500, 500, 100, 1000};
+static unsigned long axis_steps_per_sqr_second[NUM_AXIS];
+static float acceleration = 500, retract_acceleration = 500;
+static float max_xy_jerk = 10.0f, max_z_jerk = 0.3f, max_e_jerk = 5.0f;
+static float minimumfeedrate = 0, mintravelfeedrate = 0;
+static int extrudemultiply = 100;
+
+static float square(float x) { return x * x; }
+
+struct Block
+{
+    long steps_x, steps_y, steps_z, steps_e;
+    unsigned long step_event_count, nominal_rate, acceleration_st, acceleration_rate;
+    unsigned char direction_bits;
+    float millimeters, nominal_speed, acceleration, max_entry_speed, entry_speed;
+};
+
+struct Planner
+{
+    long position[NUM_AXIS];
+    float previous_speed[NUM_AXIS];
+    float previous_nominal_speed;
+    float mm_per_step[NUM_AXIS], mm_per_step_of[NUM_AXIS];
+};
+
+static float max_allowable_speed(float acceleration, float target_velocity, float distance)
+{
+    return sqrtf(target_velocity * target_velocity - 2 * acceleration * distance);
+}
+
+// What both versions share: step counts and direction bits before, speed limits and jerk after
+static bool steps(Planner &p, const float *xyze, long *target, long *delta, Block &b)
+{
+    for (int i = 0; i < NUM_AXIS; i++)
+    {
+        target[i] = lroundf(xyze[i] * axis_steps_per_unit[i]);
+        delta[i] = target[i] - p.position[i];
+    }
+    b.steps_x = labs(delta[X_AXIS]);
+    b.steps_y = labs(delta[Y_AXIS]);
+    b.steps_z = labs(delta[Z_AXIS]);
+    b.steps_e = labs(delta[E_AXIS]) * extrudemultiply / 100;
+    b.step_event_count = std::max(b.steps_x, std::max(b.steps_y, std::max(b.steps_z, b.steps_e)));
+    if (b.step_event_count <= dropsegments)
+        return false;
+    b.direction_bits = 0;
+    for (int i = 0; i < NUM_AXIS; i++)
+        if (delta[i] < 0)
+            b.direction_bits |= 1 << i;
+    return true;
+}
+
+// planner.cpp before: divides by axis_steps_per_unit and step_event_count, pow() for the XY jerk
+static bool plan_before(Planner &p, const float *xyze, float feed_rate, Block &b)
+{
+    long target[NUM_AXIS], delta[NUM_AXIS];
+    if (!steps(p, xyze, target, delta, b))
+        return false;
+    if (b.steps_e == 0)
+        feed_rate = std::max(feed_rate, mintravelfeedrate);
+    else
+        feed_rate = std::max(feed_rate, minimumfeedrate);
+
+    float delta_mm[4];
+    delta_mm[X_AXIS] = (target[X_AXIS] - p.position[X_AXIS]) / axis_steps_per_unit[X_AXIS];
+    delta_mm[Y_AXIS] = (target[Y_AXIS] - p.position[Y_AXIS]) / axis_steps_per_unit[Y_AXIS];
+    delta_mm[Z_AXIS] = (target[Z_AXIS] - p.position[Z_AXIS]) / axis_steps_per_unit[Z_AXIS];
+    delta_mm[E_AXIS] = ((target[E_AXIS] - p.position[E_AXIS]) / axis_steps_per_unit[E_AXIS]) * extrudemultiply / 100.0f;
+    if (b.steps_x <= (long)dropsegments && b.steps_y <= (long)dropsegments && b.steps_z <= (long)dropsegments)
+        b.millimeters = fabsf(delta_mm[E_AXIS]);
+    else
+        b.millimeters = sqrtf(square(delta_mm[X_AXIS]) + square(delta_mm[Y_AXIS]) + square(delta_mm[Z_AXIS]));
+    float inverse_millimeters = 1.0f / b.millimeters;
+    float inverse_second = feed_rate * inverse_millimeters;
+
+    b.nominal_speed = b.millimeters * inverse_second;
+    b.nominal_rate = ceilf(b.step_event_count * inverse_second);
+    float current_speed[4];
+    float speed_factor = 1.0f;
+    for (int i = 0; i < 4; i++)
+    {
+        current_speed[i] = delta_mm[i] * inverse_second;
+        if (fabsf(current_speed[i]) > max_feedrate[i])
+            speed_factor = std::min(speed_factor, max_feedrate[i] / fabsf(current_speed[i]));
+    }
+    if (speed_factor < 1.0f)
+    {
+        for (int i = 0; i < 4; i++)
+            current_speed[i] *= speed_factor;
+        b.nominal_speed *= speed_factor;
+        b.nominal_rate *= speed_factor;
+    }
+
+    float steps_per_mm = b.step_event_count / b.millimeters;
+    if (b.steps_x == 0 && b.steps_y == 0 && b.steps_z == 0)
+        b.acceleration_st = ceilf(retract_acceleration * steps_per_mm);
+    else
+    {
+        b.acceleration_st = ceilf(acceleration * steps_per_mm);
+        if (((float)b.acceleration_st * (float)b.steps_x / (float)b.step_event_count) > axis_steps_per_sqr_second[X_AXIS])
+            b.acceleration_st = axis_steps_per_sqr_second[X_AXIS];
+        if (((float)b.acceleration_st * (float)b.steps_y / (float)b.step_event_count) > axis_steps_per_sqr_second[Y_AXIS])
+            b.acceleration_st = axis_steps_per_sqr_second[Y_AXIS];
+        if (((float)b.acceleration_st * (float)b.steps_e / (float)b.step_event_count) > axis_steps_per_sqr_second[E_AXIS])
+            b.acceleration_st = axis_steps_per_sqr_second[E_AXIS];
+        if (((float)b.acceleration_st * (float)b.steps_z / (float)b.step_event_count) > axis_steps_per_sqr_second[Z_AXIS])
+            b.acceleration_st = axis_steps_per_sqr_second[Z_AXIS];
+    }
+    b.acceleration = b.acceleration_st / steps_per_mm;
+    b.acceleration_rate = (long)((float)b.acceleration_st * (16777216.0f / (F_CPU / 8.0f)));
+
+    float vmax_junction = max_xy_jerk / 2;
+    float vmax_junction_factor = 1.0f;
+    if (fabsf(current_speed[Z_AXIS]) > max_z_jerk / 2)
+        vmax_junction = std::min(vmax_junction, max_z_jerk / 2);
+    if (fabsf(current_speed[E_AXIS]) > max_e_jerk / 2)
+        vmax_junction = std::min(vmax_junction, max_e_jerk / 2);
+    vmax_junction = std::min(vmax_junction, b.nominal_speed);
+    if (p.previous_nominal_speed > 0.0001f)
+    {
+        float jerk = sqrtf(powf((current_speed[X_AXIS] - p.previous_speed[X_AXIS]), 2) + powf((current_speed[Y_AXIS] - p.previous_speed[Y_AXIS]), 2));
+        vmax_junction = b.nominal_speed;
+        if (jerk > max_xy_jerk)
+            vmax_junction_factor = (max_xy_jerk / jerk);
+        if (fabsf(current_speed[Z_AXIS] - p.previous_speed[Z_AXIS]) > max_z_jerk)
+            vmax_junction_factor = std::min(vmax_junction_factor, (max_z_jerk / fabsf(current_speed[Z_AXIS] - p.previous_speed[Z_AXIS])));
+        if (fabsf(current_speed[E_AXIS] - p.previous_speed[E_AXIS]) > max_e_jerk)
+            vmax_junction_factor = std::min(vmax_junction_factor, (max_e_jerk / fabsf(current_speed[E_AXIS] - p.previous_speed[E_AXIS])));
+        vmax_junction = std::min(p.previous_nominal_speed, vmax_junction * vmax_junction_factor);
+    }
+    b.max_entry_speed = vmax_junction;
+    b.entry_speed = std::min(vmax_junction, max_allowable_speed(-b.acceleration, MINIMUM_PLANNER_SPEED, b.millimeters));
+
+    memcpy(p.previous_speed, current_speed, sizeof(p.previous_speed));
+    p.previous_nominal_speed = b.nominal_speed;
+    memcpy(p.position, target, sizeof(target));
+    return true;
+}
+
+// planner.cpp now
+static bool plan_after(Planner &p, const float *xyze, float feed_rate, Block &b)
+{
+    long target[NUM_AXIS], delta_steps[NUM_AXIS];
+    if (!steps(p, xyze, target, delta_steps, b))
+        return false;
+    for (int i = 0; i < NUM_AXIS; i++)
+    {
+        if (p.mm_per_step_of[i] != axis_steps_per_unit[i])
+        {
+            p.mm_per_step_of[i] = axis_steps_per_unit[i];
+            p.mm_per_step[i] = 1.0f / axis_steps_per_unit[i];
+        }
+    }
+    if (b.steps_e == 0)
+        feed_rate = std::max(feed_rate, mintravelfeedrate);
+    else
+        feed_rate = std::max(feed_rate, minimumfeedrate);
+
+    float delta_mm[4];
+    delta_mm[X_AXIS] = delta_steps[X_AXIS] * p.mm_per_step[X_AXIS];
+    delta_mm[Y_AXIS] = delta_steps[Y_AXIS] * p.mm_per_step[Y_AXIS];
+    delta_mm[Z_AXIS] = delta_steps[Z_AXIS] * p.mm_per_step[Z_AXIS];
+    delta_mm[E_AXIS] = delta_steps[E_AXIS] * p.mm_per_step[E_AXIS] * (extrudemultiply * 0.01f);
+    if (b.steps_x <= (long)dropsegments && b.steps_y <= (long)dropsegments && b.steps_z <= (long)dropsegments)
+        b.millimeters = fabsf(delta_mm[E_AXIS]);
+    else
+        b.millimeters = sqrtf(square(delta_mm[X_AXIS]) + square(delta_mm[Y_AXIS]) + square(delta_mm[Z_AXIS]));
+    float inverse_millimeters = 1.0f / b.millimeters;
+    float inverse_second = feed_rate * inverse_millimeters;
+
+    b.nominal_speed = b.millimeters * inverse_second;
+    b.nominal_rate = ceilf(b.step_event_count * inverse_second);
+    float current_speed[4];
+    float speed_factor = 1.0f;
+    for (int i = 0; i < 4; i++)
+    {
+        current_speed[i] = delta_mm[i] * inverse_second;
+        if (fabsf(current_speed[i]) > max_feedrate[i])
+            speed_factor = std::min(speed_factor, max_feedrate[i] / fabsf(current_speed[i]));
+    }
+    if (speed_factor < 1.0f)
+    {
+        for (int i = 0; i < 4; i++)
+            current_speed[i] *= speed_factor;
+        b.nominal_speed *= speed_factor;
+        b.nominal_rate *= speed_factor;
+    }
+
+    float steps_per_mm = b.step_event_count * inverse_millimeters;
+    if (b.steps_x == 0 && b.steps_y == 0 && b.steps_z == 0)
+        b.acceleration_st = ceilf(retract_acceleration * steps_per_mm);
+    else
+    {
+        b.acceleration_st = ceilf(acceleration * steps_per_mm);
+        float event_count = (float)b.step_event_count;
+        if ((float)b.acceleration_st * (float)b.steps_x > axis_steps_per_sqr_second[X_AXIS] * event_count)
+            b.acceleration_st = axis_steps_per_sqr_second[X_AXIS];
+        if ((float)b.acceleration_st * (float)b.steps_y > axis_steps_per_sqr_second[Y_AXIS] * event_count)
+            b.acceleration_st = axis_steps_per_sqr_second[Y_AXIS];
+        if ((float)b.acceleration_st * (float)b.steps_e > axis_steps_per_sqr_second[E_AXIS] * event_count)
+            b.acceleration_st = axis_steps_per_sqr_second[E_AXIS];
+        if ((float)b.acceleration_st * (float)b.steps_z > axis_steps_per_sqr_second[Z_AXIS] * event_count)
+            b.acceleration_st = axis_steps_per_sqr_second[Z_AXIS];
+    }
+    b.acceleration = b.acceleration_st / steps_per_mm;
+    b.acceleration_rate = (long)((float)b.acceleration_st * (16777216.0f / (F_CPU / 8.0f)));
+
+    float vmax_junction = max_xy_jerk / 2;
+    float vmax_junction_factor = 1.0f;
+    if (fabsf(current_speed[Z_AXIS]) > max_z_jerk / 2)
+        vmax_junction = std::min(vmax_junction, max_z_jerk / 2);
+    if (fabsf(current_speed[E_AXIS]) > max_e_jerk / 2)
+        vmax_junction = std::min(vmax_junction, max_e_jerk / 2);
+    vmax_junction = std::min(vmax_junction, b.nominal_speed);
+    if (p.previous_nominal_speed > 0.0001f)
+    {
+        float jerk_sq = square(current_speed[X_AXIS] - p.previous_speed[X_AXIS]) + square(current_speed[Y_AXIS] - p.previous_speed[Y_AXIS]);
+        vmax_junction = b.nominal_speed;
+        if (jerk_sq > square(max_xy_jerk))
+            vmax_junction_factor = (max_xy_jerk / sqrtf(jerk_sq));
+        if (fabsf(current_speed[Z_AXIS] - p.previous_speed[Z_AXIS]) > max_z_jerk)
+            vmax_junction_factor = std::min(vmax_junction_factor, (max_z_jerk / fabsf(current_speed[Z_AXIS] - p.previous_speed[Z_AXIS])));
+        if (fabsf(current_speed[E_AXIS] - p.previous_speed[E_AXIS]) > max_e_jerk)
+            vmax_junction_factor = std::min(vmax_junction_factor, (max_e_jerk / fabsf(current_speed[E_AXIS] - p.previous_speed[E_AXIS])));
+        vmax_junction = std::min(p.previous_nominal_speed, vmax_junction * vmax_junction_factor);
+    }
+    b.max_entry_speed = vmax_junction;
+    b.entry_speed = std::min(vmax_junction, max_allowable_speed(-b.acceleration, MINIMUM_PLANNER_SPEED, b.millimeters));
+
+    memcpy(p.previous_speed, current_speed, sizeof(p.previous_speed));
+    p.previous_nominal_speed = b.nominal_speed;
+    memcpy(p.position, target, sizeof(target));
+    return true;
+}
+
+static double rel(float a, float b)
+{
+    if (a == b)
+        return 0;
+    return fabs((double)a - b) / fmax(fabs((double)a), fabs((double)b));
+}
+
+int main(int argc, char **argv)
+{
+    double tolerance = 1e-5;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            tolerance = atof(argv[++i]);
+        else
+            path = argv[i];
+    }
+    if (!path)
+    {
+        fprintf(stderr, "usage: %s [-t tolerance] file.gcode\n", argv[0]);
+        return 2;
+    }
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 2;
+    }
+    for (int i = 0; i < NUM_AXIS; i++)
+        axis_steps_per_sqr_second[i] = max_acceleration_units_per_sq_second[i] * axis_steps_per_unit[i];
+
+    Planner before, after;
+    memset(&before, 0, sizeof(before));
+    memset(&after, 0, sizeof(after));
+    float pos[NUM_AXIS] = {0, 0, 0, 0}, feedrate = 1500;
+    bool relative = false, relative_e = false;
+    unsigned long blocks = 0, int_errors = 0, off_by_one = 0, float_errors = 0, identical = 0, line_no = 0;
+    double worst = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f))
+    {
+        line_no++;
+        char *c = strchr(line, ';');
+        if (c)
+            *c = 0;
+        int g = -1, m = -1;
+        float v[NUM_AXIS + 1];
+        bool seen[NUM_AXIS + 1] = {false, false, false, false, false};
+        for (char *s = line; *s; s++)
+        {
+            if (s != line && s[-1] != ' ' && s[-1] != '\t')
+                continue;
+            const char *axes = "XYZEF";
+            const char *a = strchr(axes, *s);
+            if (*s == 'G')
+                g = atoi(s + 1);
+            else if (*s == 'M')
+                m = atoi(s + 1);
+            else if (a && *a)
+            {
+                v[a - axes] = strtof(s + 1, NULL);
+                seen[a - axes] = true;
+            }
+        }
+        if (g == 90) relative = relative_e = false;
+        else if (g == 91) relative = relative_e = true;
+        else if (m == 82) relative_e = false;
+        else if (m == 83) relative_e = true;
+        else if (g == 92)
+        {
+            for (int i = 0; i < NUM_AXIS; i++)
+                if (seen[i])
+                {
+                    pos[i] = v[i];
+                    before.position[i] = after.position[i] = lroundf(pos[i] * axis_steps_per_unit[i]);
+                }
+        }
+        else if (g == 0 || g == 1)
+        {
+            if (seen[NUM_AXIS])
+                feedrate = v[NUM_AXIS];
+            for (int i = 0; i < NUM_AXIS; i++)
+                if (seen[i])
+                    pos[i] = ((i == E_AXIS) ? relative_e : relative) ? pos[i] + v[i] : v[i];
+            Block a, b;
+            memset(&a, 0, sizeof(a));
+            memset(&b, 0, sizeof(b));
+            bool planned_a = plan_before(before, pos, feedrate / 60.0f, a);
+            bool planned_b = plan_after(after, pos, feedrate / 60.0f, b);
+            if (!planned_a && !planned_b)
+                continue;
+            blocks++;
+            if (planned_a != planned_b || a.steps_x != b.steps_x || a.steps_y != b.steps_y || a.steps_z != b.steps_z ||
+                a.steps_e != b.steps_e || a.step_event_count != b.step_event_count || a.direction_bits != b.direction_bits)
+            {
+                if (int_errors++ < 10)
+                    fprintf(stderr, "line %lu: step counts differ\n", line_no);
+                continue;
+            }
+            long d_rate = (long)a.nominal_rate - (long)b.nominal_rate, d_acc = (long)a.acceleration_st - (long)b.acceleration_st;
+            if (labs(d_rate) > 1 || labs(d_acc) > 1)
+            {
+                if (int_errors++ < 10)
+                    fprintf(stderr, "line %lu: nominal_rate %lu/%lu acceleration_st %lu/%lu\n", line_no, a.nominal_rate,
+                            b.nominal_rate, a.acceleration_st, b.acceleration_st);
+            }
+            else if (d_rate != 0 || d_acc != 0)
+                off_by_one++;
+            float fa[] = {a.millimeters, a.nominal_speed, a.acceleration, a.max_entry_speed, a.entry_speed};
+            float fb[] = {b.millimeters, b.nominal_speed, b.acceleration, b.max_entry_speed, b.entry_speed};
+            bool same = d_rate == 0 && d_acc == 0 && a.acceleration_rate == b.acceleration_rate;
+            // acceleration and entry_speed follow acceleration_st, one step/s^2 more or less moves them by that much
+            double acc_slack = d_acc ? 1.0 / std::min(a.acceleration_st, b.acceleration_st) : 0;
+            for (int i = 0; i < 5; i++)
+            {
+                double r = rel(fa[i], fb[i]);
+                if (r != 0)
+                    same = false;
+                if (r > worst)
+                    worst = r;
+                if (r > tolerance + ((i == 2 || i == 4) ? acc_slack : 0) && float_errors++ < 10)
+                    fprintf(stderr, "line %lu: float field %d %.9g/%.9g\n", line_no, i, fa[i], fb[i]);
+            }
+            if (same)
+                identical++;
+        }
+    }
+    fclose(f);
+    printf("%lu blocks, %lu bit for bit, %lu with nominal_rate/acceleration_st off by one, largest float difference %.3g\n",
+           blocks, identical, off_by_one, worst);
+    printf("step counts and direction bits: %s, floats within %.0e: %s\n", int_errors ? "MISMATCH" : "identical", tolerance,
+           float_errors ? "NO" : "yes");
+    return (int_errors || float_errors) ? 1 : 0;
+}
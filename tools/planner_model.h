@@ -0,0 +1,523 @@
+// The planner of planner.cpp on the host: plan_buffer_line() with its ring buffer of BLOCK_BUFFER_SIZE blocks,
+// the reverse and forward junction passes and calculate_trapezoid_for_block() with the S_CURVE_ACCELERATION
+// and PRINT_TIME_ESTIMATE fields, for the tools that need whole blocks (gcode_estimate, scurve_check).
+// The block set-up is the one planner_compare checks; all arithmetic is single precision like the AVR.
+//
+// The stepper is modelled as always busy: the oldest block is taken as soon as plan_buffer_line() returns and
+// a new block waits for it when the buffer is full, so SLOWDOWN only acts at the start and the planner looks
+// ahead as far as it does on a streaming print. Finished blocks are handed to the block_done callback; the
+// default Configuration_tenlog.h / Configuration_xy.h machine is set up, main() may change it before plan_init().
+//
+// G2/G3 are cut into fixed MM_PER_ARC_SEGMENT chords (ARC_MAX_DEVIATION off) at the end points mc_arc() gives.
+
+#ifndef PLANNER_MODEL_H
+#define PLANNER_MODEL_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define NUM_AXIS 4
+#define X_AXIS 0
+#define Y_AXIS 1
+#define Z_AXIS 2
+#define E_AXIS 3
+#define F_CPU 16000000.0f
+#define BLOCK_BUFFER_SIZE 16
+#define MINIMUM_PLANNER_SPEED 0.05f
+#define MM_PER_ARC_SEGMENT 1
+static const unsigned int dropsegments = 5;
+
+static float axis_steps_per_unit[NUM_AXIS] = {80, 80, 800, 395};
+static float max_feedrate[NUM_AXIS] = {70, 70, 6, 25};
+static unsigned long max_acceleration_units_per_sq_second[NUM_AXIS] = {500, 500, 100, 1000};
+static unsigned long axis_steps_per_sqr_second[NUM_AXIS];
+static float acceleration = 500, retract_acceleration = 500;
+static float max_xy_jerk = 10.0f, max_z_jerk = 0.3f, max_e_jerk = 5.0f;
+static float minimumfeedrate = 0, mintravelfeedrate = 0;
+static unsigned long minsegmenttime = 20000; // DEFAULT_MINSEGMENTTIME, SLOWDOWN is on
+static int extrudemultiply = 100;
+
+// block_t with the AVR type widths (unsigned long is 32 bits there)
+struct Block
+{
+    int32_t steps_x, steps_y, steps_z, steps_e;
+    uint32_t step_event_count;
+    int32_t accelerate_until, decelerate_after, acceleration_rate;
+    unsigned char direction_bits;
+    float nominal_speed, entry_speed, max_entry_speed, millimeters, acceleration;
+    unsigned char recalculate_flag, nominal_length_flag;
+    uint32_t nominal_rate, initial_rate, final_rate, acceleration_st;
+    uint32_t cruise_rate, accel_ticks, decel_ticks;
+    unsigned short accel_inv, decel_inv;
+    unsigned char accel_shift, decel_shift;
+    uint32_t duration_us;
+    bool busy;
+};
+
+static Block block_buffer[BLOCK_BUFFER_SIZE];
+static unsigned char block_buffer_head, block_buffer_tail;
+static long position[NUM_AXIS];
+static float previous_speed[NUM_AXIS];
+static float previous_nominal_speed;
+static float mm_per_step[NUM_AXIS];
+static void (*block_done)(const Block &block);
+
+static float square(float x) { return x * x; }
+static unsigned char next_block_index(unsigned char i) { return (i + 1) & (BLOCK_BUFFER_SIZE - 1); }
+static unsigned char prev_block_index(unsigned char i) { return (i + BLOCK_BUFFER_SIZE - 1) & (BLOCK_BUFFER_SIZE - 1); }
+
+static float estimate_acceleration_distance(float initial_rate, float target_rate, float acceleration)
+{
+    if (acceleration != 0)
+        return (target_rate * target_rate - initial_rate * initial_rate) / (2.0f * acceleration);
+    return 0.0f;
+}
+
+static float intersection_distance(float initial_rate, float final_rate, float acceleration, float distance)
+{
+    if (acceleration != 0)
+        return (2.0f * acceleration * distance - initial_rate * initial_rate + final_rate * final_rate) / (4.0f * acceleration);
+    return 0.0f;
+}
+
+static float max_allowable_speed(float acceleration, float target_velocity, float distance)
+{
+    return sqrtf(target_velocity * target_velocity - 2 * acceleration * distance);
+}
+
+static void calculate_bezier_ramp(float ticks, uint32_t &ramp_ticks, unsigned short &inv, unsigned char &shift)
+{
+    if (ticks < 128 || ticks > 16777215.0f)
+    {
+        ramp_ticks = 0;
+        inv = 0;
+        shift = 0;
+        return;
+    }
+    ramp_ticks = (uint32_t)ticks;
+    uint32_t n = ramp_ticks << 8;
+    shift = 0;
+    while (n > 65535)
+    {
+        n >>= 1;
+        shift++;
+    }
+    inv = std::min((uint32_t)65535, (uint32_t)0x7FFFFFFF / n);
+}
+
+// Like the firmware, the step counts of the ramps come from the rates the block had before (its initial_rate
+// and final_rate are only updated at the end)
+static void calculate_trapezoid_for_block(Block *block, float entry_factor, float exit_factor)
+{
+    uint32_t initial_rate = ceilf(block->nominal_rate * entry_factor);
+    uint32_t final_rate = ceilf(block->nominal_rate * exit_factor);
+    if (initial_rate < 120)
+        initial_rate = 120;
+    if (final_rate < 120)
+        final_rate = 120;
+
+    int32_t acceleration = block->acceleration_st;
+    int32_t accelerate_steps = ceilf(estimate_acceleration_distance(block->initial_rate, block->nominal_rate, acceleration));
+    int32_t decelerate_steps = floorf(estimate_acceleration_distance(block->nominal_rate, block->final_rate, -acceleration));
+    int32_t plateau_steps = block->step_event_count - accelerate_steps - decelerate_steps;
+    if (plateau_steps < 0)
+    {
+        accelerate_steps = ceilf(intersection_distance(block->initial_rate, block->final_rate, acceleration, block->step_event_count));
+        accelerate_steps = std::max(accelerate_steps, (int32_t)0);
+        accelerate_steps = std::min((uint32_t)accelerate_steps, block->step_event_count);
+        plateau_steps = 0;
+    }
+
+    uint32_t cruise_rate = block->nominal_rate;
+    if (plateau_steps == 0)
+        cruise_rate = std::min(cruise_rate, (uint32_t)sqrtf((float)initial_rate * initial_rate + 2.0f * acceleration * accelerate_steps));
+    uint32_t accel_ticks, decel_ticks;
+    unsigned short accel_inv, decel_inv;
+    unsigned char accel_shift, decel_shift;
+    float ticks_per_rate = (F_CPU / 8.0f) / acceleration;
+    calculate_bezier_ramp((cruise_rate > initial_rate) ? (cruise_rate - initial_rate) * ticks_per_rate : 0, accel_ticks, accel_inv, accel_shift);
+    calculate_bezier_ramp((cruise_rate > final_rate) ? (cruise_rate - final_rate) * ticks_per_rate : 0, decel_ticks, decel_inv, decel_shift);
+    float duration = (float)plateau_steps / block->nominal_rate;
+    if (cruise_rate > initial_rate)
+        duration += (float)(cruise_rate - initial_rate) / acceleration;
+    if (cruise_rate > final_rate)
+        duration += (float)(cruise_rate - final_rate) / acceleration;
+
+    if (block->busy == false)
+    {
+        block->accelerate_until = accelerate_steps;
+        block->decelerate_after = accelerate_steps + plateau_steps;
+        block->initial_rate = initial_rate;
+        block->final_rate = final_rate;
+        block->cruise_rate = cruise_rate;
+        block->accel_ticks = accel_ticks;
+        block->accel_inv = accel_inv;
+        block->accel_shift = accel_shift;
+        block->decel_ticks = decel_ticks;
+        block->decel_inv = decel_inv;
+        block->decel_shift = decel_shift;
+        block->duration_us = duration * 1000000.0f;
+    }
+}
+
+static void planner_reverse_pass_kernel(Block *current, Block *next)
+{
+    if (!current || !next)
+        return;
+    if (current->entry_speed != current->max_entry_speed)
+    {
+        if (!current->nominal_length_flag && current->max_entry_speed > next->entry_speed)
+            current->entry_speed = std::min(current->max_entry_speed, max_allowable_speed(-current->acceleration, next->entry_speed, current->millimeters));
+        else
+            current->entry_speed = current->max_entry_speed;
+        current->recalculate_flag = true;
+    }
+}
+
+static void planner_reverse_pass()
+{
+    unsigned char block_index = block_buffer_head;
+    unsigned char tail = block_buffer_tail;
+    if (((block_buffer_head - tail + BLOCK_BUFFER_SIZE) & (BLOCK_BUFFER_SIZE - 1)) > 3)
+    {
+        block_index = (block_buffer_head - 3) & (BLOCK_BUFFER_SIZE - 1);
+        Block *block[3] = {NULL, NULL, NULL};
+        while (block_index != tail)
+        {
+            block_index = prev_block_index(block_index);
+            block[2] = block[1];
+            block[1] = block[0];
+            block[0] = &block_buffer[block_index];
+            planner_reverse_pass_kernel(block[1], block[2]);
+        }
+    }
+}
+
+static void planner_forward_pass_kernel(Block *previous, Block *current)
+{
+    if (!previous)
+        return;
+    if (!previous->nominal_length_flag && previous->entry_speed < current->entry_speed)
+    {
+        float entry_speed = std::min(current->entry_speed, max_allowable_speed(-previous->acceleration, previous->entry_speed, previous->millimeters));
+        if (current->entry_speed != entry_speed)
+        {
+            current->entry_speed = entry_speed;
+            current->recalculate_flag = true;
+        }
+    }
+}
+
+static void planner_forward_pass()
+{
+    unsigned char block_index = block_buffer_tail;
+    Block *block[3] = {NULL, NULL, NULL};
+    while (block_index != block_buffer_head)
+    {
+        block[0] = block[1];
+        block[1] = block[2];
+        block[2] = &block_buffer[block_index];
+        planner_forward_pass_kernel(block[0], block[1]);
+        block_index = next_block_index(block_index);
+    }
+    planner_forward_pass_kernel(block[1], block[2]);
+}
+
+static void planner_recalculate_trapezoids()
+{
+    unsigned char block_index = block_buffer_tail;
+    Block *current, *next = NULL;
+    while (block_index != block_buffer_head)
+    {
+        current = next;
+        next = &block_buffer[block_index];
+        if (current && (current->recalculate_flag || next->recalculate_flag))
+        {
+            calculate_trapezoid_for_block(current, current->entry_speed / current->nominal_speed, next->entry_speed / current->nominal_speed);
+            current->recalculate_flag = false;
+        }
+        block_index = next_block_index(block_index);
+    }
+    if (next != NULL)
+    {
+        calculate_trapezoid_for_block(next, next->entry_speed / next->nominal_speed, MINIMUM_PLANNER_SPEED / next->nominal_speed);
+        next->recalculate_flag = false;
+    }
+}
+
+// The stepper finishes the oldest block and starts on the next one
+static void step_block()
+{
+    if (block_buffer_head == block_buffer_tail)
+        return;
+    if (block_done)
+        block_done(block_buffer[block_buffer_tail]);
+    block_buffer_tail = next_block_index(block_buffer_tail);
+    if (block_buffer_head != block_buffer_tail)
+        block_buffer[block_buffer_tail].busy = true;
+}
+
+static void plan_init()
+{
+    memset(block_buffer, 0, sizeof(block_buffer));
+    block_buffer_head = block_buffer_tail = 0;
+    memset(position, 0, sizeof(position));
+    memset(previous_speed, 0, sizeof(previous_speed));
+    previous_nominal_speed = 0;
+    for (int i = 0; i < NUM_AXIS; i++)
+    {
+        axis_steps_per_sqr_second[i] = max_acceleration_units_per_sq_second[i] * axis_steps_per_unit[i];
+        mm_per_step[i] = 1.0f / axis_steps_per_unit[i];
+    }
+}
+
+// The end of the file: the stepper runs the rest of the buffer
+static void plan_finish()
+{
+    while (block_buffer_head != block_buffer_tail)
+        step_block();
+}
+
+static void plan_set_position(const float *xyze)
+{
+    for (int i = 0; i < NUM_AXIS; i++)
+        position[i] = lroundf(xyze[i] * axis_steps_per_unit[i]);
+    previous_nominal_speed = 0.0f;
+    memset(previous_speed, 0, sizeof(previous_speed));
+}
+
+static void plan_set_e_position(float e)
+{
+    position[E_AXIS] = lroundf(e * axis_steps_per_unit[E_AXIS]);
+}
+
+static void plan_buffer_line(const float *xyze, float feed_rate)
+{
+    unsigned char next_buffer_head = next_block_index(block_buffer_head);
+    if (block_buffer_tail == next_buffer_head)
+        step_block();
+
+    long target[NUM_AXIS], delta_steps[NUM_AXIS];
+    for (int i = 0; i < NUM_AXIS; i++)
+    {
+        target[i] = lroundf(xyze[i] * axis_steps_per_unit[i]);
+        delta_steps[i] = target[i] - position[i];
+    }
+    Block *block = &block_buffer[block_buffer_head];
+    block->busy = false;
+    block->steps_x = labs(delta_steps[X_AXIS]);
+    block->steps_y = labs(delta_steps[Y_AXIS]);
+    block->steps_z = labs(delta_steps[Z_AXIS]);
+    block->steps_e = labs(delta_steps[E_AXIS]) * extrudemultiply / 100;
+    block->step_event_count = std::max(block->steps_x, std::max(block->steps_y, std::max(block->steps_z, block->steps_e)));
+    if (block->step_event_count <= dropsegments)
+        return;
+    block->direction_bits = 0;
+    for (int i = 0; i < NUM_AXIS; i++)
+        if (delta_steps[i] < 0)
+            block->direction_bits |= 1 << i;
+
+    if (block->steps_e == 0)
+        feed_rate = std::max(feed_rate, mintravelfeedrate);
+    else
+        feed_rate = std::max(feed_rate, minimumfeedrate);
+
+    float delta_mm[4];
+    delta_mm[X_AXIS] = delta_steps[X_AXIS] * mm_per_step[X_AXIS];
+    delta_mm[Y_AXIS] = delta_steps[Y_AXIS] * mm_per_step[Y_AXIS];
+    delta_mm[Z_AXIS] = delta_steps[Z_AXIS] * mm_per_step[Z_AXIS];
+    delta_mm[E_AXIS] = delta_steps[E_AXIS] * mm_per_step[E_AXIS] * (extrudemultiply * 0.01f);
+    if (block->steps_x <= (long)dropsegments && block->steps_y <= (long)dropsegments && block->steps_z <= (long)dropsegments)
+        block->millimeters = fabsf(delta_mm[E_AXIS]);
+    else
+        block->millimeters = sqrtf(square(delta_mm[X_AXIS]) + square(delta_mm[Y_AXIS]) + square(delta_mm[Z_AXIS]));
+    float inverse_millimeters = 1.0f / block->millimeters;
+    float inverse_second = feed_rate * inverse_millimeters;
+
+    int moves_queued = (block_buffer_head - block_buffer_tail + BLOCK_BUFFER_SIZE) & (BLOCK_BUFFER_SIZE - 1);
+    unsigned long segment_time = lroundf(1000000.0f / inverse_second);
+    if (moves_queued > 1 && moves_queued < BLOCK_BUFFER_SIZE * 0.5f && segment_time < minsegmenttime)
+        inverse_second = 1000000.0f / (segment_time + lroundf(2 * (minsegmenttime - segment_time) / moves_queued));
+
+    block->nominal_speed = block->millimeters * inverse_second;
+    block->nominal_rate = ceilf(block->step_event_count * inverse_second);
+    float current_speed[4];
+    float speed_factor = 1.0f;
+    for (int i = 0; i < 4; i++)
+    {
+        current_speed[i] = delta_mm[i] * inverse_second;
+        if (fabsf(current_speed[i]) > max_feedrate[i])
+            speed_factor = std::min(speed_factor, max_feedrate[i] / fabsf(current_speed[i]));
+    }
+    if (speed_factor < 1.0f)
+    {
+        for (int i = 0; i < 4; i++)
+            current_speed[i] *= speed_factor;
+        block->nominal_speed *= speed_factor;
+        block->nominal_rate *= speed_factor;
+    }
+
+    float steps_per_mm = block->step_event_count * inverse_millimeters;
+    if (block->steps_x == 0 && block->steps_y == 0 && block->steps_z == 0)
+        block->acceleration_st = ceilf(retract_acceleration * steps_per_mm);
+    else
+    {
+        block->acceleration_st = ceilf(acceleration * steps_per_mm);
+        float event_count = (float)block->step_event_count;
+        if ((float)block->acceleration_st * (float)block->steps_x > axis_steps_per_sqr_second[X_AXIS] * event_count)
+            block->acceleration_st = axis_steps_per_sqr_second[X_AXIS];
+        if ((float)block->acceleration_st * (float)block->steps_y > axis_steps_per_sqr_second[Y_AXIS] * event_count)
+            block->acceleration_st = axis_steps_per_sqr_second[Y_AXIS];
+        if ((float)block->acceleration_st * (float)block->steps_e > axis_steps_per_sqr_second[E_AXIS] * event_count)
+            block->acceleration_st = axis_steps_per_sqr_second[E_AXIS];
+        if ((float)block->acceleration_st * (float)block->steps_z > axis_steps_per_sqr_second[Z_AXIS] * event_count)
+            block->acceleration_st = axis_steps_per_sqr_second[Z_AXIS];
+    }
+    block->acceleration = block->acceleration_st / steps_per_mm;
+    block->acceleration_rate = (long)((float)block->acceleration_st * (16777216.0f / (F_CPU / 8.0f)));
+
+    float vmax_junction = max_xy_jerk / 2;
+    float vmax_junction_factor = 1.0f;
+    if (fabsf(current_speed[Z_AXIS]) > max_z_jerk / 2)
+        vmax_junction = std::min(vmax_junction, max_z_jerk / 2);
+    if (fabsf(current_speed[E_AXIS]) > max_e_jerk / 2)
+        vmax_junction = std::min(vmax_junction, max_e_jerk / 2);
+    vmax_junction = std::min(vmax_junction, block->nominal_speed);
+    float safe_speed = vmax_junction;
+    if (moves_queued > 1 && previous_nominal_speed > 0.0001f)
+    {
+        float jerk_sq = square(current_speed[X_AXIS] - previous_speed[X_AXIS]) + square(current_speed[Y_AXIS] - previous_speed[Y_AXIS]);
+        vmax_junction = block->nominal_speed;
+        if (jerk_sq > square(max_xy_jerk))
+            vmax_junction_factor = max_xy_jerk / sqrtf(jerk_sq);
+        if (fabsf(current_speed[Z_AXIS] - previous_speed[Z_AXIS]) > max_z_jerk)
+            vmax_junction_factor = std::min(vmax_junction_factor, max_z_jerk / fabsf(current_speed[Z_AXIS] - previous_speed[Z_AXIS]));
+        if (fabsf(current_speed[E_AXIS] - previous_speed[E_AXIS]) > max_e_jerk)
+            vmax_junction_factor = std::min(vmax_junction_factor, max_e_jerk / fabsf(current_speed[E_AXIS] - previous_speed[E_AXIS]));
+        vmax_junction = std::min(previous_nominal_speed, vmax_junction * vmax_junction_factor);
+    }
+    block->max_entry_speed = vmax_junction;
+    float v_allowable = max_allowable_speed(-block->acceleration, MINIMUM_PLANNER_SPEED, block->millimeters);
+    block->entry_speed = std::min(vmax_junction, v_allowable);
+    block->nominal_length_flag = block->nominal_speed <= v_allowable;
+    block->recalculate_flag = true;
+
+    memcpy(previous_speed, current_speed, sizeof(previous_speed));
+    previous_nominal_speed = block->nominal_speed;
+    calculate_trapezoid_for_block(block, block->entry_speed / block->nominal_speed, safe_speed / block->nominal_speed);
+    block_buffer_head = next_buffer_head;
+    memcpy(position, target, sizeof(target));
+
+    planner_reverse_pass();
+    planner_forward_pass();
+    planner_recalculate_trapezoids();
+
+    // st_wake_up(): the stepper takes the oldest block
+    block_buffer[block_buffer_tail].busy = true;
+}
+
+// Reads the moves of a G-code file into the planner: G0/G1/G2/G3 with X Y Z E F (I J for arcs), G90/G91,
+// M82/M83, G92. The feed rate is taken at 100% feed multiplier. Returns false if the file can't be read.
+static bool plan_file(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    float pos[NUM_AXIS] = {0, 0, 0, 0}, feedrate = 1500;
+    bool relative = false, relative_e = false;
+    char line[256];
+    while (fgets(line, sizeof(line), f))
+    {
+        char *c = strchr(line, ';');
+        if (c)
+            *c = 0;
+        int g = -1, m = -1;
+        float v[NUM_AXIS + 3]; // X Y Z E F I J
+        bool seen[NUM_AXIS + 3] = {false, false, false, false, false, false, false};
+        for (char *s = line; *s; s++)
+        {
+            if (s != line && s[-1] != ' ' && s[-1] != '\t')
+                continue;
+            const char *words = "XYZEFIJ";
+            const char *a = strchr(words, *s);
+            if (*s == 'G')
+                g = atoi(s + 1);
+            else if (*s == 'M')
+                m = atoi(s + 1);
+            else if (a && *a)
+            {
+                v[a - words] = strtof(s + 1, NULL);
+                seen[a - words] = true;
+            }
+        }
+        if (g == 90) relative = relative_e = false;
+        else if (g == 91) relative = relative_e = true;
+        else if (m == 82) relative_e = false;
+        else if (m == 83) relative_e = true;
+        else if (g == 92)
+        {
+            // command_G92(): X, Y or Z wait for the moves to finish and start from rest
+            for (int i = 0; i < NUM_AXIS; i++)
+                if (seen[i])
+                    pos[i] = v[i];
+            if (seen[X_AXIS] || seen[Y_AXIS] || seen[Z_AXIS])
+            {
+                plan_finish();
+                plan_set_position(pos);
+            }
+            else if (seen[E_AXIS])
+                plan_set_e_position(pos[E_AXIS]);
+        }
+        else if (g >= 0 && g <= 3)
+        {
+            if (seen[NUM_AXIS] && v[NUM_AXIS] > 0)
+                feedrate = v[NUM_AXIS];
+            float target[NUM_AXIS];
+            for (int i = 0; i < NUM_AXIS; i++)
+                target[i] = seen[i] ? (((i == E_AXIS) ? relative_e : relative) ? pos[i] + v[i] : v[i]) : pos[i];
+            if (g >= 2)
+            {
+                // mc_arc() with fixed chords
+                float offset[2] = {seen[5] ? v[5] : 0, seen[6] ? v[6] : 0};
+                float radius = hypotf(offset[0], offset[1]);
+                float center[2] = {pos[X_AXIS] + offset[0], pos[Y_AXIS] + offset[1]};
+                float r_axis0 = -offset[0], r_axis1 = -offset[1];
+                float rt_axis0 = target[X_AXIS] - center[0], rt_axis1 = target[Y_AXIS] - center[1];
+                float angular_travel = atan2f(r_axis0 * rt_axis1 - r_axis1 * rt_axis0, r_axis0 * rt_axis0 + r_axis1 * rt_axis1);
+                if (angular_travel < 0)
+                    angular_travel += 2 * M_PI;
+                if (g == 2)
+                    angular_travel -= 2 * M_PI;
+                float millimeters_of_travel = hypotf(angular_travel * radius, fabsf(target[Z_AXIS] - pos[Z_AXIS]));
+                if (millimeters_of_travel >= 0.001f)
+                {
+                    unsigned short segments = floorf(millimeters_of_travel / MM_PER_ARC_SEGMENT);
+                    if (segments == 0)
+                        segments = 1;
+                    float start[NUM_AXIS];
+                    memcpy(start, pos, sizeof(start));
+                    for (unsigned short i = 1; i < segments; i++)
+                    {
+                        float theta = angular_travel * i / segments, point[NUM_AXIS];
+                        point[X_AXIS] = center[0] + r_axis0 * cosf(theta) - r_axis1 * sinf(theta);
+                        point[Y_AXIS] = center[1] + r_axis0 * sinf(theta) + r_axis1 * cosf(theta);
+                        point[Z_AXIS] = start[Z_AXIS] + (target[Z_AXIS] - start[Z_AXIS]) * i / segments;
+                        point[E_AXIS] = start[E_AXIS] + (target[E_AXIS] - start[E_AXIS]) * i / segments;
+                        plan_buffer_line(point, feedrate / 60.0f);
+                    }
+                }
+            }
+            memcpy(pos, target, sizeof(pos));
+            plan_buffer_line(pos, feedrate / 60.0f);
+        }
+    }
+    fclose(f);
+    plan_finish();
+    return true;
+}
+
+#endif
@@ -0,0 +1,365 @@
+// Checks the S_CURVE_ACCELERATION ramps of stepper.cpp against the trapezoid ramps they replace and times
+// the rate calculation of both.
+//
+// Every case runs the acceleration phase of one block through a model of the stepper interrupt: the rate is
+// taken from bezier_step_rate() or from the trapezoid multiply, turned into a timer interval (exact division
+// with DOUBLE_STEP_FREQUENCY step loops instead of the lookup table) and the interval is added to
+// acceleration_time. The deceleration runs the same ramp back down. A ramp has to end at its end rate on the
+// accelerate_until step (a deceleration at least as close as the trapezoid), accelerate in as long as the
+// trapezoid ramp and never go back; the peak acceleration should be 1.875x the set one and the jerk finite.
+// The ramp functions are copies of the firmware code, calculate_bezier_ramp() and the planner come from
+// planner_model.h.
+//
+// Given G-code files, each is planned with the firmware planner and every block is run through the whole
+// stepper interrupt (acceleration, cruise, deceleration) once with the trapezoid and once with the Bezier
+// ramps. Per file the total time, the peak acceleration and the peak jerk (mm/s^2 and mm/s^3 along the path,
+// over 1ms windows inside the blocks) are reported; the Bezier ramps have to take the same time within 1%.
+//
+// Build: g++ -O2 -o scurve_check scurve_check.cpp
+// Usage: scurve_check [file.gcode ...]      exit status 1 if a ramp or a file fails a check
+
+#include <chrono>
+
+#include "planner_model.h"
+
+#define TICKS_PER_S (F_CPU / 8.0)
+#define DOUBLE_STEP_FREQUENCY 10000
+#define MAX_STEP_FREQUENCY 40000
+
+// The firmware code below with the AVR type widths (unsigned long is 32 bits there)
+
+// stepper.cpp
+static unsigned short bezier_ramp(unsigned short t)
+{
+    unsigned short t2 = ((uint32_t)t * t) >> 16;
+    unsigned short t3 = ((uint32_t)t2 * t) >> 16;
+    unsigned short p = ((uint32_t)10 * 65536 - (uint32_t)15 * t + (uint32_t)6 * t2) >> 4;
+    return ((uint32_t)t3 * p) >> 12;
+}
+
+static unsigned short bezier_step_rate(unsigned short rate_from, unsigned short rate_to, uint32_t elapsed,
+                                       uint32_t ramp_ticks, unsigned short inv, unsigned char shift)
+{
+    if (elapsed > ramp_ticks)
+        elapsed = ramp_ticks;
+    uint32_t t = ((uint32_t)(unsigned short)((elapsed << 8) >> shift) * inv) >> 15;
+    if (t > 65535)
+        t = 65535;
+    unsigned short s;
+    if (t < 32768)
+        s = bezier_ramp(t);
+    else
+        s = 65535 - bezier_ramp(65535 - t);
+    if (rate_to >= rate_from)
+        return rate_from + (((uint32_t)(rate_to - rate_from) * s) >> 16);
+    else
+        return rate_from - (((uint32_t)(rate_from - rate_to) * s) >> 16);
+}
+
+// MultiU24X24toH16 in stepper.cpp
+static unsigned short trapezoid_step_rate(unsigned short initial_rate, uint32_t acceleration_time, uint32_t acceleration_rate)
+{
+    return initial_rate + (unsigned short)(((uint64_t)acceleration_time * acceleration_rate) >> 24);
+}
+
+// Timer ticks to the next interrupt at rate, exact division instead of calc_timer()'s lookup table
+static uint32_t timer_ticks(unsigned long rate, unsigned long &loops)
+{
+    loops = rate > 2 * DOUBLE_STEP_FREQUENCY ? 4 : rate > DOUBLE_STEP_FREQUENCY ? 2 : 1;
+    return (uint32_t)(TICKS_PER_S * loops / (rate < MAX_STEP_FREQUENCY ? rate : MAX_STEP_FREQUENCY));
+}
+
+// The acceleration part of calculate_trapezoid_for_block() for a block that is long enough or too short to cruise
+static Block plan_block(unsigned long initial_rate, unsigned long nominal_rate, long acceleration_st, long steps)
+{
+    Block b;
+    memset(&b, 0, sizeof(b));
+    b.initial_rate = initial_rate;
+    b.nominal_rate = nominal_rate;
+    b.acceleration_st = acceleration_st;
+    b.acceleration_rate = (long)((float)acceleration_st * (16777216.0 / TICKS_PER_S));
+    long accelerate_steps = ceil(((float)nominal_rate * nominal_rate - (float)initial_rate * initial_rate) / (2.0 * acceleration_st));
+    b.cruise_rate = nominal_rate;
+    if (2 * accelerate_steps > steps) // triangle, symmetric to final_rate = initial_rate
+    {
+        accelerate_steps = steps / 2;
+        b.cruise_rate = fmin(nominal_rate, sqrt((float)initial_rate * initial_rate + 2.0 * acceleration_st * accelerate_steps));
+    }
+    b.accelerate_until = accelerate_steps;
+    calculate_bezier_ramp((b.cruise_rate - initial_rate) * (TICKS_PER_S / acceleration_st), b.accel_ticks, b.accel_inv, b.accel_shift);
+    return b;
+}
+
+struct Ramp
+{
+    double seconds;      // over accelerate_until steps
+    unsigned long rate;  // on the last of them
+    double peak_accel;   // steps/s^2 (deceleration as a positive number), over 1ms windows
+    double peak_jerk;    // steps/s^3, over 1ms windows
+    bool monotonic;
+};
+
+// The acceleration (initial to cruise rate) or deceleration (cruise back to initial rate, final_rate = initial_rate)
+// branch of the stepper interrupt, including the clamps that keep the Bezier rate from going back
+static Ramp run_ramp(const Block &b, bool bezier, bool decel)
+{
+    Ramp r = {0, 0, 0, 0, true};
+    uint32_t ramp_time = 0;
+    unsigned short acc_step_rate = decel ? b.cruise_rate : b.initial_rate, dec_step_rate = 0xFFFF;
+    unsigned long last_rate = acc_step_rate, rate = acc_step_rate;
+    long step = 0;
+    double window_start = 0, window_rate = rate, last_accel = 0;
+    bool have_accel = false;
+    while (step <= b.accelerate_until)
+    {
+        unsigned short step_rate;
+        if (!decel)
+        {
+            if (bezier && b.accel_ticks != 0)
+            {
+                step_rate = bezier_step_rate(b.initial_rate, b.cruise_rate, ramp_time, b.accel_ticks, b.accel_inv, b.accel_shift);
+                if (step_rate > acc_step_rate)
+                    acc_step_rate = step_rate;
+            }
+            else
+                acc_step_rate = trapezoid_step_rate(b.initial_rate, ramp_time, b.acceleration_rate);
+            if (acc_step_rate > b.nominal_rate)
+                acc_step_rate = b.nominal_rate;
+            rate = acc_step_rate;
+        }
+        else
+        {
+            if (bezier && b.accel_ticks != 0)
+            {
+                step_rate = bezier_step_rate(acc_step_rate, b.initial_rate, ramp_time, b.accel_ticks, b.accel_inv, b.accel_shift);
+                if (step_rate > dec_step_rate)
+                    step_rate = dec_step_rate;
+                dec_step_rate = step_rate;
+            }
+            else
+            {
+                step_rate = trapezoid_step_rate(0, ramp_time, b.acceleration_rate);
+                step_rate = (step_rate > acc_step_rate) ? b.initial_rate : acc_step_rate - step_rate;
+            }
+            if (step_rate < b.initial_rate)
+                step_rate = b.initial_rate;
+            rate = step_rate;
+        }
+        if (decel ? rate > last_rate : rate < last_rate)
+            r.monotonic = false;
+        last_rate = rate;
+        unsigned long loops;
+        unsigned long timer = timer_ticks(rate, loops);
+        double now = ramp_time / TICKS_PER_S; // when this rate was set
+        step += loops;
+        ramp_time += timer;
+        if (now - window_start >= 0.001)
+        {
+            double accel = fabs((double)rate - window_rate) / (now - window_start);
+            if (accel > r.peak_accel)
+                r.peak_accel = accel;
+            if (have_accel && fabs(accel - last_accel) / (now - window_start) > r.peak_jerk)
+                r.peak_jerk = fabs(accel - last_accel) / (now - window_start);
+            last_accel = accel;
+            have_accel = true;
+            window_start = now;
+            window_rate = rate;
+        }
+    }
+    r.seconds = ramp_time / TICKS_PER_S;
+    r.rate = rate;
+    return r;
+}
+
+struct Profile
+{
+    double seconds;    // of all blocks
+    double peak_accel; // mm/s^2
+    double peak_jerk;  // mm/s^3
+};
+
+// One planned block through the rate calculation of the stepper interrupt, as trapezoid_generator_reset()
+// starts it: acceleration up to accelerate_until, nominal rate, deceleration after decelerate_after
+static void run_block(const Block &b, bool bezier, Profile &p)
+{
+    double mm_per_step = b.millimeters / b.step_event_count;
+    unsigned long loops;
+    uint32_t acceleration_time = timer_ticks(b.initial_rate, loops), deceleration_time = 0, time = 0;
+    unsigned short acc_step_rate = b.initial_rate, dec_step_rate = 0xFFFF;
+    uint32_t step_events_completed = 0;
+    double window_start = 0, window_speed = b.initial_rate * mm_per_step, last_accel = 0;
+    bool have_accel = false;
+    while (true)
+    {
+        step_events_completed += loops;
+        if (step_events_completed >= b.step_event_count)
+            break;
+        unsigned short step_rate;
+        uint32_t timer;
+        if (step_events_completed <= (uint32_t)b.accelerate_until)
+        {
+            if (bezier && b.accel_ticks != 0)
+            {
+                step_rate = bezier_step_rate(b.initial_rate, b.cruise_rate, acceleration_time, b.accel_ticks, b.accel_inv, b.accel_shift);
+                if (step_rate > acc_step_rate)
+                    acc_step_rate = step_rate;
+            }
+            else
+                acc_step_rate = trapezoid_step_rate(b.initial_rate, acceleration_time, b.acceleration_rate);
+            if (acc_step_rate > b.nominal_rate)
+                acc_step_rate = b.nominal_rate;
+            step_rate = acc_step_rate;
+            timer = timer_ticks(step_rate, loops);
+            acceleration_time += timer;
+        }
+        else if (step_events_completed > (uint32_t)b.decelerate_after)
+        {
+            if (bezier && b.decel_ticks != 0)
+            {
+                step_rate = bezier_step_rate(acc_step_rate, b.final_rate, deceleration_time, b.decel_ticks, b.decel_inv, b.decel_shift);
+                if (step_rate > dec_step_rate)
+                    step_rate = dec_step_rate;
+                dec_step_rate = step_rate;
+            }
+            else
+            {
+                step_rate = trapezoid_step_rate(0, deceleration_time, b.acceleration_rate);
+                step_rate = (step_rate > acc_step_rate) ? b.final_rate : acc_step_rate - step_rate;
+            }
+            if (step_rate < b.final_rate)
+                step_rate = b.final_rate;
+            timer = timer_ticks(step_rate, loops);
+            deceleration_time += timer;
+        }
+        else
+        {
+            step_rate = b.nominal_rate;
+            timer = timer_ticks(step_rate, loops);
+        }
+
+        double now = time / TICKS_PER_S, speed = step_rate * mm_per_step;
+        time += timer;
+        if (now - window_start >= 0.001)
+        {
+            double accel = fabs(speed - window_speed) / (now - window_start);
+            p.peak_accel = fmax(p.peak_accel, accel);
+            if (have_accel)
+                p.peak_jerk = fmax(p.peak_jerk, fabs(accel - last_accel) / (now - window_start));
+            last_accel = accel;
+            have_accel = true;
+            window_start = now;
+            window_speed = speed;
+        }
+    }
+    p.seconds += time / TICKS_PER_S;
+}
+
+static Profile file_trap, file_bez;
+static double file_planned;
+static unsigned long file_blocks;
+
+static void check_block(const Block &block)
+{
+    run_block(block, false, file_trap);
+    run_block(block, true, file_bez);
+    file_planned += block.duration_us / 1000000.0;
+    file_blocks++;
+}
+
+// Plans a G-code file and runs its blocks with both ramps, false if it fails a check
+static bool check_file(const char *path)
+{
+    memset(&file_trap, 0, sizeof(file_trap));
+    memset(&file_bez, 0, sizeof(file_bez));
+    file_planned = 0;
+    file_blocks = 0;
+    plan_init();
+    block_done = check_block;
+    if (!plan_file(path))
+    {
+        fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    bool ok = fabs(file_bez.seconds - file_trap.seconds) <= 0.01 * file_trap.seconds;
+    printf("%s: %lu blocks, planned %.1f s\n", path, file_blocks, file_planned);
+    printf("%10s %12s %14s %14s\n", "", "time s", "peak mm/s^2", "peak mm/s^3");
+    printf("%10s %12.1f %14.0f %14.3g\n", "trapezoid", file_trap.seconds, file_trap.peak_accel, file_trap.peak_jerk);
+    printf("%10s %12.1f %14.0f %14.3g%s\n", "Bezier", file_bez.seconds, file_bez.peak_accel, file_bez.peak_jerk,
+           ok ? "" : "  time differs");
+    return ok;
+}
+
+// ns per rate calculation on this machine, only to compare the two against each other
+static double time_rate(const Block &b, bool bezier)
+{
+    const unsigned long n = 20000000;
+    volatile unsigned long sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < n; i++)
+    {
+        unsigned long t = (i * 37) % (b.accel_ticks + 1);
+        if (bezier)
+            sink += bezier_step_rate(b.initial_rate, b.cruise_rate, t, b.accel_ticks, b.accel_inv, b.accel_shift);
+        else
+            sink += trapezoid_step_rate(b.initial_rate, t, b.acceleration_rate);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / n;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        int failed = 0;
+        for (int i = 1; i < argc; i++)
+            if (!check_file(argv[i]))
+                failed++;
+        return failed ? 1 : 0;
+    }
+
+    // steps/s at the start, nominal steps/s, steps/s^2, steps of the block
+    static const long cases[][4] = {
+        {120, 8000, 240000, 100000},   // 100 mm/s, 3000 mm/s^2 at 80 steps/mm
+        {1600, 16000, 240000, 100000}, // 200 mm/s from a 20 mm/s junction
+        {120, 8000, 80000, 100000},    // 1000 mm/s^2
+        {120, 8000, 240000, 200},      // short move, no cruise
+        {120, 30000, 800000, 100000},  // fast, step loops
+        {400, 2000, 40000, 100000},    // slow Z-like move
+        {120, 500, 2000000, 100000},   // ramp too short for a Bezier, stays a trapezoid
+    };
+    int failed = 0;
+    printf("%6s %6s %8s %6s %5s | %9s %6s %9s | %9s %6s %6s %9s\n", "from", "to", "accel", "steps", "ramp", "trap ms", "end",
+           "peak a", "bez ms", "end", "peak", "jerk");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        Block b = plan_block(cases[i][0], cases[i][1], cases[i][2], cases[i][3]);
+        for (int decel = 0; decel < 2; decel++)
+        {
+            Ramp trap = run_ramp(b, false, decel);
+            Ramp bez = run_ramp(b, true, decel);
+            unsigned long end_rate = decel ? b.initial_rate : b.cruise_rate;
+            const char *problem = "";
+            if (!bez.monotonic)
+                problem = "goes back";
+            // the last steps of a deceleration to a low rate are a few ms each, neither ramp quite gets there
+            // in the step count, the Bezier one must not end further off than the trapezoid
+            else if (b.accel_ticks != 0 && labs((long)bez.rate - (long)end_rate) > labs((long)trap.rate - (long)end_rate) + (long)end_rate / 100 + 1)
+                problem = "misses the end rate";
+            else if (!decel && fabs(bez.seconds - trap.seconds) > 0.03 * trap.seconds + 0.0005)
+                problem = "ramp time differs";
+            else if (b.accel_ticks > 0.01 * TICKS_PER_S && (bez.peak_accel > 2.0 * b.acceleration_st || bez.peak_accel < 1.6 * b.acceleration_st))
+                problem = "peak acceleration not ~1.875x";
+            if (*problem)
+                failed++;
+            printf("%6ld %6ld %8ld %6ld %5s | %9.2f %6lu %9.0f | %9.2f %6lu %5.2fx %9.3g %s%s\n", cases[i][0], cases[i][1], cases[i][2],
+                   cases[i][3], decel ? "down" : "up", trap.seconds * 1000, trap.rate, trap.peak_accel, bez.seconds * 1000, bez.rate,
+                   bez.peak_accel / b.acceleration_st, bez.peak_jerk, b.accel_ticks ? "" : "(trapezoid) ", problem);
+        }
+    }
+
+    Block b = plan_block(120, 8000, 240000, 100000);
+    double trap_ns = time_rate(b, false), bez_ns = time_rate(b, true);
+    printf("rate calculation on this host: trapezoid %.2f ns, Bezier %.2f ns (%.1fx)\n", trap_ns, bez_ns, bez_ns / trap_ns);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,290 @@
+// Host simulation of the firmware input shaper (INPUT_SHAPING in stepper.cpp).
+//
+// Plans the G0/G1 X/Y moves of a G-code file as trapezoids that stop at the end
+// of every move, shapes the step positions the way shaping_step() does (1.024ms
+// position history, linear interpolation, Q15 impulse amplitudes from
+// st_set_shaping()) and drives a damped spring model of the toolhead with the
+// result. Reports the toolhead vibration relative to the carriage, unshaped
+// and shaped, so a shaper frequency can be checked against a G-code file.
+//
+// Build: g++ -O2 -o shaper_sim shaper_sim.cpp
+// Usage: shaper_sim [options] file.gcode
+//   -f <Hz>    shaper frequency (M593 F), default 40
+//   -d <zeta>  shaper damping ratio (M593 D), default 0.1
+//   -z         ZVD instead of ZV (SHAPING_ZVD)
+//   -F <Hz>    resonance of the simulated machine, default = -f
+//   -D <zeta>  damping of the simulated machine, default = -d
+//   -a <mm/s2> acceleration, default 3000
+//   -s <steps> X/Y steps per mm, default 80
+//   -r <s>     settle time after the last move, residual vibration is measured there, default 0.5
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static const double TICK = 8.0 / 16000000.0; // stepper timer tick with F_CPU 16MHz, prescaler 8
+static const int SAMPLE_SHIFT = 11;          // SHAPING_SAMPLE_SHIFT
+static const int HISTORY = 64;               // SHAPING_HISTORY
+static const double DT = 10e-6;              // integration step of the toolhead model
+
+struct Move
+{
+    double x0, y0, x1, y1, feedrate, dwell;
+};
+
+struct Shaper
+{
+    unsigned long delay[2]; // timer ticks
+    unsigned short amp[2];  // Q15
+};
+
+// Same arithmetic as st_set_shaping()
+static Shaper make_shaper(double freq, double zeta, bool zvd)
+{
+    Shaper s = {{0, 0}, {0, 0}};
+    if (freq <= 0)
+        return s;
+    if (zeta < 0) zeta = 0;
+    if (zeta > 0.99) zeta = 0.99;
+    double damped = sqrt(1.0 - zeta * zeta);
+    double K = exp(-zeta * M_PI / damped);
+    double period = (1.0 / TICK) / (freq * damped);
+    double max_delay = zvd ? period : period / 2;
+    if (period / 2 < (1 << SAMPLE_SHIFT) || max_delay > (double)(HISTORY - 2) * (1 << SAMPLE_SHIFT))
+    {
+        fprintf(stderr, "shaper frequency %.1f Hz out of range, the firmware turns it off\n", freq);
+        return s;
+    }
+    s.delay[0] = (unsigned long)(period / 2);
+    s.delay[1] = (unsigned long)period;
+    if (zvd)
+    {
+        s.amp[0] = (unsigned short)(32768.0 * 2 * K / ((1 + K) * (1 + K)));
+        s.amp[1] = (unsigned short)(32768.0 * K * K / ((1 + K) * (1 + K)));
+    }
+    else
+        s.amp[0] = (unsigned short)(32768.0 * K / (1 + K));
+    return s;
+}
+
+static bool read_gcode(const char *path, std::vector<Move> &moves)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    char line[256];
+    double x = 0, y = 0, feedrate = 3000;
+    bool relative = false;
+    while (fgets(line, sizeof(line), f))
+    {
+        char *c = strchr(line, ';');
+        if (c) *c = 0;
+        int g = -1;
+        double nx = x, ny = y, dwell = 0;
+        bool xy = false;
+        for (char *p = line; *p; p++)
+        {
+            if (p != line && p[-1] != ' ' && p[-1] != '\t')
+                continue;
+            double v = strtod(p + 1, NULL);
+            switch (*p)
+            {
+            case 'G': g = (int)v; break;
+            case 'X': nx = relative ? x + v : v; xy = true; break;
+            case 'Y': ny = relative ? y + v : v; xy = true; break;
+            case 'F': feedrate = v; break;
+            case 'P': dwell = v / 1000.0; break;
+            case 'S': dwell = v; break;
+            }
+        }
+        if (g == 90) relative = false;
+        else if (g == 91) relative = true;
+        else if (g == 4)
+        {
+            Move m = {x, y, x, y, feedrate, dwell};
+            moves.push_back(m);
+        }
+        else if ((g == 0 || g == 1) && xy)
+        {
+            Move m = {x, y, nx, ny, feedrate, 0};
+            moves.push_back(m);
+            x = nx;
+            y = ny;
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+// Commanded X/Y position in steps, sampled every DT
+static void plan(const std::vector<Move> &moves, double accel, double steps_per_mm, double settle,
+                 std::vector<long> &px, std::vector<long> &py)
+{
+    for (size_t i = 0; i < moves.size(); i++)
+    {
+        const Move &m = moves[i];
+        double dx = m.x1 - m.x0, dy = m.y1 - m.y0;
+        double len = sqrt(dx * dx + dy * dy);
+        double t_total, t_acc = 0, v = 0;
+        if (len == 0)
+            t_total = m.dwell;
+        else
+        {
+            v = m.feedrate / 60.0;
+            t_acc = v / accel;
+            if (accel * t_acc * t_acc > len)
+            {
+                t_acc = sqrt(len / accel);
+                v = accel * t_acc;
+            }
+            t_total = 2 * t_acc + (len - accel * t_acc * t_acc) / v;
+        }
+        for (double t = 0; t < t_total; t += DT)
+        {
+            double s;
+            if (len == 0)
+                s = 0;
+            else if (t < t_acc)
+                s = 0.5 * accel * t * t;
+            else if (t < t_total - t_acc)
+                s = 0.5 * accel * t_acc * t_acc + v * (t - t_acc);
+            else
+            {
+                double r = t_total - t;
+                s = len - 0.5 * accel * r * r;
+            }
+            double f = len == 0 ? 0 : s / len;
+            px.push_back(lround((m.x0 + dx * f) * steps_per_mm));
+            py.push_back(lround((m.y0 + dy * f) * steps_per_mm));
+        }
+    }
+    long lx = px.empty() ? 0 : px.back(), ly = py.empty() ? 0 : py.back();
+    for (double t = 0; t < settle; t += DT)
+    {
+        px.push_back(lx);
+        py.push_back(ly);
+    }
+}
+
+// shaping_step() on a sampled position trace: history every 2048 ticks,
+// interpolated between samples, impulses added in Q15
+static std::vector<long> shape(const std::vector<long> &pos, const Shaper &s)
+{
+    if (s.amp[0] == 0)
+        return pos;
+    std::vector<long> out(pos.size());
+    std::vector<long> history;
+    double ticks_per_dt = DT / TICK;
+    for (size_t i = 0; i < pos.size(); i++)
+    {
+        unsigned long clock = (unsigned long)(i * ticks_per_dt);
+        while (history.size() <= (clock >> SAMPLE_SHIFT))
+            history.push_back(pos[(size_t)((history.size() << SAMPLE_SHIFT) / ticks_per_dt)]);
+        long now = pos[i];
+        long lag = 0;
+        for (int k = 0; k < 2; k++)
+        {
+            if (s.amp[k] == 0)
+                continue;
+            // shaping_reset() fills the history with the start position
+            unsigned long t = clock > s.delay[k] ? clock - s.delay[k] : 0;
+            unsigned long n = t >> SAMPLE_SHIFT;
+            long p0 = history[n], p1 = history[n + 1 < history.size() ? n + 1 : n];
+            long past = p0 + (((p1 - p0) * (long)(t & ((1 << SAMPLE_SHIFT) - 1))) >> SAMPLE_SHIFT);
+            lag += (past - now) * s.amp[k];
+        }
+        out[i] = now + (lag >> 15);
+    }
+    return out;
+}
+
+struct Result
+{
+    double peak, rms, residual;
+};
+
+// Toolhead on a damped spring behind the carriage; vibration is toolhead - carriage
+static Result vibrate(const std::vector<long> &pos, double steps_per_mm, double freq, double zeta, size_t settle_from)
+{
+    Result r = {0, 0, 0};
+    double w = 2 * M_PI * freq;
+    double x = pos.empty() ? 0 : pos[0] / steps_per_mm, v = 0, u_prev = x;
+    double sum = 0;
+    for (size_t i = 0; i < pos.size(); i++)
+    {
+        double u = pos[i] / steps_per_mm;
+        double du = (u - u_prev) / DT;
+        u_prev = u;
+        v += (-w * w * (x - u) - 2 * zeta * w * (v - du)) * DT;
+        x += v * DT;
+        double e = fabs(x - u);
+        if (e > r.peak) r.peak = e;
+        sum += e * e;
+        if (i >= settle_from && e > r.residual) r.residual = e;
+    }
+    r.rms = pos.empty() ? 0 : sqrt(sum / pos.size());
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    double freq = 40, zeta = 0.1, machine_freq = -1, machine_zeta = -1;
+    double accel = 3000, steps_per_mm = 80, settle = 0.5;
+    bool zvd = false;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (argv[i][0] != '-' || argv[i][1] == 0) { path = argv[i]; continue; }
+        char o = argv[i][1];
+        if (o == 'z') { zvd = true; continue; }
+        if (i + 1 >= argc) break;
+        double v = atof(argv[++i]);
+        switch (o)
+        {
+        case 'f': freq = v; break;
+        case 'd': zeta = v; break;
+        case 'F': machine_freq = v; break;
+        case 'D': machine_zeta = v; break;
+        case 'a': accel = v; break;
+        case 's': steps_per_mm = v; break;
+        case 'r': settle = v; break;
+        }
+    }
+    if (!path)
+    {
+        fprintf(stderr, "usage: %s [-f Hz] [-d zeta] [-z] [-F Hz] [-D zeta] [-a accel] [-s steps/mm] [-r s] file.gcode\n", argv[0]);
+        return 2;
+    }
+    if (machine_freq < 0) machine_freq = freq;
+    if (machine_zeta < 0) machine_zeta = zeta;
+
+    std::vector<Move> moves;
+    if (!read_gcode(path, moves))
+    {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 2;
+    }
+    std::vector<long> px, py;
+    plan(moves, accel, steps_per_mm, settle, px, py);
+    Shaper s = make_shaper(freq, zeta, zvd);
+    // residual vibration is measured once the shaped motion has ended as well
+    size_t settle_from = px.size() - (size_t)(settle / DT) + (size_t)(((zvd ? s.delay[1] : s.delay[0]) + (1 << SAMPLE_SHIFT)) * TICK / DT);
+    Shaper none = {{0, 0}, {0, 0}};
+    printf("%zu moves, %.3f s, machine %.1f Hz zeta %.3f, shaper %s %.1f Hz zeta %.3f (delay %.1f ms)\n",
+           moves.size(), px.size() * DT, machine_freq, machine_zeta, zvd ? "ZVD" : "ZV", freq, zeta,
+           (zvd ? s.delay[1] : s.delay[0]) * TICK * 1000);
+    printf("%-5s %-8s %12s %12s %12s\n", "axis", "shaper", "peak mm", "rms mm", "residual mm");
+    for (int axis = 0; axis < 2; axis++)
+    {
+        const std::vector<long> &p = axis ? py : px;
+        for (int shaped = 0; shaped < 2; shaped++)
+        {
+            Result r = vibrate(shape(p, shaped ? s : none), steps_per_mm, machine_freq, machine_zeta, settle_from);
+            printf("%-5c %-8s %12.4f %12.4f %12.4f\n", axis ? 'Y' : 'X', shaped ? (zvd ? "ZVD" : "ZV") : "none",
+                   r.peak, r.rms, r.residual);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,179 @@
+// Compares the step periods of calc_timer() (stepper.cpp) with the exact F_CPU/8/rate ticks for every step
+// rate up to MAX_STEP_FREQUENCY. The tables are the ones speed_lookuptable.h generates, built here for the
+// configuration given on the command line (defaults are those of Configuration_adv.h); calc_timer() and the
+// timer_carry() of STEP_TIMER_FRACTION_BITS are copies of the firmware code.
+//
+// For each rate the average period of 64 interrupts is taken (the carried tick fractions included) and
+// divided by the steps per interrupt. It must be within the table resolution of the exact period: the
+// linear interpolation error between two rows plus two table units for the truncated rows and the rounding.
+//
+// Build: g++ -O2 -o step_interval_check step_interval_check.cpp
+//        add -DSTEP_TIMER_FRACTION_BITS=4, -DSPEED_TABLE_SHIFT=<5..8>, -DDOUBLE_STEP_FREQUENCY=<steps/s>
+//        or -DF_CPU=20000000L to check another configuration
+// Usage: step_interval_check      exit status 1 if a rate is outside the resolution
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+#ifndef F_CPU
+#define F_CPU 16000000L
+#endif
+#ifndef MAX_STEP_FREQUENCY
+#define MAX_STEP_FREQUENCY 40000
+#endif
+#ifndef DOUBLE_STEP_FREQUENCY
+#define DOUBLE_STEP_FREQUENCY 10000
+#endif
+
+// speed_lookuptable.h without the AVR parts
+#define MARLIN_H
+#define PROGMEM
+#include "../Marlin/speed_lookuptable.h"
+
+static char step_loops;
+#ifdef STEP_TIMER_FRACTION_BITS
+static unsigned char timer_fraction;
+static unsigned char timer_remainder;
+#endif
+static unsigned long too_high;
+
+// MultiU16X8toH16 rounds the product to the nearest 1/256
+static unsigned short multi_u16x8_h16(unsigned char a, unsigned short b)
+{
+    uint32_t p = (uint32_t)a * b;
+    return (p >> 8) + ((p >> 7) & 1);
+}
+
+static unsigned short calc_timer(unsigned short step_rate)
+{
+    unsigned short timer;
+    if (step_rate > MAX_STEP_FREQUENCY)
+        step_rate = MAX_STEP_FREQUENCY;
+
+    if (step_rate > 2 * DOUBLE_STEP_FREQUENCY)
+    {
+        step_rate = (step_rate >> 2) & 0x3fff;
+        step_loops = 4;
+    }
+    else if (step_rate > DOUBLE_STEP_FREQUENCY)
+    {
+        step_rate = (step_rate >> 1) & 0x7fff;
+        step_loops = 2;
+    }
+    else
+    {
+        step_loops = 1;
+    }
+
+    if (step_rate < (F_CPU / 500000))
+        step_rate = (F_CPU / 500000);
+    step_rate -= (F_CPU / 500000);
+    if (step_rate >= (8 * 256))
+    {
+        const uint16_t *row = speed_lookuptable_fast[(step_rate - 8 * 256) >> SPEED_TABLE_SHIFT];
+        unsigned char tmp_step_rate = (step_rate & ((1 << SPEED_TABLE_SHIFT) - 1)) << (8 - SPEED_TABLE_SHIFT);
+        timer = row[0] - multi_u16x8_h16(tmp_step_rate, row[1]);
+#ifdef STEP_TIMER_FRACTION_BITS
+        timer_fraction = timer & ((1 << STEP_TIMER_FRACTION_BITS) - 1);
+        timer >>= STEP_TIMER_FRACTION_BITS;
+#endif
+    }
+    else
+    {
+        const uint16_t *row = speed_lookuptable_slow[step_rate >> 3];
+        timer = row[0];
+        timer -= ((unsigned short)row[1] * (unsigned char)(step_rate & 0x0007)) >> 3;
+#ifdef STEP_TIMER_FRACTION_BITS
+        timer_fraction = 0;
+#endif
+    }
+    if (timer < (F_CPU / 16) / DOUBLE_STEP_FREQUENCY)
+    {
+        timer = (F_CPU / 16) / DOUBLE_STEP_FREQUENCY;
+        too_high++;
+    }
+    return timer;
+}
+
+#ifdef STEP_TIMER_FRACTION_BITS
+static unsigned char timer_carry(unsigned char fraction)
+{
+    timer_remainder += fraction;
+    if (timer_remainder < (1 << STEP_TIMER_FRACTION_BITS))
+        return 0;
+    timer_remainder -= (1 << STEP_TIMER_FRACTION_BITS);
+    return 1;
+}
+#endif
+
+int main()
+{
+    const double ticks_per_s = F_CPU / 8.0;
+    const double unit = 1.0 / (1 << SPEED_FAST_BITS); // ticks per table unit above 2048 steps/s
+    const int interrupts = 64;
+    // worst error in ticks and as a fraction of the period, per range of rates
+    static const unsigned long ranges[] = {F_CPU / 500000, 2048, 5000, DOUBLE_STEP_FREQUENCY, 2 * DOUBLE_STEP_FREQUENCY, MAX_STEP_FREQUENCY + 1};
+    const int n_ranges = sizeof(ranges) / sizeof(ranges[0]) - 1;
+    double worst_ticks[n_ranges] = {0}, worst_rel[n_ranges] = {0};
+    unsigned long failed = 0;
+
+    for (unsigned long rate = ranges[0]; rate <= MAX_STEP_FREQUENCY; rate++)
+    {
+        double sum = 0;
+        int loops = 1;
+        for (int i = 0; i < interrupts; i++)
+        {
+            unsigned short timer = calc_timer(rate);
+#ifdef STEP_TIMER_FRACTION_BITS
+            timer += timer_carry(timer_fraction);
+#endif
+            sum += timer;
+            loops = step_loops;
+        }
+        double period = sum / interrupts / loops;
+        double exact = ticks_per_s / rate;
+        double error = fabs(period - exact);
+
+        // what the tables can resolve at this rate, in ticks per interrupt: the error of a straight line
+        // between rows h steps/s apart (h^2/8 times the curvature at the row) and two table units for the
+        // truncated rows and the rounded interpolation
+        unsigned long table_rate = rate / loops - (F_CPU / 500000);
+        double bound;
+        if (table_rate >= 2048)
+        {
+            unsigned long h = 1 << SPEED_TABLE_SHIFT;
+            double r = 2048 + (table_rate - 2048) / h * h + (F_CPU / 500000);
+            bound = (double)h * h / 8 * 2 * ticks_per_s / (r * r * r) + 2 * unit + (SPEED_FAST_BITS ? 1.0 / interrupts : 0);
+        }
+        else
+        {
+            double r = table_rate / 8 * 8 + (F_CPU / 500000);
+            bound = 8.0 * 8 / 8 * 2 * ticks_per_s / (r * r * r) + 2;
+        }
+        if (error * loops > bound)
+        {
+            if (failed++ < 10)
+                fprintf(stderr, "%lu steps/s: %.3f ticks, exact %.3f, allowed %.3f\n", rate, period, exact, bound / loops);
+        }
+        for (int k = 0; k < n_ranges; k++)
+            if (rate >= ranges[k] && rate < ranges[k + 1])
+            {
+                if (error > worst_ticks[k])
+                    worst_ticks[k] = error;
+                if (error / exact > worst_rel[k])
+                    worst_rel[k] = error / exact;
+            }
+    }
+
+    printf("F_CPU %ld, SPEED_TABLE_SHIFT %d, STEP_TIMER_FRACTION_BITS %d, DOUBLE_STEP_FREQUENCY %d, %zu fast table rows\n",
+           (long)F_CPU, SPEED_TABLE_SHIFT, SPEED_FAST_BITS, DOUBLE_STEP_FREQUENCY,
+           sizeof(speed_lookuptable_fast) / sizeof(speed_lookuptable_fast[0]));
+    printf("%14s %12s %12s\n", "steps/s", "worst ticks", "worst %");
+    for (int k = 0; k < n_ranges && ranges[k] <= MAX_STEP_FREQUENCY; k++)
+        printf("%6lu-%-7lu %12.3f %12.4f\n", ranges[k], ranges[k + 1] - 1, worst_ticks[k], worst_rel[k] * 100);
+    if (too_high)
+        printf("%lu periods clamped to the shortest timer\n", too_high);
+    printf("%s\n", failed ? "FAILED" : "all rates within the table resolution");
+    return failed ? 1 : 0;
+}